@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui multimedia
+QT       += core gui multimedia concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -25,15 +25,67 @@ DEFINES += QT_DEPRECATED_WARNINGS
 CONFIG += c++11
 
 SOURCES += \
+        csvcache.cpp \
+        csvfollower.cpp \
+        csvloader.cpp \
+        csvsniffer.cpp \
+        csvtokenizer.cpp \
+        formulasheet.cpp \
+        formulasidecar.cpp \
         graphicseditor.cpp \
         graphicsview.cpp \
+        largefileview.cpp \
+        lineindex.cpp \
         main.cpp \
-        mainwindow.cpp
+        mainwindow.cpp \
+        piecetable.cpp \
+        queryengine.cpp \
+        selectionstats.cpp \
+        sparsegrid.cpp \
+        stylesidecar.cpp \
+        tableaggregate.cpp \
+        tableclipboard.cpp \
+        tabledata.cpp \
+        tablegrouping.cpp \
+        tablejoin.cpp \
+        tablemodel.cpp \
+        tablequery.cpp \
+        tablesearch.cpp \
+        tableserializer.cpp \
+        textfilewriter.cpp \
+        textformatsidecar.cpp \
+        textloader.cpp
 
 HEADERS += \
+        csvcache.h \
+        csvfollower.h \
+        csvloader.h \
+        csvsniffer.h \
+        csvtokenizer.h \
+        formulasheet.h \
+        formulasidecar.h \
         graphicseditor.h \
         graphicsview.h \
-        mainwindow.h
+        largefileview.h \
+        lineindex.h \
+        mainwindow.h \
+        piecetable.h \
+        queryengine.h \
+        selectionstats.h \
+        sparsegrid.h \
+        stylesidecar.h \
+        tableaggregate.h \
+        tableclipboard.h \
+        tabledata.h \
+        tablegrouping.h \
+        tablejoin.h \
+        tablemodel.h \
+        tablequery.h \
+        tablesearch.h \
+        tableserializer.h \
+        textfilewriter.h \
+        textformatsidecar.h \
+        textloader.h
 
 FORMS += \
         graphicseditor.ui \
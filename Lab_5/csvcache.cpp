@@ -0,0 +1,390 @@
+#include "csvcache.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <climits>
+#include <cstring>
+
+namespace
+{
+    const quint32 Magic = 0x54544543; // "TTEC"; при другом порядке байтов не совпадёт
+    const quint32 Version = 2;
+    const qint64 MinCachedSize = 4 * 1024 * 1024;       // Меньшие файлы разбираются за доли секунды
+    const qint64 MaxCacheSize = 2LL * 1024 * 1024 * 1024; // Общий размер каталога кэша
+    const int BufferSize = 1024 * 1024;
+    const int SampleEdge = 64 * 1024; // Начало и конец файла хешируются целиком
+    const int SampleCount = 16;       // и ещё столько кусков по SampleSize байт равномерно по файлу
+    const int SampleSize = 4096;
+
+    // Заголовок записи; за ним смещения строк (rows + 1 штук), затем столбцы. Столбец начинается
+    // с ColumnHeader; у текстового дальше размер буфера (qint64), ссылки CacheCell на каждую строку
+    // и сам буфер, у типизированного — значения (по 8 байт) и битовая карта пустых ячеек.
+    // Каждая часть выровнена до 8 байт
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        qint64 sourceSize;
+        qint64 sourceModified;
+        char hash[20];
+        qint32 rows;
+        qint32 columns;
+        qint32 reserved;
+    };
+
+    struct ColumnHeader
+    {
+        qint32 type;
+        qint32 reserved;
+    };
+
+    struct CacheCell
+    {
+        qint32 offset;
+        qint32 size;
+    };
+
+    qint64 aligned(qint64 size)
+    {
+        return (size + 7) & ~qint64(7);
+    }
+}
+
+CsvCache::CsvCache() : mapped(nullptr),
+                       mappedSize(0),
+                       rows(0)
+{
+}
+
+CsvCache::~CsvCache()
+{
+    close();
+}
+
+bool CsvCache::isWorthCaching(qint64 size)
+{
+    return size >= MinCachedSize;
+}
+
+CsvCache::Key CsvCache::keyFor(const QString &path, const char *data, qint64 size)
+{
+    Key key;
+    key.size = size;
+    key.modified = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+
+    // Читать для хеша весь файл слишком долго; выборка ловит правки, не меняющие размер и время
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(reinterpret_cast<const char *>(&size), sizeof(size));
+    const int edge = static_cast<int>(qMin<qint64>(size, SampleEdge));
+    hash.addData(data, edge);
+    hash.addData(data + size - edge, edge);
+    for (int i = 1; i <= SampleCount; ++i)
+    {
+        const qint64 at = size * i / (SampleCount + 1);
+        hash.addData(data + at, static_cast<int>(qMin<qint64>(SampleSize, size - at)));
+    }
+    key.hash = hash.result();
+    return key;
+}
+
+QString CsvCache::entryPath(const QString &path)
+{
+    QDir cacheDir("../Visual_Lab5/Lab_5/tabCache");
+    QByteArray name = QCryptographicHash::hash(QFileInfo(path).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return cacheDir.absoluteFilePath(QString::fromLatin1(name.toHex()) + ".tcache");
+}
+
+bool CsvCache::open(const QString &path, const Key &key)
+{
+    close();
+    if (!key.isValid())
+        return false;
+
+    file.setFileName(entryPath(path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    auto reject = [this]()
+    {
+        close();
+        return false;
+    };
+
+    mappedSize = file.size();
+    if (mappedSize < static_cast<qint64>(sizeof(Header)))
+        return reject();
+    mapped = file.map(0, mappedSize);
+    if (!mapped)
+        return reject();
+
+    Header header;
+    std::memcpy(&header, mapped, sizeof(header));
+    if (header.magic != Magic || header.version != Version || header.sourceSize != key.size ||
+        header.sourceModified != key.modified || key.hash.size() != static_cast<int>(sizeof(header.hash)) ||
+        std::memcmp(header.hash, key.hash.constData(), sizeof(header.hash)) != 0 ||
+        header.rows < 0 || header.columns <= 0)
+        return reject();
+
+    // Проверяем всю разметку сразу: дальше блоки читаются без проверок
+    qint64 pos = sizeof(Header);
+    const qint64 offsetBytes = (static_cast<qint64>(header.rows) + 1) * sizeof(qint64);
+    if (pos + offsetBytes > mappedSize)
+        return reject();
+    const qint64 *offsets = reinterpret_cast<const qint64 *>(mapped + pos);
+    if (offsets[header.rows] != key.size)
+        return reject();
+    pos += offsetBytes;
+
+    const qint64 cellBytes = static_cast<qint64>(header.rows) * sizeof(CacheCell);
+    const qint64 valueBytes = static_cast<qint64>(header.rows) * sizeof(qint64);
+    const qint64 nullBytes = aligned((static_cast<qint64>(header.rows) + 7) / 8);
+    columnStarts.reserve(header.columns);
+    columnTypes.reserve(header.columns);
+    for (int j = 0; j < header.columns; ++j)
+    {
+        ColumnHeader column;
+        if (pos + static_cast<qint64>(sizeof(column)) > mappedSize)
+            return reject();
+        std::memcpy(&column, mapped + pos, sizeof(column));
+        columnStarts.append(pos);
+        columnTypes.append(column.type);
+        pos += sizeof(column);
+
+        if (column.type == TableColumn::Integer || column.type == TableColumn::Real || column.type == TableColumn::Date)
+        {
+            if (pos + valueBytes + nullBytes > mappedSize)
+                return reject();
+            pos += valueBytes + nullBytes;
+            continue;
+        }
+        if (column.type != TableColumn::Text)
+            return reject();
+
+        qint64 arenaSize = 0;
+        if (pos + static_cast<qint64>(sizeof(arenaSize)) > mappedSize)
+            return reject();
+        std::memcpy(&arenaSize, mapped + pos, sizeof(arenaSize));
+        if (arenaSize < 0 || arenaSize > INT_MAX || pos + static_cast<qint64>(sizeof(arenaSize)) + cellBytes + arenaSize > mappedSize)
+            return reject();
+
+        // Ячейки лежат в буфере подряд и без промежутков
+        const CacheCell *cells = reinterpret_cast<const CacheCell *>(mapped + pos + sizeof(arenaSize));
+        qint64 expected = 0;
+        for (int i = 0; i < header.rows; ++i)
+        {
+            if (cells[i].offset != expected || cells[i].size < 0)
+                return reject();
+            expected += cells[i].size;
+        }
+        if (expected != arenaSize)
+            return reject();
+
+        pos += sizeof(arenaSize) + cellBytes + aligned(arenaSize);
+    }
+
+    rows = header.rows;
+
+    // Время изменения записи служит отметкой последнего использования для вытеснения. Дескриптор
+    // только для чтения не даёт менять атрибуты (Windows), поэтому запись открывается ещё раз на запись
+    QFile touch(file.fileName());
+    if (!touch.open(QIODevice::ReadWrite) || !touch.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime))
+        qDebug() << "Unable to update cache entry time: " << file.fileName() << touch.errorString();
+    return true;
+}
+
+void CsvCache::close()
+{
+    if (mapped)
+        file.unmap(const_cast<uchar *>(mapped));
+    mapped = nullptr;
+    mappedSize = 0;
+    rows = 0;
+    columnStarts.clear();
+    columnTypes.clear();
+    file.close();
+}
+
+void CsvCache::readBlock(int firstRow, int count, QVector<TableColumn> &columns, QVector<qint64> &rowOffsets) const
+{
+    const qint64 *offsets = reinterpret_cast<const qint64 *>(mapped + sizeof(Header));
+    rowOffsets.resize(count);
+    std::memcpy(rowOffsets.data(), offsets + firstRow, count * sizeof(qint64));
+
+    columns = QVector<TableColumn>(columnStarts.size());
+    for (int j = 0; j < columnStarts.size(); ++j)
+    {
+        const uchar *base = mapped + columnStarts.at(j) + sizeof(ColumnHeader);
+        TableColumn &column = columns[j];
+        column.columnType = static_cast<TableColumn::Type>(columnTypes.at(j));
+
+        if (column.columnType != TableColumn::Text)
+        {
+            const qint64 *values = reinterpret_cast<const qint64 *>(base) + firstRow;
+            if (column.columnType == TableColumn::Real)
+            {
+                column.reals.resize(count);
+                std::memcpy(column.reals.data(), values, count * sizeof(double));
+            }
+            else
+            {
+                column.integers.resize(count);
+                std::memcpy(column.integers.data(), values, count * sizeof(qint64));
+            }
+
+            const uchar *bits = base + static_cast<qint64>(rows) * sizeof(qint64);
+            for (int i = 0; i < count; ++i)
+            {
+                const int row = firstRow + i;
+                if (bits[row >> 3] & (1 << (row & 7)))
+                {
+                    if (column.nulls.isEmpty())
+                        column.nulls.resize(count);
+                    column.nulls.setBit(i);
+                }
+            }
+            continue;
+        }
+
+        base += sizeof(qint64);
+        const CacheCell *cells = reinterpret_cast<const CacheCell *>(base) + firstRow;
+        const char *arena = reinterpret_cast<const char *>(base + static_cast<qint64>(rows) * sizeof(CacheCell));
+
+        const int begin = count > 0 ? cells[0].offset : 0;
+        const int end = count > 0 ? cells[count - 1].offset + cells[count - 1].size : 0;
+
+        column.arena = QByteArray(arena + begin, end - begin);
+        column.cells.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            column.cells[i].offset = cells[i].offset - begin;
+            column.cells[i].size = cells[i].size;
+        }
+    }
+}
+
+bool CsvCache::store(const QString &path, const Key &key, const TableData &table, const QVector<qint64> &rowOffsets)
+{
+    if (!key.isValid() || table.isSparse() || table.columnCount() == 0 || rowOffsets.size() != table.rowCount() + 1)
+        return false;
+
+    const QString entry = entryPath(path);
+    QDir cacheDir = QFileInfo(entry).absoluteDir();
+    if (!cacheDir.exists() && !cacheDir.mkpath("."))
+        return false;
+
+    QSaveFile out(entry);
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = Magic;
+    header.version = Version;
+    header.sourceSize = key.size;
+    header.sourceModified = key.modified;
+    std::memcpy(header.hash, key.hash.constData(), qMin<int>(key.hash.size(), sizeof(header.hash)));
+    header.rows = table.rowCount();
+    header.columns = table.columnCount();
+
+    auto writeRaw = [&out](const void *data, qint64 size)
+    {
+        return out.write(static_cast<const char *>(data), size) == size;
+    };
+
+    if (!writeRaw(&header, sizeof(header)) || !writeRaw(rowOffsets.constData(), rowOffsets.size() * sizeof(qint64)))
+        return false;
+
+    // Буфер столбца пишем плотно, в порядке строк, даже если в памяти он успел разрастись
+    QVector<CacheCell> cells(header.rows);
+    QByteArray buffer;
+    buffer.reserve(BufferSize + 64 * 1024);
+    for (int j = 0; j < header.columns; ++j)
+    {
+        const TableColumn &column = table.column(j);
+        ColumnHeader columnHeader;
+        columnHeader.type = column.type();
+        columnHeader.reserved = 0;
+        if (!writeRaw(&columnHeader, sizeof(columnHeader)))
+            return false;
+
+        if (column.type() != TableColumn::Text)
+        {
+            if (column.type() == TableColumn::Real)
+            {
+                if (!writeRaw(column.reals.constData(), column.reals.size() * sizeof(double)))
+                    return false;
+            }
+            else if (!writeRaw(column.integers.constData(), column.integers.size() * sizeof(qint64)))
+            {
+                return false;
+            }
+
+            QByteArray bits(static_cast<int>(aligned((static_cast<qint64>(header.rows) + 7) / 8)), '\0');
+            for (int i = 0; i < header.rows; ++i)
+            {
+                if (column.isEmpty(i))
+                    bits[i >> 3] = static_cast<char>(bits.at(i >> 3) | (1 << (i & 7)));
+            }
+            if (!writeRaw(bits.constData(), bits.size()))
+                return false;
+            continue;
+        }
+
+        qint64 arenaSize = 0;
+        for (int i = 0; i < header.rows; ++i)
+        {
+            cells[i].offset = static_cast<qint32>(arenaSize);
+            cells[i].size = column.rawSize(i);
+            arenaSize += column.rawSize(i);
+            if (arenaSize > INT_MAX)
+                return false;
+        }
+
+        if (!writeRaw(&arenaSize, sizeof(arenaSize)) || !writeRaw(cells.constData(), cells.size() * sizeof(CacheCell)))
+            return false;
+
+        for (int i = 0; i < header.rows; ++i)
+        {
+            buffer.append(column.rawData(i), column.rawSize(i));
+            if (buffer.size() >= BufferSize)
+            {
+                if (!writeRaw(buffer.constData(), buffer.size()))
+                    return false;
+                buffer.resize(0);
+            }
+        }
+        buffer.append(QByteArray(static_cast<int>(aligned(arenaSize) - arenaSize), '\0'));
+        if (!writeRaw(buffer.constData(), buffer.size()))
+            return false;
+        buffer.resize(0);
+    }
+
+    if (!out.commit())
+        return false;
+
+    evict(entry);
+    return true;
+}
+
+void CsvCache::evict(const QString &keep)
+{
+    // Свежие записи идут первыми; всё, что не помещается в лимит после них, удаляем
+    QFileInfo kept(keep);
+    QDir cacheDir = kept.absoluteDir();
+    const QFileInfoList entries = cacheDir.entryInfoList(QStringList() << "*.tcache", QDir::Files, QDir::Time);
+
+    qint64 total = 0;
+    for (const QFileInfo &entry : entries)
+    {
+        total += entry.size();
+        if (total > MaxCacheSize && entry.absoluteFilePath() != kept.absoluteFilePath())
+        {
+            if (QFile::remove(entry.absoluteFilePath()))
+                total -= entry.size();
+        }
+    }
+}
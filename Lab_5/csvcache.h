@@ -0,0 +1,61 @@
+#ifndef CSVCACHE_H
+#define CSVCACHE_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+#include "tabledata.h"
+
+// Двоичный кэш разобранных CSV (tabCache/<хеш пути>.tcache). Запись содержит смещения строк
+// исходного файла и для каждого столбца ссылки на ячейки и буфер текста (или упакованные
+// числа с картой пустых ячеек) ровно в том виде, в каком их хранит TableColumn, поэтому
+// повторное открытие — отображение файла и копирование.
+// Запись действительна, пока у исходного файла те же размер, время изменения и выборочный хеш.
+// Оформление в кэш не входит: оно и так читается из двоичного файла настроек таблицы
+class CsvCache
+{
+public:
+    struct Key
+    {
+        qint64 size = 0;
+        qint64 modified = 0; // Миллисекунды с начала эпохи
+        QByteArray hash;     // SHA-1 по началу, концу и равномерной выборке содержимого
+
+        bool isValid() const { return !hash.isEmpty(); }
+    };
+
+    CsvCache();
+    ~CsvCache();
+
+    // Файлы меньше порога разбираются быстрее, чем окупается запись в кэш
+    static bool isWorthCaching(qint64 size);
+    static Key keyFor(const QString &path, const char *data, qint64 size);
+
+    // Открывает и проверяет запись для файла; false — записи нет, она устарела или повреждена
+    bool open(const QString &path, const Key &key);
+    void close();
+
+    int rowCount() const { return rows; }
+    int columnCount() const { return columnStarts.size(); }
+
+    // Копирует строки [firstRow, firstRow + count) в столбцы формата TableColumn
+    void readBlock(int firstRow, int count, QVector<TableColumn> &columns, QVector<qint64> &rowOffsets) const;
+
+    // Записывает таблицу, только что разобранную из файла, и вытесняет давно не открывавшиеся записи
+    static bool store(const QString &path, const Key &key, const TableData &table, const QVector<qint64> &rowOffsets);
+
+private:
+    static QString entryPath(const QString &path);
+    static void evict(const QString &keep);
+
+    QFile file;
+    const uchar *mapped;
+    qint64 mappedSize;
+    int rows;
+    QVector<qint64> columnStarts; // Начало записи каждого столбца в файле кэша
+    QVector<int> columnTypes;
+};
+
+#endif // CSVCACHE_H
@@ -0,0 +1,138 @@
+#include "csvfollower.h"
+#include "csvtokenizer.h"
+
+#include <QFile>
+#include <QtConcurrent>
+
+namespace
+{
+    const qint64 MaxReadBytes = 16 * 1024 * 1024; // Больше за раз не читаем, остаток — следующим блоком
+    const int PollInterval = 1000;                // мс
+}
+
+CsvFollower::CsvFollower(const QString &path, qint64 offset, int columns, const CsvDialect &dialect, QObject *parent) : QObject(parent),
+                                                                                                                   filePath(path),
+                                                                                                                   position(offset),
+                                                                                                                   columnCount(columns),
+                                                                                                                   fileDialect(dialect)
+{
+    fileWatcher.addPath(path);
+    connect(&fileWatcher, &QFileSystemWatcher::fileChanged, this, &CsvFollower::check);
+    connect(&pollTimer, &QTimer::timeout, this, &CsvFollower::check);
+    connect(&reading, &QFutureWatcher<TailRead>::finished, this, &CsvFollower::readFinished);
+    pollTimer.start(PollInterval);
+
+    // Строки, дописанные между загрузкой и включением слежения
+    check();
+}
+
+CsvFollower::~CsvFollower()
+{
+    cancelled.storeRelease(1);
+    reading.waitForFinished();
+}
+
+void CsvFollower::setOffset(qint64 offset)
+{
+    position = offset;
+}
+
+void CsvFollower::check()
+{
+    if (!active)
+        return;
+    if (reading.isRunning())
+    {
+        pending = true;
+        return;
+    }
+
+    // После замены файла путь выпадает из QFileSystemWatcher — возвращаем его
+    if (fileWatcher.files().isEmpty())
+        fileWatcher.addPath(filePath);
+    pending = false;
+    reading.setFuture(QtConcurrent::run(&CsvFollower::readTail, filePath, position, columnCount, fileDialect, &cancelled));
+}
+
+void CsvFollower::readFinished()
+{
+    const TailRead result = reading.result();
+    if (!active || result.start != position)
+    {
+        check();
+        return;
+    }
+
+    if (result.block.rowCount > 0)
+        emit blockReady(result.block, result.end);
+    position = result.end;
+
+    if (!result.error.isEmpty())
+    {
+        active = false;
+        pollTimer.stop();
+        fileWatcher.removePaths(fileWatcher.files());
+        emit stopped(result.error);
+        return;
+    }
+    if (result.more || pending)
+        check();
+}
+
+CsvFollower::TailRead CsvFollower::readTail(const QString &path, qint64 offset, int columns, const CsvDialect &dialect,
+                                            const QAtomicInt *cancelled)
+{
+    TailRead result;
+    result.start = offset;
+    result.end = offset;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        result.error = tr("Файл %1 больше недоступен").arg(path);
+        return result;
+    }
+    result.fileSize = file.size();
+    if (result.fileSize < offset)
+    {
+        result.error = tr("Файл %1 стал короче загруженного — строки не только дописывают").arg(path);
+        return result;
+    }
+    if (result.fileSize == offset || !file.seek(offset))
+        return result;
+
+    const QByteArray bytes = file.read(qMin(result.fileSize - offset, MaxReadBytes));
+    const char *begin = bytes.constData();
+    const char *end = begin + bytes.size();
+
+    // Берём только записи, которые кончаются переводом строки: последнюю могут ещё дописывать
+    const CsvTokenizer tokenizer(dialect.delimiter, dialect.quote);
+    QVector<CsvField> fields;
+    const char *complete = begin;
+    for (const char *pos = begin; pos < end;)
+    {
+        pos = tokenizer.readRecord(pos, end, fields);
+        if (pos[-1] != '\n')
+            break;
+        complete = pos;
+    }
+    if (complete == begin)
+    {
+        if (bytes.size() == MaxReadBytes)
+            result.error = tr("В файле %1 слишком длинная запись").arg(path);
+        return result;
+    }
+
+    result.block = CsvLoader::parseChunk(begin, complete, offset, dialect, cancelled);
+    result.end = offset + (complete - begin);
+    // Недописанная запись в хвосте не повод читать сразу снова — только упор в MaxReadBytes
+    result.more = bytes.size() == MaxReadBytes && result.end < result.fileSize;
+    if (!result.block.consistent || (result.block.rowCount > 0 && result.block.columns.size() != columns))
+    {
+        // Принятые строки уже разобраны; дальше таблица не соответствует файлу
+        if (result.block.columns.size() != columns)
+            result.block = CsvBlock();
+        result.error = tr("В файл %1 дописаны строки с другим числом столбцов").arg(path);
+    }
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef CSVFOLLOWER_H
+#define CSVFOLLOWER_H
+
+#include <QObject>
+#include <QString>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+
+#include "csvloader.h"
+
+// Слежение за CSV-файлом, в конец которого дописывают строки. При росте файла читаются
+// и разбираются только байты после последней известной позиции, до последней целой записи;
+// недописанная запись остаётся на следующий раз
+class CsvFollower : public QObject
+{
+    Q_OBJECT
+
+public:
+    // offset — конец уже загруженных строк, columns — число столбцов таблицы,
+    // dialect — формат файла, определённый при загрузке
+    CsvFollower(const QString &path, qint64 offset, int columns, const CsvDialect &dialect, QObject *parent = nullptr);
+    ~CsvFollower() override;
+
+    QString path() const { return filePath; }
+    // После сохранения таблицы файл переписан: следить дальше с его нового конца
+    void setOffset(qint64 offset);
+
+signals:
+    // end — позиция в файле сразу после последней строки блока
+    void blockReady(const CsvBlock &block, qint64 end);
+    // Слежение прекращено: файл укоротился, исчез или в нём строки другой ширины
+    void stopped(const QString &reason);
+
+private:
+    struct TailRead
+    {
+        CsvBlock block;
+        qint64 start = 0;    // С какой позиции читали: после setOffset старый результат не нужен
+        qint64 end = 0;      // Позиция после последней разобранной записи
+        qint64 fileSize = 0;
+        bool more = false;   // В файле есть ещё непрочитанные байты
+        QString error;
+    };
+
+    void check();
+    void readFinished();
+    static TailRead readTail(const QString &path, qint64 offset, int columns, const CsvDialect &dialect, const QAtomicInt *cancelled);
+
+    QString filePath;
+    qint64 position;
+    int columnCount;
+    CsvDialect fileDialect;
+    QFileSystemWatcher fileWatcher;
+    QTimer pollTimer; // Запасной опрос: замена файла целиком снимает слежение QFileSystemWatcher
+    QFutureWatcher<TailRead> reading;
+    QAtomicInt cancelled;
+    bool pending = false; // Файл менялся во время чтения
+    bool active = true;
+};
+
+#endif // CSVFOLLOWER_H
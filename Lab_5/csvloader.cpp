@@ -0,0 +1,444 @@
+#include "csvloader.h"
+#include "csvtokenizer.h"
+#include "csvsniffer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QList>
+
+namespace
+{
+    const qint64 ChunkSize = 4 * 1024 * 1024; // Примерный размер куска, который разбирает один поток
+    const int MaxBlocksInFlight = 4;          // Сколько готовых блоков может ждать обработки в GUI
+    const int CacheBlockRows = 64 * 1024;     // Строк в блоке при чтении из кэша разбора
+
+    bool isUtf16(CsvDialect::Encoding encoding)
+    {
+        return encoding == CsvDialect::Utf16LE || encoding == CsvDialect::Utf16BE;
+    }
+
+    // Символ UTF-16 по адресу p, который указывает на начало символа
+    ushort codeUnit(const char *p, bool bigEndian)
+    {
+        const uchar first = static_cast<uchar>(p[0]);
+        const uchar second = static_cast<uchar>(p[1]);
+        return bigEndian ? static_cast<ushort>(first << 8 | second) : static_cast<ushort>(second << 8 | first);
+    }
+
+    // Начало следующей записи UTF-16 по тем же правилам, что CsvTokenizer::readRecord.
+    // Сравниваются целые символы, а не байты: 0x0A бывает и половиной другого символа
+    const char *skipUtf16Record(const char *pos, const char *end, const CsvDialect &dialect)
+    {
+        const bool bigEndian = dialect.encoding == CsvDialect::Utf16BE;
+        const ushort quote = static_cast<uchar>(dialect.quote);
+        const ushort delimiter = static_cast<uchar>(dialect.delimiter);
+        for (;;)
+        {
+            if (pos < end && codeUnit(pos, bigEndian) == quote)
+            {
+                pos += 2;
+                for (;;)
+                {
+                    while (pos < end && codeUnit(pos, bigEndian) != quote)
+                        pos += 2;
+                    if (pos + 2 < end && codeUnit(pos + 2, bigEndian) == quote)
+                    {
+                        pos += 4;
+                        continue;
+                    }
+                    pos = pos < end ? pos + 2 : end;
+                    break;
+                }
+            }
+            while (pos < end)
+            {
+                const ushort unit = codeUnit(pos, bigEndian);
+                if (unit == delimiter || unit == '\n' || unit == '\r')
+                    break;
+                pos += 2;
+            }
+
+            if (pos >= end)
+                return end;
+            const ushort unit = codeUnit(pos, bigEndian);
+            pos += 2;
+            if (unit == delimiter)
+                continue;
+            if (unit == '\r' && pos < end && codeUnit(pos, bigEndian) == '\n')
+                pos += 2;
+            return pos;
+        }
+    }
+
+    // Начало первой записи UTF-16, которая начинается не раньше target; pos — начало записи
+    const char *findUtf16Boundary(const char *pos, const char *end, const char *target, const CsvDialect &dialect)
+    {
+        if (target >= end)
+            return end;
+        while (pos < target)
+        {
+            pos = skipUtf16Record(pos, end, dialect);
+        }
+        return pos;
+    }
+
+    // Читает строку заголовков в dialect.header и возвращает её длину в байтах файла
+    // вместе с переводом строки. UTF-16 разбирается по перекодированному началу файла
+    qint64 readHeader(const char *begin, const char *end, const CsvTokenizer &tokenizer, CsvDialect &dialect)
+    {
+        const bool utf16 = isUtf16(dialect.encoding);
+        const qint64 sample = qMin<qint64>(end - begin, CsvSniffer::SampleSize);
+        const QByteArray head = utf16 ? CsvSniffer::toUtf8(begin, sample & ~1, dialect.encoding)
+                                      : QByteArray::fromRawData(begin, static_cast<int>(sample));
+        const char *headEnd = head.constData() + head.size();
+
+        // Пустые строки перед заголовком пропускаются так же, как при определении формата
+        QVector<CsvField> fields;
+        const char *stop = head.constData();
+        do
+        {
+            stop = tokenizer.readRecord(stop, headEnd, fields);
+        } while (stop < headEnd && fields.size() == 1 && fields.first().size == 0 && !fields.first().quoted);
+
+        for (const CsvField &field : fields)
+        {
+            const QByteArray bytes = tokenizer.fieldBytes(field);
+            dialect.header.append(QString::fromUtf8(utf16 ? bytes : CsvSniffer::toUtf8(bytes.constData(), bytes.size(), dialect.encoding)));
+        }
+
+        const int length = static_cast<int>(stop - head.constData());
+        return utf16 ? CsvSniffer::fromUtf8(head.left(length), dialect.encoding).size() : length;
+    }
+}
+
+CsvLoader::CsvLoader(const QString &path, QObject *parent) : QObject(parent),
+                                                             filePath(path),
+                                                             cancelled(0),
+                                                             freeSlots(MaxBlocksInFlight)
+{
+    qRegisterMetaType<CsvBlock>("CsvBlock");
+}
+
+CsvLoader::~CsvLoader()
+{
+    // Закрытие вкладки во время загрузки: останавливаем рабочие потоки до освобождения памяти
+    cancel();
+    future.waitForFinished();
+}
+
+void CsvLoader::start()
+{
+    if (isRunning())
+        return;
+
+    cancelled.storeRelease(0);
+    future = QtConcurrent::run(this, &CsvLoader::run);
+}
+
+void CsvLoader::cancel()
+{
+    cancelled.storeRelease(1);
+}
+
+bool CsvLoader::isRunning() const
+{
+    return future.isRunning();
+}
+
+void CsvLoader::blockConsumed()
+{
+    freeSlots.release();
+}
+
+bool CsvLoader::waitForSlot()
+{
+    // Ждём, пока GUI разберёт предыдущие блоки, и при этом следим за отменой
+    while (!freeSlots.tryAcquire(1, 50))
+    {
+        if (cancelled.loadAcquire())
+            return false;
+    }
+    return !cancelled.loadAcquire();
+}
+
+bool CsvLoader::runFromCache(CsvCache &cache)
+{
+    const int rows = cache.rowCount();
+    for (int first = 0; first < rows; first += CacheBlockRows)
+    {
+        CsvBlock block;
+        block.rowCount = qMin(CacheBlockRows, rows - first);
+        cache.readBlock(first, block.rowCount, block.columns, block.rowOffsets);
+
+        if (!waitForSlot())
+            return false;
+        emit blockReady(block);
+        emit progressChanged(static_cast<int>(static_cast<qint64>(first + block.rowCount) * 100 / rows));
+    }
+    return true;
+}
+
+void CsvLoader::run()
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        emit finished(false, tr("Не удалось открыть CSV файл"));
+        return;
+    }
+
+    const qint64 size = file.size();
+    if (size == 0)
+    {
+        emit finished(false, tr("Файл CSV пуст или имеет неправильный формат"));
+        return;
+    }
+
+    // Отображаем файл в память; если не вышло (например, сетевой диск), читаем целиком
+    QByteArray fallback;
+    uchar *mapped = file.map(0, size);
+    if (!mapped)
+        fallback = file.readAll();
+    const char *data = mapped ? reinterpret_cast<const char *>(mapped) : fallback.constData();
+    const char *end = data + size;
+
+    // Формат определяется по началу файла, дальше весь файл разбирается подходящим токенизатором.
+    // Метка порядка байтов и строка заголовков в таблицу не попадают
+    dialect = CsvSniffer::sniff(data, size);
+    const CsvTokenizer tokenizer(dialect.delimiter, dialect.quote);
+    const char *body = data + CsvSniffer::bomBytes(dialect).size();
+    if (dialect.hasHeader)
+        body += readHeader(body, end, tokenizer, dialect);
+
+    // Файл уже разбирали и он не менялся — берём готовые столбцы из кэша
+    fromCache = false;
+    key = CsvCache::Key();
+    if (CsvCache::isWorthCaching(size))
+    {
+        key = CsvCache::keyFor(filePath, data, size);
+        CsvCache cache;
+        if (cache.open(filePath, key))
+        {
+            dataEndOffset = size;
+            if (mapped)
+                file.unmap(mapped);
+            fromCache = true;
+            const bool completed = runFromCache(cache);
+            emit finished(completed, QString());
+            return;
+        }
+    }
+
+    // UTF-16 делится на куски по символам перевода строки, а в UTF-8 каждый кусок перекодирует
+    // свой поток в parseChunk. Неполный последний символ (нечётный байт) отбрасывается
+    const char *base = data;
+    const bool utf16 = isUtf16(dialect.encoding);
+    if (utf16)
+        end = body + ((end - body) & ~1);
+
+    // Делим файл на куски, которые заканчиваются на границе записи (переводы строк внутри кавычек не в счёт)
+    QVector<const char *> bounds;
+    bounds.append(body);
+    const char *pos = body;
+    while (end - pos > ChunkSize)
+    {
+        pos = utf16 ? findUtf16Boundary(pos, end, pos + ChunkSize, dialect)
+                    : tokenizer.findRecordBoundary(pos, end, pos + ChunkSize);
+        bounds.append(pos);
+    }
+    if (bounds.last() != end)
+        bounds.append(end);
+
+    // Последняя запись без перевода строки может быть недописанной: её разбираем отдельно,
+    // когда станет ясно, растёт ли файл
+    const char *terminated = bounds.size() > 1 ? bounds.at(bounds.size() - 2) : end;
+    if (terminated < end)
+    {
+        QVector<CsvField> fields;
+        for (const char *record = terminated; record < end;)
+        {
+            if (utf16)
+            {
+                record = skipUtf16Record(record, end, dialect);
+                if (codeUnit(record - 2, dialect.encoding == CsvDialect::Utf16BE) == '\n')
+                    terminated = record;
+            }
+            else
+            {
+                record = tokenizer.readRecord(record, end, fields);
+                if (record[-1] == '\n')
+                    terminated = record;
+            }
+        }
+    }
+    if (terminated < end)
+    {
+        if (terminated == bounds.at(bounds.size() - 2))
+            bounds.removeLast();
+        else
+            bounds.last() = terminated;
+    }
+
+    // Куски разбираются в отдельном пуле, а этот поток по порядку собирает результаты
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    const int chunkCount = bounds.size() - 1;
+    const int window = pool.maxThreadCount() * 2;
+
+    QList<QFuture<CsvBlock>> pending;
+    int next = 0;
+    int columns = -1;
+    bool success = true;
+    QString errorMessage;
+
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        while (next < chunkCount && next - i < window)
+        {
+            pending.append(QtConcurrent::run(&pool, &CsvLoader::parseChunk, bounds[next], bounds[next + 1],
+                                             static_cast<qint64>(bounds[next] - base), dialect,
+                                             static_cast<const QAtomicInt *>(&cancelled)));
+            ++next;
+        }
+
+        CsvBlock block = pending.takeFirst().result();
+        if (cancelled.loadAcquire())
+            break;
+
+        if (columns == -1 && block.rowCount > 0)
+            columns = block.columns.size();
+        if (!block.consistent || (block.rowCount > 0 && block.columns.size() != columns))
+        {
+            success = false;
+            errorMessage = tr("Некорректный CSV файл: строки содержат разное количество столбцов");
+            break;
+        }
+
+        if (!waitForSlot())
+            break;
+
+        if (block.rowCount > 0)
+            emit blockReady(block);
+        emit progressChanged(static_cast<int>((bounds[i + 1] - base) * 100 / (end - base)));
+    }
+
+    // Файл за время разбора не вырос — хвост без перевода строки и есть последняя запись.
+    // Если вырос, запись ещё дописывают: её прочитает слежение за файлом с конца данных
+    dataEndOffset = end - base;
+    if (success && !cancelled.loadAcquire() && terminated < end)
+    {
+        dataEndOffset = terminated - base;
+        if (QFileInfo(filePath).size() == size)
+        {
+            const CsvBlock block = parseChunk(terminated, end, static_cast<qint64>(terminated - base), dialect,
+                                              static_cast<const QAtomicInt *>(&cancelled));
+            if (columns == -1 && block.rowCount > 0)
+                columns = block.columns.size();
+            if (!block.consistent || (block.rowCount > 0 && block.columns.size() != columns))
+            {
+                success = false;
+                errorMessage = tr("Некорректный CSV файл: строки содержат разное количество столбцов");
+            }
+            else if (waitForSlot())
+            {
+                if (block.rowCount > 0)
+                    emit blockReady(block);
+                dataEndOffset = end - base;
+            }
+        }
+    }
+
+    // Отображение нельзя снимать, пока рабочие потоки читают из него
+    const bool userCancelled = cancelled.loadAcquire();
+    if (!success)
+        cancelled.storeRelease(1);
+    pool.waitForDone();
+    if (mapped)
+        file.unmap(mapped);
+
+    if (success && !userCancelled && columns <= 0)
+    {
+        success = false;
+        errorMessage = tr("Файл CSV пуст или имеет неправильный формат");
+    }
+
+    if (!success)
+        emit finished(false, errorMessage);
+    else
+        emit finished(!userCancelled, QString());
+}
+
+CsvBlock CsvLoader::parseChunk(const char *begin, const char *end, qint64 offset, const CsvDialect &dialect,
+                               const QAtomicInt *cancelled)
+{
+    // Загрузчик режет CP1251 и UTF-16 по границам записей исходного файла, поэтому кусок
+    // перекодируется целиком. Смещения строк тогда относятся к перекодированному тексту и загрузчику не нужны
+    QByteArray decoded;
+    if (dialect.encoding != CsvDialect::Utf8)
+    {
+        decoded = CsvSniffer::toUtf8(begin, end - begin, dialect.encoding);
+        begin = decoded.constData();
+        end = begin + decoded.size();
+    }
+
+    const CsvTokenizer tokenizer(dialect.delimiter, dialect.quote);
+    QVector<CsvField> fields;
+    CsvBlock block;
+    const char *pos = begin;
+    while (pos < end)
+    {
+        if ((block.rowCount & 0xFFF) == 0 && cancelled->loadAcquire())
+            break;
+
+        const char *recordStart = pos;
+        pos = tokenizer.readRecord(pos, end, fields);
+
+        // Пустые строки (в том числе завершающий перевод строки) не дают строк таблицы;
+        // "" в таблице из одного столбца — пустая ячейка, а не пустая строка
+        if (fields.size() == 1 && fields.first().size == 0 && !fields.first().quoted)
+            continue;
+
+        if (block.rowCount == 0)
+        {
+            // Первая запись задаёт число столбцов; буферы резервируем с запасом на весь кусок
+            block.columns.resize(fields.size());
+            const int bytesPerColumn = static_cast<int>((end - begin) / fields.size());
+            for (TableColumn &column : block.columns)
+            {
+                column.reserve(0, bytesPerColumn);
+            }
+        }
+        else if (fields.size() != block.columns.size())
+        {
+            block.consistent = false;
+            break;
+        }
+
+        // Поля без удвоенных кавычек копируются в буфер столбца как есть, без перекодирования
+        for (int i = 0; i < fields.size(); ++i)
+        {
+            const CsvField &field = fields.at(i);
+            if (field.escaped)
+            {
+                QByteArray bytes = tokenizer.fieldBytes(field);
+                block.columns[i].append(bytes.constData(), bytes.size());
+            }
+            else
+            {
+                block.columns[i].append(field.data, field.size);
+            }
+        }
+        block.rowOffsets.append(offset + (recordStart - begin));
+        ++block.rowCount;
+    }
+
+    // Числа и даты упаковываем здесь же, в рабочем потоке
+    for (TableColumn &column : block.columns)
+    {
+        column.inferType();
+    }
+    return block;
+}
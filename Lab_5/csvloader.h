@@ -0,0 +1,78 @@
+#ifndef CSVLOADER_H
+#define CSVLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QMetaType>
+
+#include "tabledata.h"
+#include "csvcache.h"
+
+// Блок разобранных строк, который загрузчик передаёт таблице: сразу в столбцовом виде модели
+struct CsvBlock
+{
+    int rowCount = 0;
+    QVector<TableColumn> columns;
+    QVector<qint64> rowOffsets; // Смещения начала каждой строки в файле
+    bool consistent = true; // Все строки блока содержат одинаковое число столбцов
+};
+
+Q_DECLARE_METATYPE(CsvBlock)
+
+// Загрузчик CSV: отображает файл в память, по его началу определяет формат (CsvSniffer),
+// делит файл на куски по границам строк, разбирает куски параллельно и по порядку отдаёт
+// готовые блоки строк в GUI-поток
+class CsvLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CsvLoader(const QString &path, QObject *parent = nullptr);
+    ~CsvLoader() override;
+
+    void start();
+    void cancel();
+    bool isRunning() const;
+
+    // Получатель вызывает после обработки каждого блока, чтобы загрузчик не обгонял GUI
+    void blockConsumed();
+
+    // Ключ кэша разбора и источник данных; читать после finished
+    CsvCache::Key cacheKey() const { return key; }
+    bool loadedFromCache() const { return fromCache; }
+    // Формат файла с заголовками столбцов; читать после finished
+    const CsvDialect &fileDialect() const { return dialect; }
+    // Смещение конца данных, попавших в таблицу; читать после finished. Недописанная
+    // последняя запись растущего файла сюда не входит: с этого места её дочитает слежение
+    qint64 dataEnd() const { return dataEndOffset; }
+
+    // Разбор куска [begin, end), который начинается и кончается на границах записей;
+    // offset — смещение begin в файле. Текст в CP1251 и UTF-16 перекодируется здесь же, в рабочем потоке
+    static CsvBlock parseChunk(const char *begin, const char *end, qint64 offset, const CsvDialect &dialect,
+                               const QAtomicInt *cancelled);
+
+signals:
+    void blockReady(const CsvBlock &block);
+    void progressChanged(int percent);
+    void finished(bool success, const QString &errorMessage);
+
+private:
+    void run();
+    bool runFromCache(CsvCache &cache);
+    bool waitForSlot();
+
+    QString filePath;
+    QFuture<void> future;
+    QAtomicInt cancelled;
+    QSemaphore freeSlots;           // Сколько блоков ещё можно отправить, не дожидаясь GUI
+    CsvCache::Key key;
+    bool fromCache = false;
+    CsvDialect dialect;
+    qint64 dataEndOffset = 0;
+};
+
+#endif // CSVLOADER_H
@@ -0,0 +1,317 @@
+#include "csvsniffer.h"
+#include "csvtokenizer.h"
+
+#include <QHash>
+#include <QTextCodec>
+
+namespace
+{
+    const int MaxSampleRecords = 100; // Записей выборки, по которым выбираются разделитель и заголовок
+    const int ZeroProbeSize = 4096;   // Столько байт просматривается в поисках UTF-16 без метки
+    const int DecodeStep = 64 * 1024 * 1024;
+
+    // Кандидаты в разделители; при равной согласованности выигрывает более редкий символ,
+    // например точка с запятой у файлов с десятичной запятой
+    const char Delimiters[] = {'\t', ';', '|', ','};
+
+    QTextCodec *codecFor(CsvDialect::Encoding encoding)
+    {
+        switch (encoding)
+        {
+        case CsvDialect::Utf16LE:
+            return QTextCodec::codecForName("UTF-16LE");
+        case CsvDialect::Utf16BE:
+            return QTextCodec::codecForName("UTF-16BE");
+        case CsvDialect::Cp1251:
+            return QTextCodec::codecForName("Windows-1251");
+        default:
+            return QTextCodec::codecForName("UTF-8");
+        }
+    }
+
+    bool isUtf16(CsvDialect::Encoding encoding)
+    {
+        return encoding == CsvDialect::Utf16LE || encoding == CsvDialect::Utf16BE;
+    }
+
+    // Корректен ли UTF-8; последовательность, оборванная концом выборки, ошибкой не считается
+    bool isUtf8(const uchar *data, int size, bool truncated)
+    {
+        int i = 0;
+        while (i < size)
+        {
+            const uchar c = data[i];
+            if (c < 0x80)
+            {
+                ++i;
+                continue;
+            }
+
+            int length = 0;
+            if (c >= 0xC2 && c <= 0xDF)
+                length = 2;
+            else if (c >= 0xE0 && c <= 0xEF)
+                length = 3;
+            else if (c >= 0xF0 && c <= 0xF4)
+                length = 4;
+            else
+                return false;
+
+            if (i + length > size)
+                return truncated;
+            for (int k = 1; k < length; ++k)
+            {
+                if ((data[i + k] & 0xC0) != 0x80)
+                    return false;
+            }
+            i += length;
+        }
+        return true;
+    }
+
+    CsvDialect::Encoding detectEncoding(const uchar *data, int size, bool truncated, bool &bom)
+    {
+        bom = true;
+        if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF)
+            return CsvDialect::Utf8;
+        if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE)
+            return CsvDialect::Utf16LE;
+        if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF)
+            return CsvDialect::Utf16BE;
+        bom = false;
+
+        // UTF-16 без метки выдают нулевые старшие байты у латиницы, цифр и разделителей
+        const int probe = qMin(size, ZeroProbeSize) & ~1;
+        int evenZeros = 0;
+        int oddZeros = 0;
+        for (int i = 0; i < probe; i += 2)
+        {
+            evenZeros += data[i] == 0;
+            oddZeros += data[i + 1] == 0;
+        }
+        if (evenZeros == 0 && oddZeros > probe / 8)
+            return CsvDialect::Utf16LE;
+        if (oddZeros == 0 && evenZeros > probe / 8)
+            return CsvDialect::Utf16BE;
+
+        return isUtf8(data, size, truncated) ? CsvDialect::Utf8 : CsvDialect::Cp1251;
+    }
+
+    QByteArray detectLineEnd(const QByteArray &text)
+    {
+        const int lf = text.indexOf('\n');
+        const int cr = text.indexOf('\r');
+        if (cr >= 0 && (lf < 0 || cr < lf - 1))
+            return "\r";
+        if (lf > 0 && text.at(lf - 1) == '\r')
+            return "\r\n";
+        if (lf >= 0)
+            return "\n";
+        return QByteArray();
+    }
+
+    bool startsField(const QByteArray &text, int i)
+    {
+        if (i == 0)
+            return true;
+        const char previous = text.at(i - 1);
+        return previous == '\n' || previous == '\r' || previous == ',' || previous == ';' || previous == '\t' || previous == '|';
+    }
+
+    // Апострофы в роли кавычек встречаются, только если двойных кавычек в начале полей меньше
+    char detectQuote(const QByteArray &text)
+    {
+        int doubles = 0;
+        int singles = 0;
+        for (int i = 0; i < text.size(); ++i)
+        {
+            const char c = text.at(i);
+            if (c == '"' && startsField(text, i))
+                ++doubles;
+            else if (c == '\'' && startsField(text, i))
+                ++singles;
+        }
+        return singles > doubles ? '\'' : '"';
+    }
+
+    // Разделитель, при котором наибольшая доля записей выборки имеет одну и ту же ширину
+    // больше одного поля
+    char detectDelimiter(const QByteArray &text, char quote)
+    {
+        const char *end = text.constData() + text.size();
+        QVector<CsvField> fields;
+        char best = ',';
+        double bestShare = 0;
+        for (char candidate : Delimiters)
+        {
+            CsvTokenizer tokenizer(candidate, quote);
+            QHash<int, int> widths;
+            int records = 0;
+            for (const char *pos = text.constData(); pos < end && records < MaxSampleRecords;)
+            {
+                pos = tokenizer.readRecord(pos, end, fields);
+                if (fields.size() == 1 && fields.first().size == 0)
+                    continue;
+                ++widths[fields.size()];
+                ++records;
+            }
+
+            int width = 1;
+            int count = 0;
+            for (auto it = widths.constBegin(); it != widths.constEnd(); ++it)
+            {
+                if (it.value() > count)
+                {
+                    width = it.key();
+                    count = it.value();
+                }
+            }
+            if (width < 2)
+                continue;
+
+            const double share = static_cast<double>(count) / records;
+            if (share > bestShare)
+            {
+                best = candidate;
+                bestShare = share;
+            }
+        }
+        return best;
+    }
+
+    // Первая запись — заголовок, если под ней числа или даты, а в ней самой текст, или если
+    // все значения текстового столбца одной длины, а первое другой. Голосуют столбцы
+    bool detectHeader(const QByteArray &text, const CsvDialect &dialect)
+    {
+        CsvTokenizer tokenizer(dialect.delimiter, dialect.quote);
+        const char *end = text.constData() + text.size();
+        QVector<CsvField> fields;
+        QVector<QByteArray> first;
+        QVector<TableColumn> columns;
+        int rows = 0;
+        for (const char *pos = text.constData(); pos < end && rows < MaxSampleRecords;)
+        {
+            pos = tokenizer.readRecord(pos, end, fields);
+            if (fields.size() == 1 && fields.first().size == 0)
+                continue;
+
+            if (first.isEmpty())
+            {
+                for (const CsvField &field : fields)
+                {
+                    first.append(tokenizer.fieldBytes(field));
+                }
+                columns.resize(fields.size());
+                continue;
+            }
+            if (fields.size() != columns.size())
+                return false;
+
+            for (int j = 0; j < fields.size(); ++j)
+            {
+                const QByteArray bytes = tokenizer.fieldBytes(fields.at(j));
+                columns[j].append(bytes.constData(), bytes.size());
+            }
+            ++rows;
+        }
+        if (rows == 0)
+            return false;
+
+        int votes = 0;
+        for (int j = 0; j < columns.size(); ++j)
+        {
+            if (first.at(j).isEmpty())
+                continue;
+
+            TableColumn &column = columns[j];
+            column.inferType();
+            if (column.type() != TableColumn::Text)
+            {
+                TableColumn probe;
+                probe.append(first.at(j).constData(), first.at(j).size());
+                probe.inferType();
+                votes += probe.type() == TableColumn::Text ? 1 : -1;
+                continue;
+            }
+
+            const int length = column.rawSize(0);
+            bool sameLength = true;
+            for (int i = 1; i < rows && sameLength; ++i)
+            {
+                sameLength = column.rawSize(i) == length;
+            }
+            if (sameLength)
+                votes += first.at(j).size() != length ? 1 : -1;
+        }
+        return votes > 0;
+    }
+}
+
+CsvDialect CsvSniffer::sniff(const char *data, qint64 size)
+{
+    CsvDialect dialect;
+    const int sampleSize = static_cast<int>(qMin<qint64>(size, SampleSize));
+    const bool truncated = size > sampleSize;
+    dialect.encoding = detectEncoding(reinterpret_cast<const uchar *>(data), sampleSize, truncated, dialect.bom);
+
+    // Остальное ищем в тексте выборки: UTF-16 переводим в UTF-8, а CP1251 в ASCII совпадает с UTF-8
+    const int skip = bomBytes(dialect).size();
+    QByteArray text = isUtf16(dialect.encoding) ? toUtf8(data + skip, (sampleSize - skip) & ~1, dialect.encoding)
+                                                 : QByteArray::fromRawData(data + skip, sampleSize - skip);
+
+    // Последняя запись обрезанной выборки неполная и исказила бы ширину записей
+    if (truncated)
+    {
+        const int last = text.lastIndexOf('\n');
+        if (last >= 0)
+            text = text.left(last + 1);
+    }
+
+    dialect.lineEnd = detectLineEnd(text);
+    dialect.quote = detectQuote(text);
+    dialect.delimiter = detectDelimiter(text, dialect.quote);
+    dialect.hasHeader = detectHeader(text, dialect);
+    return dialect;
+}
+
+QByteArray CsvSniffer::bomBytes(const CsvDialect &dialect)
+{
+    if (!dialect.bom)
+        return QByteArray();
+    switch (dialect.encoding)
+    {
+    case CsvDialect::Utf8:
+        return QByteArray("\xEF\xBB\xBF");
+    case CsvDialect::Utf16LE:
+        return QByteArray("\xFF\xFE");
+    case CsvDialect::Utf16BE:
+        return QByteArray("\xFE\xFF");
+    default:
+        return QByteArray();
+    }
+}
+
+QByteArray CsvSniffer::toUtf8(const char *data, qint64 size, CsvDialect::Encoding encoding)
+{
+    if (encoding == CsvDialect::Utf8)
+        return QByteArray(data, static_cast<int>(size));
+
+    // Метку порядка байтов вызывающий уже пропустил; большие файлы декодируются частями
+    QTextDecoder decoder(codecFor(encoding), QTextCodec::IgnoreHeader);
+    QByteArray utf8;
+    for (qint64 done = 0; done < size; done += DecodeStep)
+    {
+        utf8 += decoder.toUnicode(data + done, static_cast<int>(qMin<qint64>(DecodeStep, size - done))).toUtf8();
+    }
+    return utf8;
+}
+
+QByteArray CsvSniffer::fromUtf8(const QByteArray &utf8, CsvDialect::Encoding encoding)
+{
+    if (encoding == CsvDialect::Utf8)
+        return utf8;
+
+    // Метку порядка байтов пишет сериализатор один раз в начале файла
+    QTextEncoder encoder(codecFor(encoding), QTextCodec::IgnoreHeader);
+    return encoder.fromUnicode(QString::fromUtf8(utf8));
+}
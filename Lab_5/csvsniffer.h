@@ -0,0 +1,27 @@
+#ifndef CSVSNIFFER_H
+#define CSVSNIFFER_H
+
+#include <QByteArray>
+
+#include "tabledata.h"
+
+// Определение формата CSV по первым SampleSize байтам файла, без отдельного прохода по всему
+// файлу: кодировка (метка порядка байтов, проверка UTF-8, иначе CP1251), перевод строки,
+// кавычка, разделитель (при котором записи выборки одной ширины) и строка заголовков
+class CsvSniffer
+{
+public:
+    static const int SampleSize = 256 * 1024;
+
+    // data — начало файла размером size; заголовки (CsvDialect::header) заполняет загрузчик
+    static CsvDialect sniff(const char *data, qint64 size);
+
+    // Метка порядка байтов, с которой файл начинается (или пустой массив)
+    static QByteArray bomBytes(const CsvDialect &dialect);
+
+    // Перекодирование между кодировкой файла и UTF-8, в котором хранит текст таблица
+    static QByteArray toUtf8(const char *data, qint64 size, CsvDialect::Encoding encoding);
+    static QByteArray fromUtf8(const QByteArray &utf8, CsvDialect::Encoding encoding);
+};
+
+#endif // CSVSNIFFER_H
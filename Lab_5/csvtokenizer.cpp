@@ -0,0 +1,252 @@
+#include "csvtokenizer.h"
+
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSV_TOKENIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+CsvTokenizer::CsvTokenizer(char delimiter, char quote) : delimiterChar(delimiter),
+                                                         quoteChar(quote)
+{
+    std::memset(structural, 0, sizeof(structural));
+    structural[static_cast<uchar>(delimiterChar)] = true;
+    structural[static_cast<uchar>('\n')] = true;
+    structural[static_cast<uchar>('\r')] = true;
+}
+
+const char *CsvTokenizer::findStructural(const char *pos, const char *end) const
+{
+#ifdef CSV_TOKENIZER_SSE2
+    const __m128i delimiters = _mm_set1_epi8(delimiterChar);
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i returns = _mm_set1_epi8('\r');
+    while (end - pos >= 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+        const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, delimiters),
+                                                       _mm_cmpeq_epi8(chunk, newlines)),
+                                          _mm_cmpeq_epi8(chunk, returns));
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask)
+            return pos + qCountTrailingZeroBits(static_cast<quint32>(mask));
+        pos += 16;
+    }
+#endif
+    while (pos < end && !structural[static_cast<uchar>(*pos)])
+        ++pos;
+    return pos;
+}
+
+const char *CsvTokenizer::findByte(const char *pos, const char *end, char byte) const
+{
+#ifdef CSV_TOKENIZER_SSE2
+    const __m128i needle = _mm_set1_epi8(byte);
+    while (end - pos >= 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask)
+            return pos + qCountTrailingZeroBits(static_cast<quint32>(mask));
+        pos += 16;
+    }
+#endif
+    while (pos < end && *pos != byte)
+        ++pos;
+    return pos;
+}
+
+const char *CsvTokenizer::readRecord(const char *pos, const char *end, QVector<CsvField> &fields) const
+{
+    fields.clear();
+    for (;;)
+    {
+        CsvField field;
+        if (pos < end && *pos == quoteChar)
+        {
+            // Поле в кавычках: ищем закрывающую кавычку, пропуская удвоенные
+            const char *start = ++pos;
+            bool escaped = false;
+            for (;;)
+            {
+                const char *quote = findByte(pos, end, quoteChar);
+                if (quote + 1 < end && quote[1] == quoteChar)
+                {
+                    escaped = true;
+                    pos = quote + 2;
+                    continue;
+                }
+                field.data = start;
+                field.size = static_cast<int>(quote - start);
+                field.escaped = escaped;
+                field.quoted = true;
+                pos = quote < end ? quote + 1 : end;
+                break;
+            }
+            // Мусор между закрывающей кавычкой и разделителем отбрасываем, как это делают табличные редакторы
+            pos = findStructural(pos, end);
+        }
+        else
+        {
+            const char *stop = findStructural(pos, end);
+            field.data = pos;
+            field.size = static_cast<int>(stop - pos);
+            field.escaped = false;
+            field.quoted = false;
+            pos = stop;
+        }
+        fields.append(field);
+
+        if (pos >= end)
+            return end;
+        if (*pos == delimiterChar)
+        {
+            ++pos;
+            continue;
+        }
+        if (*pos == '\r')
+        {
+            ++pos;
+            if (pos < end && *pos == '\n')
+                ++pos;
+            return pos;
+        }
+        return pos + 1; // '\n'
+    }
+}
+
+const char *CsvTokenizer::skipRecord(const char *pos, const char *end) const
+{
+    // Те же правила, что в readRecord, но без сбора полей
+    for (;;)
+    {
+        if (pos < end && *pos == quoteChar)
+        {
+            ++pos;
+            for (;;)
+            {
+                const char *quote = findByte(pos, end, quoteChar);
+                if (quote + 1 < end && quote[1] == quoteChar)
+                {
+                    pos = quote + 2;
+                    continue;
+                }
+                pos = quote < end ? quote + 1 : end;
+                break;
+            }
+        }
+        pos = findStructural(pos, end);
+
+        if (pos >= end)
+            return end;
+        if (*pos == delimiterChar)
+        {
+            ++pos;
+            continue;
+        }
+        if (*pos == '\r')
+        {
+            ++pos;
+            if (pos < end && *pos == '\n')
+                ++pos;
+            return pos;
+        }
+        return pos + 1; // '\n'
+    }
+}
+
+const char *CsvTokenizer::findRecordBoundary(const char *pos, const char *end, const char *target) const
+{
+    if (target >= end)
+        return end;
+
+    // Записи проходятся от pos так же, как при последовательном разборе: кавычку открывает
+    // только первый символ поля, а кавычка внутри поля (5" pipe) остаётся обычным символом
+    while (pos < target)
+    {
+        pos = skipRecord(pos, end);
+    }
+    return pos;
+}
+
+QByteArray CsvTokenizer::fieldBytes(const CsvField &field) const
+{
+    if (!field.escaped)
+        return QByteArray(field.data, field.size);
+
+    // Сворачиваем удвоенные кавычки
+    QByteArray bytes;
+    bytes.reserve(field.size);
+    const char *end = field.data + field.size;
+    for (const char *p = field.data; p < end; ++p)
+    {
+        bytes.append(*p);
+        if (*p == quoteChar && p + 1 < end && p[1] == quoteChar)
+            ++p;
+    }
+    return bytes;
+}
+
+QString CsvTokenizer::fieldText(const CsvField &field) const
+{
+    if (!field.escaped)
+        return QString::fromUtf8(field.data, field.size);
+    return QString::fromUtf8(fieldBytes(field));
+}
+
+bool CsvTokenizer::needsQuoting(const char *data, int size) const
+{
+    const char *end = data + size;
+    return findStructural(data, end) != end || findByte(data, end, quoteChar) != end;
+}
+
+void CsvTokenizer::appendField(QByteArray &out, const char *data, int size) const
+{
+    if (!needsQuoting(data, size))
+    {
+        out.append(data, size);
+        return;
+    }
+
+    out.append(quoteChar);
+    const char *end = data + size;
+    for (const char *p = data; p < end; ++p)
+    {
+        if (*p == quoteChar)
+            out.append(quoteChar);
+        out.append(*p);
+    }
+    out.append(quoteChar);
+}
+
+void CsvTokenizer::appendSoleField(QByteArray &out, const char *data, int size) const
+{
+    if (size == 0)
+    {
+        out.append(quoteChar);
+        out.append(quoteChar);
+        return;
+    }
+    appendField(out, data, size);
+}
+
+QByteArray CsvTokenizer::formatRecord(const QStringList &cells) const
+{
+    QByteArray record;
+    if (cells.size() == 1)
+    {
+        appendSoleField(record, cells.first().toUtf8());
+        record.append('\n');
+        return record;
+    }
+    for (int i = 0; i < cells.size(); ++i)
+    {
+        if (i > 0)
+            record.append(delimiterChar);
+        appendField(record, cells.at(i).toUtf8());
+    }
+    record.append('\n');
+    return record;
+}
@@ -0,0 +1,57 @@
+#ifndef CSVTOKENIZER_H
+#define CSVTOKENIZER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Поле записи: указывает прямо в исходный буфер, копирование происходит только при декодировании
+struct CsvField
+{
+    const char *data;
+    int size;
+    bool escaped; // Внутри поля есть удвоенные кавычки, их нужно свернуть
+    bool quoted;  // Поле было в кавычках: "" — пустое значение, а не пустая строка файла
+};
+
+// Разбор CSV по RFC 4180 прямо по байтам UTF-8: поля в кавычках, запятые и переводы
+// строк внутри кавычек, удвоенные кавычки. Поиск разделителей ведётся по 16 байт за раз (SSE2),
+// на остальных платформах работает обычный побайтовый цикл
+class CsvTokenizer
+{
+public:
+    explicit CsvTokenizer(char delimiter = ',', char quote = '"');
+
+    char delimiter() const { return delimiterChar; }
+    char quote() const { return quoteChar; }
+
+    // Читает одну запись начиная с pos и возвращает указатель на начало следующей
+    const char *readRecord(const char *pos, const char *end, QVector<CsvField> &fields) const;
+
+    // Начало первой записи, которая начинается не раньше target; pos должен быть началом записи
+    const char *findRecordBoundary(const char *pos, const char *end, const char *target) const;
+
+    QString fieldText(const CsvField &field) const;
+    QByteArray fieldBytes(const CsvField &field) const;
+
+    // Запись в обратную сторону: кавычки ставятся только там, где без них запись не прочитать
+    void appendField(QByteArray &out, const char *data, int size) const;
+    void appendField(QByteArray &out, const QByteArray &utf8) const { appendField(out, utf8.constData(), utf8.size()); }
+    // Единственное поле записи: пустое пишется как "", иначе запись прочиталась бы как пустая строка
+    void appendSoleField(QByteArray &out, const char *data, int size) const;
+    void appendSoleField(QByteArray &out, const QByteArray &utf8) const { appendSoleField(out, utf8.constData(), utf8.size()); }
+    QByteArray formatRecord(const QStringList &cells) const;
+
+private:
+    const char *findStructural(const char *pos, const char *end) const;
+    const char *findByte(const char *pos, const char *end, char byte) const;
+    const char *skipRecord(const char *pos, const char *end) const; // Начало следующей записи
+    bool needsQuoting(const char *data, int size) const;
+
+    char delimiterChar;
+    char quoteChar;
+    bool structural[256]; // Разделитель, \r и \n для побайтового хвоста
+};
+
+#endif // CSVTOKENIZER_H
@@ -0,0 +1,1021 @@
+#include "formulasheet.h"
+
+#include <QSet>
+#include <QVarLengthArray>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+    const int ParallelLevel = 1024; // Уровень пересчёта меньше этого считается в текущем потоке
+    const int MaxColumnLetters = 4;
+    const int MaxRowDigits = 9;
+
+    // Байт-код: код операции, за ним её операнды
+    enum Op : qint32
+    {
+        PushConstant, // Индекс константы
+        PushCell,     // Строка, столбец
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power,
+        Negate,
+        BeginAggregate, // Функция; открывает накопитель для аргументов
+        AggregateRange, // Индекс диапазона
+        AggregateValue, // Значение с вершины стека
+        EndAggregate    // Закрывает накопитель и кладёт результат функции на стек
+    };
+
+    enum Function
+    {
+        Sum,
+        Min,
+        Max,
+        Average,
+        Count
+    };
+
+    struct Token
+    {
+        enum Kind
+        {
+            End,
+            Number,
+            Reference,
+            Name,
+            Operator,
+            Colon,
+            Separator,
+            Open,
+            Close,
+            RefError,
+            Invalid
+        };
+
+        Kind kind = End;
+        int start = 0;
+        int length = 0;
+        double number = 0;
+        QChar symbol;
+        QString name;
+        int row = 0;
+        int column = 0;
+        bool absoluteRow = false;
+        bool absoluteColumn = false;
+    };
+
+    bool isLatinLetter(QChar c)
+    {
+        return (c >= QLatin1Char('A') && c <= QLatin1Char('Z')) || (c >= QLatin1Char('a') && c <= QLatin1Char('z'));
+    }
+
+    QString columnName(int column)
+    {
+        QString name;
+        for (int value = column + 1; value > 0; value = (value - 1) / 26)
+        {
+            name.prepend(QChar('A' + (value - 1) % 26));
+        }
+        return name;
+    }
+
+    QString referenceText(int row, int column, bool absoluteRow, bool absoluteColumn)
+    {
+        return (absoluteColumn ? QStringLiteral("$") : QString()) + columnName(column) +
+               (absoluteRow ? QStringLiteral("$") : QString()) + QString::number(row + 1);
+    }
+
+    // Разбор ссылки вида $A$1 с позиции start; false — это не ссылка
+    bool readReference(const QString &source, int start, Token &token)
+    {
+        int i = start;
+        token.absoluteColumn = i < source.size() && source.at(i) == QLatin1Char('$');
+        if (token.absoluteColumn)
+            ++i;
+
+        const int lettersStart = i;
+        qint64 column = 0;
+        while (i < source.size() && isLatinLetter(source.at(i)))
+        {
+            column = column * 26 + (source.at(i).toUpper().unicode() - 'A' + 1);
+            ++i;
+        }
+        if (i == lettersStart || i - lettersStart > MaxColumnLetters)
+            return false;
+
+        token.absoluteRow = i < source.size() && source.at(i) == QLatin1Char('$');
+        if (token.absoluteRow)
+            ++i;
+
+        const int digitsStart = i;
+        qint64 row = 0;
+        while (i < source.size() && source.at(i).isDigit())
+        {
+            row = row * 10 + source.at(i).digitValue();
+            ++i;
+        }
+        if (i == digitsStart || i - digitsStart > MaxRowDigits || row == 0)
+            return false;
+        if (i < source.size() && (source.at(i).isLetterOrNumber() || source.at(i) == QLatin1Char('_')))
+            return false;
+
+        token.kind = Token::Reference;
+        token.start = start;
+        token.length = i - start;
+        token.row = static_cast<int>(row - 1);
+        token.column = static_cast<int>(column - 1);
+        return true;
+    }
+
+    // Лексемы формулы без ведущего '='; смещения — в исходной строке
+    QVector<Token> tokenize(const QString &source)
+    {
+        QVector<Token> tokens;
+        int i = source.startsWith(QLatin1Char('=')) ? 1 : 0;
+        while (i < source.size())
+        {
+            const QChar c = source.at(i);
+            if (c.isSpace())
+            {
+                ++i;
+                continue;
+            }
+
+            Token token;
+            token.start = i;
+            if (c.isDigit() || (c == QLatin1Char('.') && i + 1 < source.size() && source.at(i + 1).isDigit()))
+            {
+                int end = i;
+                while (end < source.size() && (source.at(end).isDigit() || source.at(end) == QLatin1Char('.')))
+                {
+                    ++end;
+                }
+                if (end < source.size() && (source.at(end) == QLatin1Char('e') || source.at(end) == QLatin1Char('E')))
+                {
+                    int exponent = end + 1;
+                    if (exponent < source.size() && (source.at(exponent) == QLatin1Char('+') || source.at(exponent) == QLatin1Char('-')))
+                        ++exponent;
+                    if (exponent < source.size() && source.at(exponent).isDigit())
+                    {
+                        end = exponent;
+                        while (end < source.size() && source.at(end).isDigit())
+                        {
+                            ++end;
+                        }
+                    }
+                }
+                bool ok = false;
+                token.number = source.mid(i, end - i).toDouble(&ok);
+                token.kind = ok ? Token::Number : Token::Invalid;
+                token.length = end - i;
+            }
+            else if (isLatinLetter(c) || c == QLatin1Char('$'))
+            {
+                if (!readReference(source, i, token))
+                {
+                    int end = i;
+                    while (end < source.size() && isLatinLetter(source.at(end)))
+                    {
+                        ++end;
+                    }
+                    token.kind = end > i ? Token::Name : Token::Invalid;
+                    token.length = qMax(end - i, 1);
+                    token.name = source.mid(i, end - i).toUpper();
+                }
+            }
+            else if (source.midRef(i).startsWith(QLatin1String("#REF!"), Qt::CaseInsensitive))
+            {
+                token.kind = Token::RefError;
+                token.length = 5;
+            }
+            else
+            {
+                token.length = 1;
+                token.symbol = c;
+                switch (c.unicode())
+                {
+                case '+':
+                case '-':
+                case '*':
+                case '/':
+                case '^':
+                    token.kind = Token::Operator;
+                    break;
+                case ':':
+                    token.kind = Token::Colon;
+                    break;
+                case ',':
+                case ';':
+                    token.kind = Token::Separator;
+                    break;
+                case '(':
+                    token.kind = Token::Open;
+                    break;
+                case ')':
+                    token.kind = Token::Close;
+                    break;
+                default:
+                    token.kind = Token::Invalid;
+                    break;
+                }
+            }
+
+            i = token.start + token.length;
+            tokens.append(token);
+        }
+
+        Token end;
+        end.start = source.size();
+        tokens.append(end);
+        return tokens;
+    }
+
+    // Рекурсивный спуск: выражение -> слагаемые -> множители -> степень -> унарный минус -> операнд
+    class Compiler
+    {
+    public:
+        Compiler(const QVector<Token> &tokens, Formula &formula) : tokens(tokens),
+                                                                   formula(formula)
+        {
+        }
+
+        bool compile()
+        {
+            return parseExpression() && peek().kind == Token::End;
+        }
+
+        Formula::Error error = Formula::SyntaxError;
+
+    private:
+        const Token &peek(int ahead = 0) const
+        {
+            return tokens.at(qMin(position + ahead, tokens.size() - 1));
+        }
+
+        bool isOperator(QChar symbol) const
+        {
+            return peek().kind == Token::Operator && peek().symbol == symbol;
+        }
+
+        void write(qint32 op) { formula.code.append(op); }
+
+        bool parseExpression()
+        {
+            if (!parseTerm())
+                return false;
+            while (isOperator(QLatin1Char('+')) || isOperator(QLatin1Char('-')))
+            {
+                const bool add = peek().symbol == QLatin1Char('+');
+                ++position;
+                if (!parseTerm())
+                    return false;
+                write(add ? Add : Subtract);
+            }
+            return true;
+        }
+
+        bool parseTerm()
+        {
+            if (!parsePower())
+                return false;
+            while (isOperator(QLatin1Char('*')) || isOperator(QLatin1Char('/')))
+            {
+                const bool multiply = peek().symbol == QLatin1Char('*');
+                ++position;
+                if (!parsePower())
+                    return false;
+                write(multiply ? Multiply : Divide);
+            }
+            return true;
+        }
+
+        bool parsePower()
+        {
+            if (!parseUnary())
+                return false;
+            if (isOperator(QLatin1Char('^')))
+            {
+                ++position;
+                if (!parsePower()) // Степень правоассоциативна
+                    return false;
+                write(Power);
+            }
+            return true;
+        }
+
+        bool parseUnary()
+        {
+            if (isOperator(QLatin1Char('-')) || isOperator(QLatin1Char('+')))
+            {
+                const bool negate = peek().symbol == QLatin1Char('-');
+                ++position;
+                if (!parseUnary())
+                    return false;
+                if (negate)
+                    write(Negate);
+                return true;
+            }
+            return parsePrimary();
+        }
+
+        bool parsePrimary()
+        {
+            const Token &token = peek();
+            switch (token.kind)
+            {
+            case Token::Number:
+                ++position;
+                write(PushConstant);
+                write(formula.constants.size());
+                formula.constants.append(token.number);
+                return true;
+            case Token::Reference:
+                ++position;
+                write(PushCell);
+                write(token.row);
+                write(token.column);
+                formula.cells.append(FormulaSheet::key(token.row, token.column));
+                return true;
+            case Token::Name:
+                return parseCall();
+            case Token::Open:
+                ++position;
+                if (!parseExpression() || peek().kind != Token::Close)
+                    return false;
+                ++position;
+                return true;
+            case Token::RefError:
+                error = Formula::RefError;
+                return false;
+            default:
+                return false;
+            }
+        }
+
+        bool parseCall()
+        {
+            static const QHash<QString, int> functions = {{QStringLiteral("SUM"), Sum},
+                                                          {QStringLiteral("MIN"), Min},
+                                                          {QStringLiteral("MAX"), Max},
+                                                          {QStringLiteral("AVERAGE"), Average},
+                                                          {QStringLiteral("AVG"), Average},
+                                                          {QStringLiteral("COUNT"), Count}};
+            const auto function = functions.constFind(peek().name);
+            if (function == functions.constEnd() || peek(1).kind != Token::Open)
+                return false;
+            position += 2;
+
+            write(BeginAggregate);
+            write(function.value());
+            if (peek().kind != Token::Close)
+            {
+                while (true)
+                {
+                    if (!parseArgument())
+                        return false;
+                    if (peek().kind != Token::Separator)
+                        break;
+                    ++position;
+                }
+            }
+            if (peek().kind != Token::Close)
+                return false;
+            ++position;
+            write(EndAggregate);
+            return true;
+        }
+
+        // Аргумент функции: диапазон A1:B2 или любое выражение
+        bool parseArgument()
+        {
+            if (peek().kind == Token::Reference && peek(1).kind == Token::Colon && peek(2).kind == Token::Reference)
+            {
+                const Token &first = peek();
+                const Token &last = peek(2);
+                Formula::Range range;
+                range.top = qMin(first.row, last.row);
+                range.bottom = qMax(first.row, last.row);
+                range.left = qMin(first.column, last.column);
+                range.right = qMax(first.column, last.column);
+                position += 3;
+
+                write(AggregateRange);
+                write(formula.ranges.size());
+                formula.ranges.append(range);
+                return true;
+            }
+
+            if (!parseExpression())
+                return false;
+            write(AggregateValue);
+            return true;
+        }
+
+        const QVector<Token> &tokens;
+        Formula &formula;
+        int position = 0;
+    };
+
+    struct Value
+    {
+        double number = 0;
+        Formula::Error error = Formula::NoError;
+    };
+
+    struct Aggregate
+    {
+        int function = Sum;
+        double sum = 0;
+        double minimum = 0;
+        double maximum = 0;
+        qint64 count = 0;
+        Formula::Error error = Formula::NoError;
+
+        void add(double value)
+        {
+            minimum = count == 0 ? value : qMin(minimum, value);
+            maximum = count == 0 ? value : qMax(maximum, value);
+            sum += value;
+            ++count;
+        }
+
+        Value result() const
+        {
+            Value value;
+            value.error = error;
+            switch (function)
+            {
+            case Sum:
+                value.number = sum;
+                break;
+            case Min:
+                value.number = minimum;
+                break;
+            case Max:
+                value.number = maximum;
+                break;
+            case Average:
+                if (count == 0 && error == Formula::NoError)
+                    value.error = Formula::DivideByZero;
+                value.number = count > 0 ? sum / count : 0;
+                break;
+            case Count:
+                value.number = count;
+                break;
+            }
+            return value;
+        }
+    };
+
+    enum CellKind
+    {
+        EmptyCell,
+        NumberCell,
+        TextCell,
+        ErrorCell
+    };
+
+    // Текст ошибки в ячейке, на которую ссылаются: ошибка передаётся дальше по цепочке
+    Formula::Error errorFromText(const QByteArray &bytes)
+    {
+        if (!bytes.startsWith('#'))
+            return Formula::NoError;
+        for (int error = Formula::SyntaxError; error <= Formula::CycleError; ++error)
+        {
+            if (bytes == Formula::errorText(static_cast<Formula::Error>(error)).toLatin1())
+                return static_cast<Formula::Error>(error);
+        }
+        return Formula::NoError;
+    }
+
+    CellKind readCell(const TableData &table, int row, int column, double &number, Formula::Error &error)
+    {
+        QByteArray bytes;
+        if (!table.isSparse())
+        {
+            const TableColumn &cells = table.column(column);
+            if (cells.isEmpty(row))
+                return EmptyCell;
+            if (cells.type() == TableColumn::Integer || cells.type() == TableColumn::Real)
+            {
+                bool ok = false;
+                number = cells.number(row, &ok);
+                return NumberCell;
+            }
+            if (cells.type() == TableColumn::Date)
+                return TextCell;
+            bytes = QByteArray::fromRawData(cells.rawData(row), cells.rawSize(row));
+        }
+        else
+        {
+            bytes = table.sparseGrid().bytes(row, column);
+            if (bytes.isEmpty())
+                return EmptyCell;
+        }
+
+        bool ok = false;
+        number = bytes.trimmed().toDouble(&ok);
+        if (ok && std::isfinite(number))
+            return NumberCell;
+        error = errorFromText(bytes);
+        return error != Formula::NoError ? ErrorCell : TextCell;
+    }
+
+    Value evaluate(const Formula &formula, const TableData &table)
+    {
+        Value result;
+        if (formula.error != Formula::NoError)
+        {
+            result.error = formula.error;
+            return result;
+        }
+
+        QVarLengthArray<Value, 16> stack;
+        QVarLengthArray<Aggregate, 4> aggregates;
+        const qint32 *code = formula.code.constData();
+        const int size = formula.code.size();
+        for (int pc = 0; pc < size;)
+        {
+            switch (code[pc++])
+            {
+            case PushConstant:
+            {
+                Value value;
+                value.number = formula.constants.at(code[pc++]);
+                stack.append(value);
+                break;
+            }
+            case PushCell:
+            {
+                const int row = code[pc++];
+                const int column = code[pc++];
+                Value value;
+                if (row >= table.rowCount() || column >= table.columnCount())
+                {
+                    value.error = Formula::RefError;
+                }
+                else if (readCell(table, row, column, value.number, value.error) == TextCell)
+                {
+                    value.error = Formula::ValueError;
+                }
+                stack.append(value);
+                break;
+            }
+            case Negate:
+                stack.last().number = -stack.last().number;
+                break;
+            case BeginAggregate:
+            {
+                Aggregate aggregate;
+                aggregate.function = code[pc++];
+                aggregates.append(aggregate);
+                break;
+            }
+            case AggregateRange:
+            {
+                // Диапазон обрезается по таблице: SUM(A1:A1000) над короткой таблицей не ошибка
+                const Formula::Range &range = formula.ranges.at(code[pc++]);
+                Aggregate &aggregate = aggregates.last();
+                const int bottom = qMin(range.bottom, table.rowCount() - 1);
+                const int right = qMin(range.right, table.columnCount() - 1);
+                for (int j = range.left; j <= right && aggregate.error == Formula::NoError; ++j)
+                {
+                    for (int i = range.top; i <= bottom; ++i)
+                    {
+                        double number = 0;
+                        Formula::Error error = Formula::NoError;
+                        const CellKind kind = readCell(table, i, j, number, error);
+                        if (kind == NumberCell)
+                        {
+                            aggregate.add(number);
+                        }
+                        else if (kind == ErrorCell)
+                        {
+                            aggregate.error = error;
+                            break;
+                        }
+                    }
+                }
+                break;
+            }
+            case AggregateValue:
+            {
+                const Value value = stack.last();
+                stack.removeLast();
+                Aggregate &aggregate = aggregates.last();
+                if (value.error != Formula::NoError)
+                {
+                    if (aggregate.error == Formula::NoError)
+                        aggregate.error = value.error;
+                }
+                else
+                {
+                    aggregate.add(value.number);
+                }
+                break;
+            }
+            case EndAggregate:
+                stack.append(aggregates.last().result());
+                aggregates.removeLast();
+                break;
+            default:
+            {
+                // Двухместные операции: ошибка любого операнда становится результатом
+                const Value right = stack.last();
+                stack.removeLast();
+                Value &left = stack.last();
+                if (left.error != Formula::NoError)
+                    break;
+                if (right.error != Formula::NoError)
+                {
+                    left.error = right.error;
+                    break;
+                }
+
+                switch (code[pc - 1])
+                {
+                case Add:
+                    left.number += right.number;
+                    break;
+                case Subtract:
+                    left.number -= right.number;
+                    break;
+                case Multiply:
+                    left.number *= right.number;
+                    break;
+                case Divide:
+                    if (right.number == 0)
+                        left.error = Formula::DivideByZero;
+                    else
+                        left.number /= right.number;
+                    break;
+                case Power:
+                    left.number = std::pow(left.number, right.number);
+                    break;
+                }
+                break;
+            }
+            }
+        }
+
+        result = stack.last();
+        if (result.error == Formula::NoError && !std::isfinite(result.number))
+            result.error = Formula::ValueError;
+        return result;
+    }
+
+    QString valueText(const Value &value)
+    {
+        if (value.error != Formula::NoError)
+            return Formula::errorText(value.error);
+        return value.number == 0 ? QStringLiteral("0") : QString::number(value.number, 'g', 15);
+    }
+
+    // Координата после вставки (count > 0) или удаления (count < 0); -1 — ячейка удалена
+    int shiftIndex(int index, int position, int count)
+    {
+        if (index < position)
+            return index;
+        if (count > 0)
+            return index + count;
+        return index >= position - count ? index + count : -1;
+    }
+}
+
+Formula Formula::compile(const QString &source)
+{
+    Formula formula;
+    formula.source = source;
+
+    const QVector<Token> tokens = tokenize(source);
+    Compiler compiler(tokens, formula);
+    if (!compiler.compile())
+    {
+        formula.code.clear();
+        formula.constants.clear();
+        formula.ranges.clear();
+        formula.cells.clear();
+        formula.error = compiler.error;
+        return formula;
+    }
+
+    std::sort(formula.cells.begin(), formula.cells.end());
+    formula.cells.erase(std::unique(formula.cells.begin(), formula.cells.end()), formula.cells.end());
+    return formula;
+}
+
+QString Formula::errorText(Error error)
+{
+    switch (error)
+    {
+    case SyntaxError:
+        return QStringLiteral("#ERROR!");
+    case DivideByZero:
+        return QStringLiteral("#DIV/0!");
+    case ValueError:
+        return QStringLiteral("#VALUE!");
+    case RefError:
+        return QStringLiteral("#REF!");
+    case CycleError:
+        return QStringLiteral("#CYCLE!");
+    default:
+        return QString();
+    }
+}
+
+QString Formula::shiftReferences(const QString &source, bool rows, int position, int count)
+{
+    const QVector<Token> tokens = tokenize(source);
+    QString result;
+    int copied = 0;
+    for (int i = 0; i < tokens.size(); ++i)
+    {
+        const Token &first = tokens.at(i);
+        if (first.kind != Token::Reference)
+            continue;
+
+        QString replacement;
+        int end = first.start + first.length;
+        if (i + 2 < tokens.size() && tokens.at(i + 1).kind == Token::Colon && tokens.at(i + 2).kind == Token::Reference)
+        {
+            // Диапазон сжимается при удалении части строк и растягивается при вставке внутрь
+            const Token &last = tokens.at(i + 2);
+            int top = rows ? first.row : first.column;
+            int bottom = rows ? last.row : last.column;
+            const bool reversed = top > bottom;
+            if (reversed)
+                std::swap(top, bottom);
+
+            int newTop = shiftIndex(top, position, count);
+            int newBottom = shiftIndex(bottom, position, count);
+            if (newTop < 0)
+                newTop = position;
+            if (newBottom < 0)
+                newBottom = position - 1;
+
+            if (newTop > newBottom)
+            {
+                replacement = QStringLiteral("#REF!");
+            }
+            else
+            {
+                if (reversed)
+                    std::swap(newTop, newBottom);
+                replacement = referenceText(rows ? newTop : first.row, rows ? first.column : newTop, first.absoluteRow, first.absoluteColumn) +
+                              QLatin1Char(':') +
+                              referenceText(rows ? newBottom : last.row, rows ? last.column : newBottom, last.absoluteRow, last.absoluteColumn);
+            }
+            end = last.start + last.length;
+            i += 2;
+        }
+        else
+        {
+            const int index = shiftIndex(rows ? first.row : first.column, position, count);
+            if (index < 0)
+                replacement = QStringLiteral("#REF!");
+            else
+                replacement = referenceText(rows ? index : first.row, rows ? first.column : index, first.absoluteRow, first.absoluteColumn);
+        }
+
+        result += source.midRef(copied, first.start - copied);
+        result += replacement;
+        copied = end;
+    }
+    result += source.midRef(copied);
+    return result;
+}
+
+QString FormulaSheet::source(int row, int column) const
+{
+    const auto formula = formulas.constFind(key(row, column));
+    return formula != formulas.constEnd() ? formula->source : QString();
+}
+
+void FormulaSheet::setFormula(int row, int column, const QString &source)
+{
+    removeFormula(row, column);
+    const quint64 cell = key(row, column);
+    Formula formula = Formula::compile(source);
+    link(cell, formula);
+    formulas.insert(cell, formula);
+}
+
+void FormulaSheet::removeFormula(int row, int column)
+{
+    const quint64 cell = key(row, column);
+    const auto formula = formulas.constFind(cell);
+    if (formula == formulas.constEnd())
+        return;
+    unlink(cell, *formula);
+    formulas.erase(formula);
+}
+
+void FormulaSheet::link(quint64 cell, const Formula &formula)
+{
+    for (quint64 precedent : formula.cells)
+    {
+        cellDependents[precedent].append(cell);
+    }
+    for (const Formula::Range &range : formula.ranges)
+    {
+        for (int j = range.left; j <= range.right; ++j)
+        {
+            QVector<quint64> &bucket = rangeDependents[j];
+            if (bucket.isEmpty() || bucket.last() != cell)
+                bucket.append(cell);
+        }
+    }
+}
+
+void FormulaSheet::unlink(quint64 cell, const Formula &formula)
+{
+    for (quint64 precedent : formula.cells)
+    {
+        auto bucket = cellDependents.find(precedent);
+        if (bucket == cellDependents.end())
+            continue;
+        bucket->removeAll(cell);
+        if (bucket->isEmpty())
+            cellDependents.erase(bucket);
+    }
+    for (const Formula::Range &range : formula.ranges)
+    {
+        for (int j = range.left; j <= range.right; ++j)
+        {
+            auto bucket = rangeDependents.find(j);
+            if (bucket == rangeDependents.end())
+                continue;
+            bucket->removeAll(cell);
+            if (bucket->isEmpty())
+                rangeDependents.erase(bucket);
+        }
+    }
+}
+
+QVector<quint64> FormulaSheet::dependents(quint64 cell) const
+{
+    QVector<quint64> result = cellDependents.value(cell);
+
+    const int row = keyRow(cell);
+    const int column = keyColumn(cell);
+    const auto bucket = rangeDependents.constFind(column);
+    if (bucket != rangeDependents.constEnd())
+    {
+        for (quint64 dependent : *bucket)
+        {
+            for (const Formula::Range &range : formulas.value(dependent).ranges)
+            {
+                if (range.contains(row, column))
+                {
+                    result.append(dependent);
+                    break;
+                }
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+QVector<quint64> FormulaSheet::recalculate(TableData &table, const QVector<quint64> &changed) const
+{
+    // Подграф затронутых ячеек обходом в ширину; входящая степень — число затронутых
+    // ячеек, от которых формула зависит
+    QHash<quint64, QVector<quint64>> edges;
+    QHash<quint64, int> pending;
+    QVector<quint64> affected;
+    QSet<quint64> visited;
+    for (quint64 cell : changed)
+    {
+        if (!visited.contains(cell))
+        {
+            visited.insert(cell);
+            affected.append(cell);
+        }
+    }
+    for (int i = 0; i < affected.size(); ++i)
+    {
+        const QVector<quint64> next = dependents(affected.at(i));
+        if (next.isEmpty())
+            continue;
+        edges.insert(affected.at(i), next);
+        for (quint64 dependent : next)
+        {
+            ++pending[dependent];
+            if (!visited.contains(dependent))
+            {
+                visited.insert(dependent);
+                affected.append(dependent);
+            }
+        }
+    }
+
+    QVector<quint64> level;
+    for (quint64 cell : affected)
+    {
+        if (pending.value(cell) == 0)
+            level.append(cell);
+    }
+
+    const TableData &snapshot = table;
+    QVector<quint64> updated;
+    while (!level.isEmpty())
+    {
+        QVector<quint64> targets;
+        for (quint64 cell : level)
+        {
+            if (formulas.contains(cell))
+                targets.append(cell);
+        }
+
+        // Формулы уровня читают только значения прошлых уровней, поэтому таблица не меняется,
+        // пока они считаются, а результаты записываются после
+        QVector<QString> values(targets.size());
+        auto evaluateAt = [this, &targets, &values, &snapshot](int index)
+        {
+            values[index] = valueText(evaluate(*formulas.constFind(targets.at(index)), snapshot));
+        };
+        if (targets.size() >= ParallelLevel)
+        {
+            QVector<int> indices(targets.size());
+            std::iota(indices.begin(), indices.end(), 0);
+            QtConcurrent::blockingMap(indices, [&evaluateAt](int &index)
+                                      { evaluateAt(index); });
+        }
+        else
+        {
+            for (int i = 0; i < targets.size(); ++i)
+            {
+                evaluateAt(i);
+            }
+        }
+
+        for (int i = 0; i < targets.size(); ++i)
+        {
+            const int row = keyRow(targets.at(i));
+            const int column = keyColumn(targets.at(i));
+            if (row < table.rowCount() && column < table.columnCount() && table.text(row, column) != values.at(i))
+            {
+                table.setText(row, column, values.at(i));
+                updated.append(targets.at(i));
+            }
+        }
+
+        QVector<quint64> next;
+        for (quint64 cell : level)
+        {
+            for (quint64 dependent : edges.value(cell))
+            {
+                if (--pending[dependent] == 0)
+                    next.append(dependent);
+            }
+        }
+        level = next;
+    }
+
+    // Не дошедшие до нуля — в цикле или ниже него по цепочке
+    const QString cycle = Formula::errorText(Formula::CycleError);
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it)
+    {
+        const int row = keyRow(it.key());
+        const int column = keyColumn(it.key());
+        if (it.value() > 0 && formulas.contains(it.key()) && row < table.rowCount() && column < table.columnCount() &&
+            table.text(row, column) != cycle)
+        {
+            table.setText(row, column, cycle);
+            updated.append(it.key());
+        }
+    }
+    return updated;
+}
+
+QVector<quint64> FormulaSheet::recalculateAll(TableData &table) const
+{
+    return recalculate(table, formulas.keys().toVector());
+}
+
+void FormulaSheet::shift(bool rows, int position, int count)
+{
+    // Формулы переезжают вместе с ячейками, ссылки в них переписываются, граф строится заново
+    const QHash<quint64, Formula> previous = formulas;
+    formulas.clear();
+    cellDependents.clear();
+    rangeDependents.clear();
+
+    for (auto it = previous.constBegin(); it != previous.constEnd(); ++it)
+    {
+        int row = keyRow(it.key());
+        int column = keyColumn(it.key());
+        int &moved = rows ? row : column;
+        moved = shiftIndex(moved, position, count);
+        if (moved < 0)
+            continue;
+        setFormula(row, column, Formula::shiftReferences(it->source, rows, position, count));
+    }
+}
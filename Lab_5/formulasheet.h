@@ -0,0 +1,91 @@
+#ifndef FORMULASHEET_H
+#define FORMULASHEET_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+#include "tabledata.h"
+
+// Формула ячейки, разобранная один раз в байт-код стековой машины.
+// Ссылки A1 и диапазоны A1:B10 (в том числе с $) — номера строк и столбцов с нуля
+struct Formula
+{
+    struct Range
+    {
+        int top = 0;
+        int left = 0;
+        int bottom = 0;
+        int right = 0;
+
+        bool contains(int row, int column) const { return row >= top && row <= bottom && column >= left && column <= right; }
+    };
+
+    enum Error
+    {
+        NoError,
+        SyntaxError,  // #ERROR!
+        DivideByZero, // #DIV/0!
+        ValueError,   // #VALUE!
+        RefError,     // #REF!
+        CycleError    // #CYCLE!
+    };
+
+    QString source;
+    QVector<qint32> code; // Операции с операндами сразу за ними
+    QVector<double> constants;
+    QVector<Range> ranges;  // Диапазоны аргументов функций
+    QVector<quint64> cells; // Отдельные ссылки без повторов, ключи FormulaSheet::key
+    Error error = NoError;  // Ошибка разбора: формула сразу вычисляется в неё
+
+    static Formula compile(const QString &source);
+    static QString errorText(Error error);
+
+    // Текст формулы после вставки (count > 0) или удаления (count < 0) строк или столбцов
+    // начиная с position; ссылки на удалённые ячейки становятся #REF!
+    static QString shiftReferences(const QString &source, bool rows, int position, int count);
+};
+
+// Формулы таблицы и граф зависимостей между ячейками. В TableData лежат вычисленные значения,
+// поэтому отображение, сортировка и запись CSV работают с ними как с обычным текстом.
+// Правка ячейки пересчитывает только зависящие от неё формулы — по уровням топологического
+// порядка, формулы одного уровня друг от друга не зависят и на больших уровнях считаются параллельно
+class FormulaSheet
+{
+public:
+    static quint64 key(int row, int column) { return (quint64(quint32(row)) << 32) | quint32(column); }
+    static int keyRow(quint64 key) { return int(key >> 32); }
+    static int keyColumn(quint64 key) { return int(key & 0xFFFFFFFFu); }
+
+    bool isEmpty() const { return formulas.isEmpty(); }
+    int count() const { return formulas.size(); }
+    bool contains(int row, int column) const { return formulas.contains(key(row, column)); }
+    QString source(int row, int column) const;
+    QList<quint64> keys() const { return formulas.keys(); }
+
+    void setFormula(int row, int column, const QString &source);
+    void removeFormula(int row, int column);
+
+    // Пересчитывает формулы, зависящие от изменённых ячеек (и сами изменённые, если это формулы),
+    // записывает значения в table и возвращает ключи ячеек, значение которых изменилось
+    QVector<quint64> recalculate(TableData &table, const QVector<quint64> &changed) const;
+    QVector<quint64> recalculateAll(TableData &table) const;
+
+    // Сдвиг формул и ссылок в них вслед за вставкой и удалением строк и столбцов
+    void insertRows(int row, int count) { shift(true, row, count); }
+    void removeRows(int row, int count) { shift(true, row, -count); }
+    void insertColumns(int column, int count) { shift(false, column, count); }
+    void removeColumns(int column, int count) { shift(false, column, -count); }
+
+private:
+    void link(quint64 cell, const Formula &formula);
+    void unlink(quint64 cell, const Formula &formula);
+    QVector<quint64> dependents(quint64 cell) const;
+    void shift(bool rows, int position, int count);
+
+    QHash<quint64, Formula> formulas;
+    QHash<quint64, QVector<quint64>> cellDependents; // Ячейка -> формулы, ссылающиеся на неё
+    QHash<int, QVector<quint64>> rangeDependents;    // Столбец -> формулы с диапазоном, задевающим его
+};
+
+#endif // FORMULASHEET_H
@@ -0,0 +1,57 @@
+#include "formulasidecar.h"
+
+#include <QDataStream>
+#include <algorithm>
+
+namespace
+{
+    const quint32 Magic = 0x54544d46; // "FMTT"
+    const quint16 Version = 1;
+}
+
+bool FormulaSidecar::write(QIODevice *device, const FormulaSheet &formulas, const TableData &table)
+{
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    // Порядок по ячейкам, чтобы одинаковые таблицы давали одинаковые файлы
+    QList<quint64> keys = formulas.keys();
+    std::sort(keys.begin(), keys.end());
+
+    out << Magic << Version << static_cast<quint32>(keys.size());
+    for (quint64 key : keys)
+    {
+        const int row = FormulaSheet::keyRow(key);
+        const int column = FormulaSheet::keyColumn(key);
+        out << static_cast<qint32>(row) << static_cast<qint32>(column) << formulas.source(row, column) << table.text(row, column);
+    }
+    return out.status() == QDataStream::Ok;
+}
+
+bool FormulaSidecar::read(QIODevice *device)
+{
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> count;
+    if (in.status() != QDataStream::Ok || magic != Magic || version == 0 || version > Version)
+        return false;
+
+    entries.clear();
+    for (quint32 i = 0; i < count; ++i)
+    {
+        Entry entry;
+        qint32 row = 0;
+        qint32 column = 0;
+        in >> row >> column >> entry.source >> entry.value;
+        if (in.status() != QDataStream::Ok || row < 0 || column < 0)
+            return false;
+        entry.row = row;
+        entry.column = column;
+        entries.append(entry);
+    }
+    return true;
+}
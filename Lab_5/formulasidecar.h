@@ -0,0 +1,30 @@
+#ifndef FORMULASIDECAR_H
+#define FORMULASIDECAR_H
+
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+
+#include "formulasheet.h"
+
+// Файл формул таблицы (tabSettings/<имя>.formulas), двоичный и версионный: сигнатура, версия,
+// число формул и для каждой строка, столбец, текст и значение на момент сохранения.
+// Значения нужны при открытии: если они совпадают с ячейками CSV, пересчитывать ничего не надо
+class FormulaSidecar
+{
+public:
+    struct Entry
+    {
+        int row = 0;
+        int column = 0;
+        QString source;
+        QString value;
+    };
+
+    QVector<Entry> entries;
+
+    static bool write(QIODevice *device, const FormulaSheet &formulas, const TableData &table);
+    bool read(QIODevice *device);
+};
+
+#endif // FORMULASIDECAR_H
@@ -0,0 +1,513 @@
+#include "largefileview.h"
+
+#include <QPainter>
+#include <QScrollBar>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <climits>
+
+namespace
+{
+    const int MaxLineBytes = 64 * 1024; // Длиннее строку не рисуем: она всё равно за краем окна
+    const int TextMargin = 4;
+    const int LineFlags = Qt::TextSingleLine | Qt::TextExpandTabs;
+}
+
+LargeFileView::LargeFileView(QWidget *parent) : QAbstractScrollArea(parent),
+                                                cancelled(0)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setBackgroundRole(QPalette::Base);
+    viewport()->setCursor(Qt::IBeamCursor);
+    connect(&indexing, &QFutureWatcher<LineIndex>::finished, this, &LargeFileView::indexFinished);
+}
+
+LargeFileView::~LargeFileView()
+{
+    // Отображение снимается вместе с QFile, поэтому сначала дожидаемся построения индекса
+    cancelled.storeRelease(1);
+    indexing.waitForFinished();
+}
+
+bool LargeFileView::open(const QString &path)
+{
+    const char *data = nullptr;
+    qint64 size = 0;
+    if (!mapFile(path, data, size))
+        return false;
+    this->path = path;
+    text = PieceTable(data, size);
+
+    // Новые строки при правке заканчиваются так же, как первая строка файла
+    const qint64 newline = text.findNewline(0);
+    if (newline > 0 && newline < size && text.at(newline - 1) == '\r')
+        lineBreak = "\r\n";
+
+    // Пока индекс строится, видна первая страница: её строки ищутся от начала файла
+    updateScrollBars();
+    startIndexing(data, size);
+    return true;
+}
+
+bool LargeFileView::mapFile(const QString &path, const char *&data, qint64 &size)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    size = file.size();
+    data = nullptr;
+    if (size > 0)
+    {
+        mapped = file.map(0, size);
+        if (!mapped)
+        {
+            file.close();
+            return false;
+        }
+        data = reinterpret_cast<const char *>(mapped);
+    }
+    return true;
+}
+
+void LargeFileView::unmapFile()
+{
+    // Построение индекса читает отображение: сначала останавливаем его
+    cancelled.storeRelease(1);
+    indexing.waitForFinished();
+    if (mapped)
+        file.unmap(mapped);
+    mapped = nullptr;
+    file.close();
+}
+
+void LargeFileView::startIndexing(const char *data, qint64 size)
+{
+    // Новая задача заменяет прежнюю в indexing, и её сигнал finished уже не придёт
+    cancelled.storeRelease(0);
+    indexing.setFuture(QtConcurrent::run(&LineIndex::build, data, size, static_cast<const QAtomicInt *>(&cancelled)));
+}
+
+void LargeFileView::goToLine(qint64 line)
+{
+    verticalScrollBar()->setValue(static_cast<int>(qBound<qint64>(0, line, INT_MAX)));
+    cursor = text.lineStart(line);
+    lastEdit = NoEdit;
+    viewport()->update();
+}
+
+void LargeFileView::setReadOnly(bool readOnly)
+{
+    this->readOnly = readOnly || !text.isIndexed();
+    viewport()->update();
+}
+
+bool LargeFileView::save(const QString &path)
+{
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    if (!text.write(&out))
+    {
+        out.cancelWriting();
+        return false;
+    }
+
+    // Windows не заменяет открытый и отображённый файл: до переименования отображение
+    // снимается. Куски текста уже записаны, исходный файл им больше не нужен
+    const QString originalPath = file.fileName();
+    const bool wasIndexed = text.isIndexed();
+    unmapFile();
+
+    const char *data = nullptr;
+    qint64 size = 0;
+    if (!out.commit())
+    {
+        // Исходный файл не изменился: отображаем его снова, правки остаются в таблице кусков
+        if (!mapFile(originalPath, data, size))
+        {
+            text = PieceTable();
+            cursor = 0;
+            readOnly = true;
+            updateScrollBars();
+            viewport()->update();
+            return false;
+        }
+        text.setOriginal(data);
+        if (!wasIndexed)
+            startIndexing(data, size);
+        viewport()->update();
+        return false;
+    }
+
+    // Вкладка переходит на записанный файл: он целиком — один кусок, а индекс строк строится
+    // заново. Правка и прокрутка возвращаются, когда индекс готов
+    this->path = path;
+    resumeEditing = !readOnly;
+    resumeLine = verticalScrollBar()->value();
+    readOnly = true;
+    lastEdit = NoEdit;
+    if (!mapFile(path, data, size))
+    {
+        text = PieceTable();
+        cursor = 0;
+        updateScrollBars();
+        viewport()->update();
+        return true;
+    }
+    text = PieceTable(data, size);
+    cursor = qMin(cursor, size);
+    updateScrollBars();
+    viewport()->update();
+    startIndexing(data, size);
+    return true;
+}
+
+void LargeFileView::undo()
+{
+    const qint64 position = text.undo();
+    if (position < 0)
+        return;
+    cursor = qMin(position, text.size());
+    lastEdit = NoEdit;
+    edited();
+}
+
+void LargeFileView::redo()
+{
+    const qint64 position = text.redo();
+    if (position < 0)
+        return;
+    cursor = qMin(position, text.size());
+    lastEdit = NoEdit;
+    edited();
+}
+
+void LargeFileView::indexFinished()
+{
+    if (cancelled.loadAcquire())
+        return;
+    text.setOriginalIndex(indexing.result());
+    updateScrollBars();
+    if (resumeEditing)
+        readOnly = false;
+    if (resumeLine >= 0)
+        verticalScrollBar()->setValue(resumeLine);
+    resumeEditing = false;
+    resumeLine = -1;
+    viewport()->update();
+    emit indexReady(text.lineCount());
+}
+
+int LargeFileView::visibleLines() const
+{
+    return qMax(1, viewport()->height() / fontMetrics().height());
+}
+
+int LargeFileView::gutterWidth() const
+{
+    const int digits = QString::number(qMax<qint64>(text.lineCount(), 1)).size();
+    return fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits + 2 * TextMargin;
+}
+
+void LargeFileView::updateScrollBars()
+{
+    // Полоса прокрутки хранит int: строки дальше INT_MAX недоступны
+    const int lines = visibleLines();
+    verticalScrollBar()->setRange(0, static_cast<int>(qBound<qint64>(0, text.lineCount() - lines, INT_MAX)));
+    verticalScrollBar()->setPageStep(lines);
+    horizontalScrollBar()->setRange(0, qMax(0, gutterWidth() + widestLine + TextMargin - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void LargeFileView::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    // Строки рисуются заново из файла, сдвигать старое изображение незачем
+    viewport()->update();
+}
+
+qint64 LargeFileView::visibleEnd(qint64 start) const
+{
+    qint64 end = text.findNewline(start);
+    if (end > start && text.at(end - 1) == '\r')
+        --end;
+    return end;
+}
+
+QString LargeFileView::lineText(qint64 start) const
+{
+    const qint64 length = qMin<qint64>(visibleEnd(start) - start, MaxLineBytes);
+    return QString::fromUtf8(text.read(start, length));
+}
+
+int LargeFileView::columnX(qint64 start, qint64 pos) const
+{
+    const qint64 length = qMin<qint64>(pos - start, MaxLineBytes);
+    return fontMetrics().size(LineFlags, QString::fromUtf8(text.read(start, length))).width();
+}
+
+qint64 LargeFileView::positionInLine(qint64 start, int x) const
+{
+    // Ширина префикса растёт с его длиной: ищем последний символ, начало которого левее x
+    const QString line = lineText(start);
+    const QFontMetrics metrics = fontMetrics();
+    int low = 0;
+    int high = line.size();
+    while (low < high)
+    {
+        const int middle = (low + high + 1) / 2;
+        if (metrics.size(LineFlags, line.left(middle)).width() <= x)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    if (low < line.size())
+    {
+        const int before = metrics.size(LineFlags, line.left(low)).width();
+        const int after = metrics.size(LineFlags, line.left(low + 1)).width();
+        if (x - before > after - x)
+            ++low;
+    }
+    return start + line.left(low).toUtf8().size();
+}
+
+qint64 LargeFileView::previousChar(qint64 pos) const
+{
+    if (pos <= 0)
+        return 0;
+    --pos;
+    // Продолжения многобайтовых символов UTF-8 и \r перед \n курсор проходит целиком
+    while (pos > 0 && (static_cast<uchar>(text.at(pos)) & 0xC0) == 0x80)
+    {
+        --pos;
+    }
+    if (pos > 0 && text.at(pos) == '\n' && text.at(pos - 1) == '\r')
+        --pos;
+    return pos;
+}
+
+qint64 LargeFileView::nextChar(qint64 pos) const
+{
+    const qint64 size = text.size();
+    if (pos >= size)
+        return size;
+    if (text.at(pos) == '\r' && pos + 1 < size && text.at(pos + 1) == '\n')
+        return pos + 2;
+    ++pos;
+    while (pos < size && (static_cast<uchar>(text.at(pos)) & 0xC0) == 0x80)
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+void LargeFileView::moveCursor(qint64 pos)
+{
+    cursor = qBound<qint64>(0, pos, text.size());
+    lastEdit = NoEdit;
+    ensureCursorVisible();
+    viewport()->update();
+}
+
+void LargeFileView::ensureCursorVisible()
+{
+    const qint64 line = text.lineOf(cursor);
+    const qint64 first = verticalScrollBar()->value();
+    const int lines = visibleLines();
+    if (line < first)
+        verticalScrollBar()->setValue(static_cast<int>(qMin<qint64>(line, INT_MAX)));
+    else if (line >= first + lines)
+        verticalScrollBar()->setValue(static_cast<int>(qMin<qint64>(line - lines + 1, INT_MAX)));
+
+    const int x = columnX(text.lineStart(line), cursor);
+    const int shift = horizontalScrollBar()->value();
+    const int width = viewport()->width() - gutterWidth() - 2 * TextMargin;
+    if (x > horizontalScrollBar()->maximum() + width)
+        horizontalScrollBar()->setMaximum(x - width);
+    if (x < shift)
+        horizontalScrollBar()->setValue(x);
+    else if (x > shift + width)
+        horizontalScrollBar()->setValue(x - width);
+}
+
+void LargeFileView::insertText(const QByteArray &utf8)
+{
+    text.insert(cursor, utf8, lastEdit == Typing && cursor == lastEditEnd);
+    cursor += utf8.size();
+    lastEdit = Typing;
+    lastEditEnd = cursor;
+    edited();
+}
+
+void LargeFileView::eraseText(qint64 pos, qint64 length)
+{
+    if (length <= 0)
+        return;
+    text.remove(pos, length, lastEdit == Erasing && cursor == lastEditEnd);
+    cursor = pos;
+    lastEdit = Erasing;
+    lastEditEnd = cursor;
+    edited();
+}
+
+void LargeFileView::edited()
+{
+    updateScrollBars();
+    ensureCursorVisible();
+    viewport()->update();
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event)
+{
+    // В режиме просмотра клавиши только прокручивают
+    if (readOnly)
+    {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    const bool control = event->modifiers().testFlag(Qt::ControlModifier);
+    const qint64 line = text.lineOf(cursor);
+    const qint64 start = text.lineStart(line);
+    const qint64 lastLine = text.lineOf(text.size());
+    switch (event->key())
+    {
+    case Qt::Key_Left:
+        moveCursor(previousChar(cursor));
+        return;
+    case Qt::Key_Right:
+        moveCursor(nextChar(cursor));
+        return;
+    case Qt::Key_Up:
+    case Qt::Key_Down:
+    case Qt::Key_PageUp:
+    case Qt::Key_PageDown:
+    {
+        qint64 target = line;
+        if (event->key() == Qt::Key_Up)
+            target = line - 1;
+        else if (event->key() == Qt::Key_Down)
+            target = line + 1;
+        else if (event->key() == Qt::Key_PageUp)
+            target = line - visibleLines();
+        else
+            target = line + visibleLines();
+        target = qBound<qint64>(0, target, lastLine);
+        if (target != line)
+            moveCursor(positionInLine(text.lineStart(target), columnX(start, cursor)));
+        return;
+    }
+    case Qt::Key_Home:
+        moveCursor(control ? 0 : start);
+        return;
+    case Qt::Key_End:
+        moveCursor(control ? text.size() : visibleEnd(start));
+        return;
+    case Qt::Key_Backspace:
+        eraseText(previousChar(cursor), cursor - previousChar(cursor));
+        return;
+    case Qt::Key_Delete:
+        eraseText(cursor, nextChar(cursor) - cursor);
+        return;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        insertText(lineBreak);
+        return;
+    default:
+        break;
+    }
+
+    const QString typed = event->text();
+    if (!control && !typed.isEmpty() && (typed.at(0).isPrint() || typed.at(0) == QLatin1Char('\t')))
+    {
+        insertText(typed.toUtf8());
+        return;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event)
+{
+    if (readOnly || event->button() != Qt::LeftButton)
+    {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+    const qint64 line = qMin<qint64>(verticalScrollBar()->value() + event->pos().y() / fontMetrics().height(), text.lineOf(text.size()));
+    const int x = event->pos().x() - gutterWidth() - TextMargin + horizontalScrollBar()->value();
+    cursor = positionInLine(text.lineStart(line), qMax(0, x));
+    lastEdit = NoEdit;
+    viewport()->update();
+}
+
+void LargeFileView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(viewport());
+    const QFontMetrics metrics = fontMetrics();
+    const int lineHeight = metrics.height();
+    const int gutter = gutterWidth();
+    const int shift = horizontalScrollBar()->value();
+    const int width = viewport()->width();
+    const qint64 size = text.size();
+
+    painter.fillRect(0, 0, gutter, viewport()->height(), palette().window());
+
+    const qint64 first = verticalScrollBar()->value();
+    const int rows = visibleLines() + 1;
+    qint64 start = text.lineStart(first);
+    int widest = widestLine;
+    for (int i = 0; i < rows && start < size; ++i)
+    {
+        const QString line = lineText(start);
+        const int y = i * lineHeight;
+
+        painter.setPen(palette().color(QPalette::Disabled, QPalette::Text));
+        painter.drawText(QRect(0, y, gutter - TextMargin, lineHeight), Qt::AlignRight | Qt::AlignVCenter, QString::number(first + i + 1));
+
+        const int textWidth = metrics.size(LineFlags, line).width();
+        widest = qMax(widest, textWidth);
+        painter.setClipRect(gutter, y, width - gutter, lineHeight);
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(QRect(gutter + TextMargin - shift, y, textWidth + 1, lineHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter | LineFlags, line);
+        painter.setClipping(false);
+
+        start = text.findNewline(start) + 1;
+    }
+
+    // Курсор рисуется только в режиме правки
+    if (!readOnly)
+    {
+        const qint64 cursorLine = text.lineOf(cursor) - first;
+        if (cursorLine >= 0 && cursorLine < rows)
+        {
+            const int x = gutter + TextMargin - shift + columnX(text.lineStart(first + cursorLine), cursor);
+            if (x >= gutter)
+            {
+                const int y = static_cast<int>(cursorLine) * lineHeight;
+                painter.setPen(palette().color(QPalette::Text));
+                painter.drawLine(x, y, x, y + lineHeight - 1);
+            }
+        }
+    }
+
+    // Прокрутка вбок растёт по мере того, как встречаются более длинные строки
+    if (widest != widestLine)
+    {
+        widestLine = widest;
+        horizontalScrollBar()->setRange(0, qMax(0, gutter + widestLine + TextMargin - width));
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef LARGEFILEVIEW_H
+#define LARGEFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+
+#include "lineindex.h"
+#include "piecetable.h"
+
+// Вкладка больших текстовых файлов. Файл отображается в память, индекс строк строится в пуле
+// потоков, рисуются только видимые строки — открытие и переход к любой строке не зависят от
+// размера файла. Текст хранится таблицей кусков поверх отображения, поэтому после построения
+// индекса вкладку можно перевести в режим правки: вставка, удаление и отмена стоят O(log n)
+// от числа правок, а не от размера файла. Текст считается UTF-8
+class LargeFileView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit LargeFileView(QWidget *parent = nullptr);
+    ~LargeFileView() override;
+
+    // Отображает файл в память и запускает построение индекса; false — файл не открылся
+    bool open(const QString &path);
+    QString filePath() const { return path; }
+
+    bool isIndexing() const { return indexing.isRunning(); }
+    qint64 lineCount() const { return text.lineCount(); }
+    // Строка line (с нуля) становится первой видимой, курсор — в её начало
+    void goToLine(qint64 line);
+
+    // Правка доступна только после построения индекса
+    bool isReadOnly() const { return readOnly; }
+    void setReadOnly(bool readOnly);
+    bool isModified() const { return text.isModified(); }
+    // Куски пишутся во временный файл рядом с path, который затем заменяет path. Вкладка
+    // переходит на записанный файл: история правок сбрасывается, индекс строится заново
+    bool save(const QString &path);
+    void undo();
+    void redo();
+
+signals:
+    void indexReady(qint64 lines);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+
+private:
+    enum EditKind
+    {
+        NoEdit,
+        Typing,
+        Erasing
+    };
+
+    bool mapFile(const QString &path, const char *&data, qint64 &size);
+    void unmapFile();
+    void startIndexing(const char *data, qint64 size);
+    void indexFinished();
+    void updateScrollBars();
+    int visibleLines() const;
+    int gutterWidth() const;
+    qint64 visibleEnd(qint64 start) const; // Конец строки без перевода строки (и \r перед ним)
+    QString lineText(qint64 start) const;
+    int columnX(qint64 start, qint64 pos) const;
+    qint64 positionInLine(qint64 start, int x) const;
+    qint64 previousChar(qint64 pos) const;
+    qint64 nextChar(qint64 pos) const;
+    void moveCursor(qint64 pos);
+    void ensureCursorVisible();
+    void insertText(const QByteArray &utf8);
+    void eraseText(qint64 pos, qint64 length);
+    void edited();
+
+    QFile file;
+    uchar *mapped = nullptr;
+    QString path;
+    PieceTable text;
+    QFutureWatcher<LineIndex> indexing;
+    QAtomicInt cancelled;
+    int widestLine = 0; // Ширина самой длинной из нарисованных строк: по ней прокрутка вбок
+    bool readOnly = true;
+    qint64 cursor = 0;
+    QByteArray lineBreak = "\n"; // Как в первой строке файла
+    EditKind lastEdit = NoEdit;
+    qint64 lastEditEnd = -1; // Позиция курсора после последней правки: набор подряд отменяется целиком
+    // После сохранения правка и прокрутка возвращаются, когда построен индекс нового файла
+    bool resumeEditing = false;
+    int resumeLine = -1;
+};
+
+#endif // LARGEFILEVIEW_H
@@ -0,0 +1,133 @@
+#include "lineindex.h"
+
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const qint64 MinPieceSize = 16 * 1024 * 1024; // Меньшие куски не окупают передачу в другой поток
+    const qint64 ScanBlock = 1024 * 1024;         // Между проверками отмены
+
+    qint64 countLines(const char *begin, const char *end, const QAtomicInt *cancelled)
+    {
+        qint64 count = 0;
+        for (const char *pos = begin; pos < end && !cancelled->loadAcquire(); pos += ScanBlock)
+        {
+            count += std::count(pos, pos + qMin<qint64>(ScanBlock, end - pos), '\n');
+        }
+        return count;
+    }
+
+    // Отметки начала строк с номером, кратным Stride; line — номер строки, в которой лежит begin
+    QVector<qint64> markLines(const char *data, qint64 size, qint64 begin, qint64 end, qint64 line, const QAtomicInt *cancelled)
+    {
+        QVector<qint64> marks;
+        if (begin == 0)
+            marks.append(0);
+        const char *pos = data + begin;
+        const char *stop = data + end;
+        while (pos < stop)
+        {
+            const char *newline = static_cast<const char *>(std::memchr(pos, '\n', static_cast<size_t>(stop - pos)));
+            if (!newline)
+                break;
+            pos = newline + 1;
+            ++line;
+            if (line % LineIndex::Stride == 0 && pos - data < size)
+                marks.append(pos - data);
+            if ((line & 0xFFFF) == 0 && cancelled->loadAcquire())
+                break;
+        }
+        return marks;
+    }
+}
+
+qint64 LineIndex::lineStart(const char *data, qint64 size, qint64 line) const
+{
+    // Без отметок (индекс ещё строится) строки ищутся от начала буфера
+    qint64 mark = qMin<qint64>(line / Stride, checkpoints.size() - 1);
+    qint64 start = 0;
+    qint64 current = 0;
+    if (mark >= 0)
+    {
+        start = checkpoints.at(static_cast<int>(mark));
+        current = mark * Stride;
+    }
+    for (; current < line && start < size; ++current)
+    {
+        const void *newline = std::memchr(data + start, '\n', static_cast<size_t>(size - start));
+        start = newline ? static_cast<const char *>(newline) - data + 1 : size;
+    }
+    return start;
+}
+
+qint64 LineIndex::newlinesBefore(const char *data, qint64 pos) const
+{
+    // Последняя отметка не дальше pos; отметка k — начало строки k * Stride
+    const int k = static_cast<int>(std::upper_bound(checkpoints.constBegin(), checkpoints.constEnd(), pos) - checkpoints.constBegin()) - 1;
+    qint64 from = 0;
+    qint64 count = 0;
+    if (k >= 0)
+    {
+        from = checkpoints.at(k);
+        count = static_cast<qint64>(k) * Stride;
+    }
+    return count + std::count(data + from, data + pos, '\n');
+}
+
+LineIndex LineIndex::build(const char *data, qint64 size, const QAtomicInt *cancelled)
+{
+    LineIndex result;
+    if (size == 0)
+        return result;
+
+    const int parts = qMax(1, QThread::idealThreadCount());
+    const qint64 step = qMax(MinPieceSize, (size + parts - 1) / parts);
+    QVector<qint64> bounds;
+    for (qint64 pos = 0; pos < size; pos += step)
+    {
+        bounds.append(pos);
+    }
+    bounds.append(size);
+
+    QList<QFuture<qint64>> counts;
+    for (int i = 0; i + 1 < bounds.size(); ++i)
+    {
+        const char *begin = data + bounds.at(i);
+        const char *end = data + bounds.at(i + 1);
+        counts.append(QtConcurrent::run(&countLines, begin, end, cancelled));
+    }
+
+    // Номер строки, в которой начинается каждый кусок
+    QVector<qint64> firstLines;
+    qint64 newlines = 0;
+    for (QFuture<qint64> &count : counts)
+    {
+        firstLines.append(newlines);
+        newlines += count.result();
+    }
+    if (cancelled->loadAcquire())
+        return result;
+
+    QList<QFuture<QVector<qint64>>> marks;
+    for (int i = 0; i + 1 < bounds.size(); ++i)
+    {
+        const qint64 begin = bounds.at(i);
+        const qint64 end = bounds.at(i + 1);
+        const qint64 line = firstLines.at(i);
+        marks.append(QtConcurrent::run([data, size, begin, end, line, cancelled]()
+                                       { return markLines(data, size, begin, end, line, cancelled); }));
+    }
+    result.checkpoints.reserve(static_cast<int>(newlines / Stride + 1));
+    for (QFuture<QVector<qint64>> &part : marks)
+    {
+        result.checkpoints += part.result();
+    }
+
+    // Последняя строка без перевода строки в конце файла тоже строка
+    result.newlineCount = newlines;
+    result.lineCount = newlines + (data[size - 1] != '\n' ? 1 : 0);
+    return result;
+}
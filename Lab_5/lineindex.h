@@ -0,0 +1,28 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QVector>
+#include <QAtomicInt>
+
+// Индекс строк неизменяемого буфера (отображённого в память файла): смещения начала каждой
+// Stride-й строки. Остальные строки находятся поиском переводов строки от ближайшей отметки,
+// не дальше Stride строк, поэтому индекс в десятки раз меньше самого файла
+struct LineIndex
+{
+    static const int Stride = 64;
+
+    QVector<qint64> checkpoints;
+    qint64 lineCount = 0;
+    qint64 newlineCount = 0;
+
+    // Начало строки line (с нуля); за последней строкой — size
+    qint64 lineStart(const char *data, qint64 size, qint64 line) const;
+    // Число переводов строки в [0, pos)
+    qint64 newlinesBefore(const char *data, qint64 pos) const;
+
+    // Два прохода по кускам буфера в пуле потоков: число строк в каждом куске,
+    // затем отметки начала строк, номера которых после первого прохода известны
+    static LineIndex build(const char *data, qint64 size, const QAtomicInt *cancelled);
+};
+
+#endif // LINEINDEX_H
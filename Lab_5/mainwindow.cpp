@@ -1,12 +1,78 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "stylesidecar.h"
+#include "formulasidecar.h"
+
+#include <QApplication>
+#include <QtConcurrent>
+#include <numeric>
+#include <climits>
 
 QTemporaryFile MainWindow::tempFile;
 
+namespace
+{
+    // Оформление ячеек таблицы хранится отдельно от CSV, в каталоге настроек
+    QString tableSettingsPath(const QString &filePath)
+    {
+        QDir settingsDir("../Visual_Lab5/Lab_5/tabSettings");
+        return settingsDir.absoluteFilePath(QFileInfo(filePath).fileName() + ".styles");
+    }
+
+    // Формулы таблицы лежат рядом с оформлением
+    QString tableFormulasPath(const QString &filePath)
+    {
+        QDir settingsDir("../Visual_Lab5/Lab_5/tabSettings");
+        return settingsDir.absoluteFilePath(QFileInfo(filePath).fileName() + ".formulas");
+    }
+
+    // Файл настроек старого формата (JSON), читается, пока таблицу не пересохранят
+    QString legacyTableSettingsPath(const QString &filePath)
+    {
+        QDir settingsDir("../Visual_Lab5/Lab_5/tabSettings");
+        return settingsDir.absoluteFilePath(QFileInfo(filePath).fileName() + ".json");
+    }
+
+    // Файл оформления в памяти; пустая палитра — файла нет или он не читается
+    StyleSidecar readStyleSidecar(const QString &path)
+    {
+        StyleSidecar sidecar;
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly) || !sidecar.read(&file))
+            sidecar.palette.clear();
+        return sidecar;
+    }
+
+    // Текстовые файлы от этого размера открываются во вкладке просмотра (LargeFileView);
+    // порог в мегабайтах хранится в настройках приложения
+    const int DefaultLargeFileMegabytes = 64;
+
+    int largeFileMegabytes()
+    {
+        QSettings settings("Visual_Lab5", "Lab_5");
+        return settings.value("viewer/largeFileMegabytes", DefaultLargeFileMegabytes).toInt();
+    }
+
+    // Новые таблицы крупнее этого числа ячеек хранятся разреженно
+    const qint64 SparseTableCells = 64 * 1024;
+
+    // HTML-таблица в текстовом редакторе создаётся целиком, поэтому её размер ограничен
+    const qint64 MaxEditorTableCells = 100 * 100;
+
+    // Строки в диалоге сортировки и фильтра
+    const int SortKeyCount = 3;
+    const int FilterCount = 3;
+    const int ResetOrderResult = 2; // Код завершения диалога для кнопки «Сбросить»
+
+    // Строки в диалоге группировки
+    const int GroupKeyCount = 3;
+    const int AggregateCount = 3;
+}
+
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
                                           ui(new Ui::MainWindow),
                                           editor(new QTextEdit),
-                                          tableWidget(new QTableWidget),
+                                          tableView(nullptr),
                                           tableModified(false),
                                           graphicEditor(nullptr)
 {
@@ -14,7 +80,12 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
     ui->tabWidget->setTabsClosable(true);
     connect(ui->tabWidget, &QTabWidget::tabCloseRequested, this, &MainWindow::closeTab);
 
-    connect(tableWidget, &QTableWidget::cellChanged, this, &MainWindow::onTableCellChanged);
+    // Сводка по выделенным ячейкам таблицы в строке состояния
+    selectionLabel = new QLabel(statusBar());
+    statusBar()->addWidget(selectionLabel);
+    selectionStats = new SelectionStats(this);
+    connect(selectionStats, &SelectionStats::finished, this, &MainWindow::showSelectionStats);
+    connect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::updateSelectionStats);
 
     QWidget *centralWidget = new QWidget(this);
     this->setCentralWidget(centralWidget);
@@ -38,6 +109,8 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
 
 MainWindow::~MainWindow()
 {
+    // Вкладки удаляются после ui: пересчёт сводки при смене вкладки уже не нужен
+    disconnect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::updateSelectionStats);
     delete ui;
 }
 
@@ -83,126 +156,362 @@ void MainWindow::on_OpenFile_triggered()
 
     if (fileName.endsWith(".csv", Qt::CaseInsensitive))
     {
-        QFile file(fileName);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        // Таблица появляется сразу и заполняется блоками по мере разбора файла
+        QTableView *newTableView = createTableView(new TableModel());
+        newTableView->setWindowTitle(fileName);
+
+        pageIndex = ui->tabWidget->addTab(newTableView, QFileInfo(fileName).fileName());
+        ui->tabWidget->setCurrentIndex(pageIndex);
+        newTableView->setProperty("modified", false);
+        startCsvLoad(newTableView, fileName);
+    }
+    else if (QFileInfo(fileName).size() >= static_cast<qint64>(largeFileMegabytes()) * 1024 * 1024)
+    {
+        // Большой файл не читается в редактор целиком: он отображается в память и открывается
+        // для просмотра, индекс строк строится в фоне. Правка включается отдельным пунктом меню
+        LargeFileView *viewer = new LargeFileView();
+        if (!viewer->open(fileName))
         {
-            QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Не удалось открыть CSV файл"));
+            delete viewer;
+            QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Не удалось открыть файл"));
             return;
         }
+        connect(viewer, &LargeFileView::indexReady, this, [this](qint64 lines)
+                { statusBar()->showMessage(tr("Строк в файле: %1").arg(lines), 5000); });
+        statusBar()->showMessage(tr("Построение индекса строк..."));
 
-        QTextStream in(&file);
-        QStringList lines;
-        while (!in.atEnd())
-        {
-            lines.append(in.readLine());
-        }
-        file.close();
+        pageIndex = ui->tabWidget->addTab(viewer, QFileInfo(fileName).fileName());
+        ui->tabWidget->setCurrentIndex(pageIndex);
+    }
+    else
+    {
+        // Вкладка появляется сразу и заполняется кусками по мере чтения файла
+        editor = new QTextEdit();
+        pageIndex = ui->tabWidget->addTab(editor, QFileInfo(fileName).fileName());
+        ui->tabWidget->setCurrentIndex(pageIndex);
+        startTextLoad(editor, fileName);
+    }
+    pageIndex = ui->tabWidget->currentIndex();
+    ui->tabWidget->setTabToolTip(pageIndex, fileName);
+}
 
-        int rows = lines.size();
-        int columns = !lines.isEmpty() ? lines.first().split(",").size() : 0;
+QTableView *MainWindow::createTableView(TableModel *model)
+{
+    QTableView *view = new QTableView();
+    model->setParent(view);
+    view->setModel(model);
+    connect(model, &TableModel::cellEdited, this, &MainWindow::onTableCellChanged);
 
-        if (rows == 0 || columns == 0)
-        {
-            QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Файл CSV пуст или имеет неправильный формат"));
-            return;
-        }
+    // Сводка пересчитывается только для таблицы текущей вкладки
+    auto updateIfCurrent = [this, view]()
+    {
+        if (ui->tabWidget->currentWidget() == view)
+            updateSelectionStats();
+    };
+    connect(view->selectionModel(), &QItemSelectionModel::selectionChanged, this, updateIfCurrent);
+    connect(model, &QAbstractItemModel::modelReset, this, updateIfCurrent);
+    return view;
+}
 
-        if (tableWidget)
-        {
-            tableWidget->clear();
-            tableWidget->setRowCount(0);
-            tableWidget->setColumnCount(0);
-        }
+void MainWindow::updateSelectionStats()
+{
+    // Новое выделение отменяет подсчёт по прежнему, даже если сводку показывать не нужно
+    selectionStats->cancel();
 
-        QTableWidget *newTableWidget = new QTableWidget(rows, columns);
-        newTableWidget->setWindowTitle(fileName);
-        if (!tableWidget)
-        {
-            QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Не удалось создать таблицу"));
-            return;
-        }
+    QTableView *table = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *model = tableModelOf(table);
+    if (!model || !table->selectionModel()->hasSelection())
+    {
+        selectionLabel->clear();
+        return;
+    }
 
-        for (int i = 0; i < rows; ++i)
-        {
-            QStringList cells = lines.at(i).split(",");
-            if (cells.size() != columns)
+    QVector<CellRange> ranges;
+    for (const QItemSelectionRange &selected : table->selectionModel()->selection())
+    {
+        CellRange range;
+        range.top = selected.top();
+        range.left = selected.left();
+        range.bottom = selected.bottom();
+        range.right = selected.right();
+        ranges.append(range);
+    }
+
+    // Для одной ячейки сводка ничего не добавляет к её содержимому
+    if (ranges.size() == 1 && ranges.first().top == ranges.first().bottom && ranges.first().left == ranges.first().right)
+    {
+        selectionLabel->clear();
+        return;
+    }
+
+    selectionLabel->setText(tr("Подсчёт..."));
+    selectionStats->compute(model->tableData(), model->hasRowOrder() ? model->rowOrder() : QVector<int>(), ranges);
+}
+
+void MainWindow::showSelectionStats(const SelectionSummary &summary)
+{
+    QString text = tr("Количество: %1").arg(summary.count);
+    if (summary.numericCount > 0)
+    {
+        text += tr("   Сумма: %1   Мин: %2   Макс: %3   Среднее: %4")
+                    .arg(QString::number(summary.sum, 'g', 12))
+                    .arg(QString::number(summary.minimum, 'g', 12))
+                    .arg(QString::number(summary.maximum, 'g', 12))
+                    .arg(QString::number(summary.mean(), 'g', 12));
+    }
+    text += tr("   Различных: %1").arg(summary.distinct);
+    selectionLabel->setText(text);
+}
+
+TableModel *MainWindow::tableModelOf(QTableView *view)
+{
+    return view ? qobject_cast<TableModel *>(view->model()) : nullptr;
+}
+
+void MainWindow::startCsvLoad(QTableView *table, const QString &fileName)
+{
+    // Загрузчик принадлежит таблице: закрытие вкладки удаляет его и останавливает разбор
+    CsvLoader *loader = new CsvLoader(fileName, table);
+
+    // Индикатор загрузки с кнопкой отмены в строке состояния
+    QWidget *progressWidget = new QWidget(statusBar());
+    QHBoxLayout *progressLayout = new QHBoxLayout(progressWidget);
+    progressLayout->setContentsMargins(0, 0, 0, 0);
+    QLabel *progressLabel = new QLabel(QFileInfo(fileName).fileName(), progressWidget);
+    QProgressBar *progressBar = new QProgressBar(progressWidget);
+    progressBar->setRange(0, 100);
+    progressBar->setMaximumWidth(200);
+    QPushButton *cancelButton = new QPushButton(tr("Отмена"), progressWidget);
+    progressLayout->addWidget(progressLabel);
+    progressLayout->addWidget(progressBar);
+    progressLayout->addWidget(cancelButton);
+    statusBar()->addPermanentWidget(progressWidget);
+
+    connect(cancelButton, &QPushButton::clicked, loader, &CsvLoader::cancel);
+    connect(loader, &CsvLoader::progressChanged, progressBar, &QProgressBar::setValue);
+    connect(loader, &QObject::destroyed, progressWidget, &QObject::deleteLater);
+
+    // Файл оформления читается в пуле потоков одновременно с разбором CSV: к концу загрузки
+    // он обычно уже готов, и стилизованная таблица открывается так же быстро, как обычная
+    const QFuture<StyleSidecar> styles = QtConcurrent::run(&readStyleSidecar, tableSettingsPath(fileName));
+
+    TableModel *model = tableModelOf(table);
+    connect(loader, &CsvLoader::blockReady, table, [model, loader](const CsvBlock &block)
             {
-                QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Некорректный CSV файл: строки содержат разное количество столбцов"));
-                delete newTableWidget;
-                return;
-            }
+                // Готовый блок столбцов просто дописывается в хранилище модели
+                model->appendColumns(block.columns, block.rowCount, block.rowOffsets);
+                loader->blockConsumed();
+            });
 
-            for (int j = 0; j < cells.size(); ++j)
+    connect(loader, &CsvLoader::finished, table, [this, table, loader, fileName, styles](bool success, const QString &errorMessage)
             {
-                newTableWidget->setItem(i, j, new QTableWidgetItem(cells.at(j)));
-            }
-        }
-        QFileInfo fileInfo(fileName);
-        QString relativePath = "../Visual_Lab5/Lab_5/tabSettings";
-        QDir settingsDir(relativePath);
-        QString jsonFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".json");
-        QFile settingsFile(jsonFilePath);
-        if (settingsFile.exists() && settingsFile.open(QIODevice::ReadOnly))
-        {
-            QByteArray settingsData = settingsFile.readAll();
-            settingsFile.close();
+                loader->deleteLater();
 
-            QJsonDocument settingsDoc = QJsonDocument::fromJson(settingsData);
-            QJsonArray cellSettingsArray = settingsDoc.array();
+                if (!success)
+                {
+                    // Отменённую или ошибочную загрузку не оставляем открытой наполовину
+                    int index = ui->tabWidget->indexOf(table);
+                    if (index != -1)
+                    {
+                        ui->tabWidget->removeTab(index);
+                    }
+                    table->deleteLater();
+                    if (!errorMessage.isEmpty())
+                    {
+                        QMessageBox::warning(nullptr, QObject::tr("Ошибка"), errorMessage);
+                    }
+                    return;
+                }
+
+                // Сначала таблица сверяется с файлом, затем накладываются формулы: пересчитанные
+                // ими строки остаются помеченными и попадут в следующее сохранение
+                TableModel *model = tableModelOf(table);
+                model->finishLoad(fileName, loader->fileDialect(), loader->dataEnd());
+                // Кэш разбора хранит содержимое CSV: снимок берётся до пересчёта формул
+                // (столбцы общие, копируются только те, что изменит пересчёт)
+                const TableData parsed = model->tableData();
+                const bool recalculated = applyTableSettings(model, fileName, styles.result());
+                table->setProperty("modified", recalculated);
+                if (recalculated)
+                    statusBar()->showMessage(tr("Значения формул в файле устарели и пересчитаны"), 5000);
+
+                // Большой файл разобран заново — в фоне кладём результат в кэш для следующего открытия
+                const CsvCache::Key key = loader->cacheKey();
+                if (!loader->loadedFromCache() && key.isValid())
+                {
+                    QtConcurrent::run(&CsvCache::store, fileName, key, parsed, model->fileLayout().rowOffsets);
+                }
+            });
 
-            for (int i = 0; i < cellSettingsArray.size(); ++i)
+    loader->start();
+}
+
+void MainWindow::startTextLoad(QTextEdit *textEdit, const QString &fileName)
+{
+    // Загрузчик принадлежит редактору: закрытие вкладки удаляет его и останавливает чтение
+    TextLoader *loader = new TextLoader(fileName, textEdit);
+
+    // Индикатор загрузки с кнопкой отмены в строке состояния
+    QWidget *progressWidget = new QWidget(statusBar());
+    QHBoxLayout *progressLayout = new QHBoxLayout(progressWidget);
+    progressLayout->setContentsMargins(0, 0, 0, 0);
+    QLabel *progressLabel = new QLabel(QFileInfo(fileName).fileName(), progressWidget);
+    QProgressBar *progressBar = new QProgressBar(progressWidget);
+    progressBar->setRange(0, 100);
+    progressBar->setMaximumWidth(200);
+    QPushButton *cancelButton = new QPushButton(tr("Отмена"), progressWidget);
+    progressLayout->addWidget(progressLabel);
+    progressLayout->addWidget(progressBar);
+    progressLayout->addWidget(cancelButton);
+    statusBar()->addPermanentWidget(progressWidget);
+
+    connect(cancelButton, &QPushButton::clicked, loader, &TextLoader::cancel);
+    connect(loader, &TextLoader::progressChanged, progressBar, &QProgressBar::setValue);
+    connect(loader, &QObject::destroyed, progressWidget, &QObject::deleteLater);
+
+    // Пока файл читается, текст можно прокручивать и читать, но не править. История отмены
+    // на время загрузки выключена: иначе каждый кусок стал бы отдельным шагом отмены
+    QTextDocument *document = textEdit->document();
+    textEdit->setReadOnly(true);
+    document->setUndoRedoEnabled(false);
+
+    connect(loader, &TextLoader::chunkReady, textEdit, [document, loader](const QString &text)
             {
-                QJsonArray rowSettings = cellSettingsArray[i].toArray();
-                for (int j = 0; j < rowSettings.size(); ++j)
+                QTextCursor cursor(document);
+                cursor.movePosition(QTextCursor::End);
+                cursor.insertText(text);
+                document->setModified(false);
+                loader->chunkConsumed();
+            });
+
+    connect(loader, &TextLoader::finished, textEdit, [this, textEdit, document, loader, fileName](bool success, const QString &errorMessage)
+            {
+                loader->deleteLater();
+
+                if (!success)
                 {
-                    QTableWidgetItem *item = newTableWidget->item(i, j);
-                    if (item)
+                    // Недочитанный текст не оставляем открытым: его сохранение обрезало бы файл
+                    int index = ui->tabWidget->indexOf(textEdit);
+                    if (index != -1)
                     {
-                        QJsonObject cellSettings = rowSettings[j].toObject();
-                        item->setForeground(QColor(cellSettings["textColor"].toString()));
-                        item->setBackground(QColor(cellSettings["backgroundColor"].toString()));
-                        QFont font;
-                        font.fromString(cellSettings["font"].toString());
-                        item->setFont(font);
-                        qDebug() << "Restoring font: " << cellSettings["font"].toString();
-                        item->setTextAlignment(cellSettings["alignment"].toInt());
+                        ui->tabWidget->removeTab(index);
                     }
+                    textEdit->deleteLater();
+                    if (!errorMessage.isEmpty())
+                    {
+                        QMessageBox::warning(nullptr, QObject::tr("Ошибка"), errorMessage);
+                    }
+                    return;
                 }
-            }
-        }
 
-        pageIndex = ui->tabWidget->addTab(newTableWidget, QFileInfo(fileName).fileName());
-        ui->tabWidget->setCurrentIndex(pageIndex);
-        connect(newTableWidget, &QTableWidget::cellChanged, this, &MainWindow::onTableCellChanged);
-        newTableWidget->setProperty("modified", false);
+                // Оформление накладывается до включения истории отмены
+                loadTextSettings(textEdit, fileName);
+                document->setUndoRedoEnabled(true);
+                textEdit->setReadOnly(false);
+                document->setModified(false);
+            });
+
+    loader->start();
+}
+
+bool MainWindow::applyTableSettings(TableModel *model, const QString &fileName, const StyleSidecar &styles)
+{
+    // Формулы, чьи значения в CSV устарели, пересчитываются — таблица тогда расходится с файлом
+    bool recalculated = false;
+    QFile formulasFile(tableFormulasPath(fileName));
+    if (formulasFile.exists() && formulasFile.open(QIODevice::ReadOnly))
+    {
+        FormulaSidecar formulas;
+        if (formulas.read(&formulasFile))
+            recalculated = model->setFormulas(formulas.entries);
+        formulasFile.close();
     }
-    else
+
+    // Номера стилей ложатся в таблицу столбцами как есть; сами стили превращаются
+    // в значения ролей только при отрисовке ячеек (TableModel::data)
+    StyleSidecar sidecar = styles;
+    bool loaded = !sidecar.palette.isEmpty();
+    if (!QFile::exists(tableSettingsPath(fileName)))
     {
-        QFile file(fileName);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        QFile legacyFile(legacyTableSettingsPath(fileName));
+        if (legacyFile.exists() && legacyFile.open(QIODevice::ReadOnly))
         {
-
-            QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Не удалось открыть файл"));
-            return;
+            loaded = sidecar.readLegacyJson(legacyFile.readAll(), model->rowCount(), model->columnCount());
+            legacyFile.close();
         }
+    }
 
-        QTextStream in(&file);
-        QString fileContent = in.readAll();
-        file.close();
+    // Оформление от другой версии файла (изменилась форма таблицы) не применяем
+    if (!loaded || sidecar.rows != model->rowCount() || sidecar.columns != model->columnCount())
+        return recalculated;
 
-        QTextEdit *newEdit = new QTextEdit();
-        newEdit->setText(fileContent);
+    model->setStyles(sidecar.palette, sidecar.columnStyles);
+    return recalculated;
+}
 
-        int pageIndex = ui->tabWidget->addTab(newEdit, QFileInfo(fileName).fileName());
-        ui->tabWidget->setCurrentIndex(pageIndex);
-        pageIndex = ui->tabWidget->currentIndex();
+void MainWindow::saveTable(QTableView *table, const QString &filePath)
+{
+    // Сериализатор принадлежит вкладке: при закрытии она дождётся окончания записи
+    TableSerializer *serializer = table->findChild<TableSerializer *>();
+    if (!serializer)
+    {
+        serializer = new TableSerializer(table);
+        connect(serializer, &TableSerializer::finished, table, [this, table, serializer](bool success, const QString &errorMessage)
+                {
+                    TableModel *model = tableModelOf(table);
+                    if (success)
+                    {
+                        model->setFileLayout(serializer->fileLayout());
+
+                        // Файл переписан: слежение продолжается с его нового конца
+                        CsvFollower *follower = table->findChild<CsvFollower *>();
+                        if (follower && model->fileLayout().isValid() && model->fileLayout().filePath == follower->path())
+                            follower->setOffset(model->fileLayout().rowOffsets.last());
+                        else
+                            delete follower;
+                        return;
+                    }
 
-        editor = qobject_cast<QTextEdit *>(ui->tabWidget->currentWidget());
-        loadTextSettings(fileName);
-        editor->document()->setModified(false);
+                    // Несохранённые данные снова помечаем как изменённые; файл мог остаться
+                    // записанным наполовину, поэтому в следующий раз он переписывается целиком
+                    model->restoreChanges(serializer->changes());
+                    CsvLayout unknown;
+                    unknown.dialect = model->fileLayout().dialect;
+                    model->setFileLayout(unknown);
+                    table->setProperty("modified", true);
+                    QMessageBox::warning(this, QObject::tr("Ошибка"), errorMessage);
+                });
     }
-    pageIndex = ui->tabWidget->currentIndex();
-    ui->tabWidget->setTabToolTip(pageIndex, fileName);
+
+    if (serializer->isRunning())
+    {
+        QMessageBox::information(this, tr("Сохранение"), tr("Предыдущее сохранение этой таблицы ещё не завершено"));
+        return;
+    }
+
+    QString settingsPath = tableSettingsPath(filePath);
+    QDir settingsDir = QFileInfo(settingsPath).absoluteDir();
+    if (!settingsDir.exists() && !settingsDir.mkpath("."))
+    {
+        qDebug() << "Unable to create directory: " << settingsDir.absolutePath();
+        settingsPath.clear();
+    }
+    const QString formulasPath = settingsPath.isEmpty() ? QString() : tableFormulasPath(filePath);
+
+    // Снимок дешёвый (данные разделяются); правки во время записи снова выставят флаг modified
+    // и попадут в новые изменения модели
+    TableModel *model = tableModelOf(table);
+    table->setProperty("modified", false);
+
+    // Файл сохраняется в том же формате, в каком был открыт. Изменились столбцы — изменилась
+    // и строка заголовков, тогда файл переписывается целиком
+    CsvLayout layout = model->fileLayout();
+    if (layout.dialect.hasHeader && layout.dialect.header != model->columnTitles())
+    {
+        layout.dialect.header = model->columnTitles();
+        layout.rowOffsets.clear();
+    }
+    serializer->save(model->tableData(), model->formulaSheet(), filePath, settingsPath, formulasPath, layout, model->takeChanges());
 }
 
 void MainWindow::on_SaveFile_triggered()
@@ -216,7 +525,15 @@ void MainWindow::on_SaveFile_triggered()
 
     // Определяем тип виджета
     editor = qobject_cast<QTextEdit *>(currentWidget);
-    QTableWidget *tableWidget = qobject_cast<QTableWidget *>(currentWidget);
+    QTableView *tableView = qobject_cast<QTableView *>(currentWidget);
+    TableModel *model = tableModelOf(tableView);
+
+    // Недочитанный текст не сохраняем: файл обрезался бы до загруженной части
+    if (editor && editor->findChild<TextLoader *>())
+    {
+        QMessageBox::information(this, tr("Сохранение"), tr("Файл ещё загружается"));
+        return;
+    }
 
     QString filePath = ui->tabWidget->tabToolTip(ui->tabWidget->currentIndex()); // Получаем путь к файлу из tabToolTip
 
@@ -226,16 +543,11 @@ void MainWindow::on_SaveFile_triggered()
         if (!filePath.isEmpty())
         {
             // Если файл существует, сохраняем изменения без диалога
-            QFile file(filePath);
-            if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            if (!TextFileWriter::save(editor->document(), filePath))
             {
                 QMessageBox::warning(nullptr, "Ошибка", "Не удалось сохранить текстовый файл");
                 return;
             }
-
-            QTextStream out(&file);
-            out << editor->toPlainText();
-            file.close();
             saveTextSettings(filePath);
         }
         else
@@ -247,16 +559,11 @@ void MainWindow::on_SaveFile_triggered()
                 return;
             }
 
-            QFile file(filePath);
-            if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            if (!TextFileWriter::save(editor->document(), filePath))
             {
                 QMessageBox::warning(nullptr, "Ошибка", "Не удалось сохранить текстовый файл");
                 return;
             }
-
-            QTextStream out(&file);
-            out << editor->toPlainText();
-            file.close();
             saveTextSettings(filePath);
             // Устанавливаем путь в качестве подсказки на вкладке
             ui->tabWidget->setTabToolTip(ui->tabWidget->currentIndex(), filePath);
@@ -264,80 +571,10 @@ void MainWindow::on_SaveFile_triggered()
         }
         editor->document()->setModified(false); // Снимаем флаг изменения документа
     }
-    else if (tableWidget && tableWidget->property("modified").toBool())
+    else if (model && tableView->property("modified").toBool())
     {
         // Обработка для таблицы
-        if (!filePath.isEmpty())
-        {
-            // Если файл существует, сохраняем изменения без диалога
-            QFile file(filePath);
-            if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-            {
-                QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Не удалось открыть файл для записи"));
-                return;
-            }
-
-            QTextStream out(&file);
-            int rows = tableWidget->rowCount();
-            int columns = tableWidget->columnCount();
-
-            // Записываем данные таблицы в файл
-            QJsonArray cellSettingsArray;
-            for (int i = 0; i < rows; ++i)
-            {
-                QStringList rowContents;
-                QJsonArray rowCellSettings;
-
-                for (int j = 0; j < columns; ++j)
-                {
-                    QTableWidgetItem *item = tableWidget->item(i, j);
-
-                    // Проверка на nullptr
-                    if (!item)
-                    {
-                        item = new QTableWidgetItem(""); // Создаем пустую ячейку, если она не существует
-                        tableWidget->setItem(i, j, item);
-                    }
-
-                    QString cellText = item->text();
-                    rowContents << cellText;
-
-                    // Сохраняем настройки ячейки
-                    QJsonObject cellSettings;
-                    cellSettings["textColor"] = item->foreground().color().name();
-                    cellSettings["backgroundColor"] = item->background().color().name();
-                    cellSettings["font"] = item->font().toString();
-                    qDebug() << item->font().toString();
-                    cellSettings["alignment"] = item->textAlignment();
-                    rowCellSettings.append(cellSettings);
-                }
-
-                out << rowContents.join(",") << "\n";
-                cellSettingsArray.append(rowCellSettings);
-            }
-
-            // Сохраняем настройки в JSON файл
-            QFileInfo fileInfo(filePath);
-            QString relativePath = "../Visual_Lab5/Lab_5/tabSettings";
-
-            QDir settingsDir(relativePath);
-            if (!settingsDir.exists() && !settingsDir.mkpath("."))
-            {
-                qDebug() << "Unable to create directory: " << settingsDir.absolutePath();
-                return;
-            }
-            QString jsonFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".json");
-            QFile settingsFile(jsonFilePath);
-            if (settingsFile.open(QIODevice::WriteOnly))
-            {
-                QJsonDocument settingsDoc(cellSettingsArray);
-                settingsFile.write(settingsDoc.toJson());
-                settingsFile.close();
-            }
-            tableWidget->setProperty("modified", false);
-            file.close();
-        }
-        else
+        if (filePath.isEmpty())
         {
             // Если файл новый, вызываем диалог сохранения
             filePath = QFileDialog::getSaveFileName(this, tr("Сохранить файл таблицы"), "", tr("CSV Files (*.csv);;All Files (*)"));
@@ -346,76 +583,17 @@ void MainWindow::on_SaveFile_triggered()
                 return;
             }
 
-            QFile file(filePath);
-            if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-            {
-                QMessageBox::warning(nullptr, QObject::tr("Ошибка"), QObject::tr("Не удалось открыть файл для записи"));
-                return;
-            }
-
-            QTextStream out(&file);
-            int rows = tableWidget->rowCount();
-            int columns = tableWidget->columnCount();
-
-            // Записываем данные таблицы в файл
-            QJsonArray cellSettingsArray;
-            for (int i = 0; i < rows; ++i)
-            {
-                QStringList rowContents;
-                QJsonArray rowCellSettings;
-
-                for (int j = 0; j < columns; ++j)
-                {
-                    QTableWidgetItem *item = tableWidget->item(i, j);
-
-                    // Проверка на nullptr
-                    if (!item)
-                    {
-                        item = new QTableWidgetItem(""); // Создаем пустую ячейку, если она не существует
-                        tableWidget->setItem(i, j, item);
-                    }
-
-                    QString cellText = item->text();
-                    rowContents << cellText;
-
-                    // Сохраняем настройки ячейки
-                    QJsonObject cellSettings;
-                    cellSettings["textColor"] = item->foreground().color().name();
-                    cellSettings["backgroundColor"] = item->background().color().name();
-                    cellSettings["font"] = item->font().toString();
-                    cellSettings["alignment"] = item->textAlignment();
-                    rowCellSettings.append(cellSettings);
-                }
-
-                out << rowContents.join(",") << "\n";
-                cellSettingsArray.append(rowCellSettings);
-            }
-
-            // Сохраняем настройки в JSON файл
-            QFileInfo fileInfo(filePath);
-            QString relativePath = "../Visual_Lab5/Lab_5/tabSettings";
-
-            QDir settingsDir(relativePath);
-            if (!settingsDir.exists() && !settingsDir.mkpath("."))
-            {
-                qDebug() << "Unable to create directory: " << settingsDir.absolutePath();
-                return;
-            }
-            QString jsonFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".json");
-            QFile settingsFile(jsonFilePath);
-            if (settingsFile.open(QIODevice::WriteOnly))
-            {
-                QJsonDocument settingsDoc(cellSettingsArray);
-                settingsFile.write(settingsDoc.toJson());
-                settingsFile.close();
-            }
-
-            file.close();
             // Устанавливаем путь в качестве подсказки на вкладке
             ui->tabWidget->setTabToolTip(ui->tabWidget->currentIndex(), filePath);
             ui->tabWidget->setTabText(ui->tabWidget->currentIndex(), QFileInfo(filePath).fileName());
-            tableWidget->setProperty("modified", false);
         }
+        saveTable(tableView, filePath);
+    }
+    else if (LargeFileView *viewer = qobject_cast<LargeFileView *>(currentWidget))
+    {
+        // Большой файл пишется кусками прямо из отображения и буфера правок
+        if (viewer->isModified() && !viewer->save(viewer->filePath()))
+            QMessageBox::warning(this, tr("Ошибка"), tr("Не удалось сохранить файл"));
     }
     else
     {
@@ -433,103 +611,55 @@ void MainWindow::on_SaveFileAs_triggered()
     }
 
     editor = qobject_cast<QTextEdit *>(currentWidget);
-    QTableWidget *tableWidget = qobject_cast<QTableWidget *>(currentWidget);
+    QTableView *tableView = qobject_cast<QTableView *>(currentWidget);
+
+    // Недочитанный текст не сохраняем: файл обрезался бы до загруженной части
+    if (editor && editor->findChild<TextLoader *>())
+    {
+        QMessageBox::information(this, tr("Сохранение"), tr("Файл ещё загружается"));
+        return;
+    }
 
     QString filePath;
-    if (tableWidget)
+    if (tableModelOf(tableView))
     {
         // Если активна таблица
         filePath = QFileDialog::getSaveFileName(this, tr("Сохранить файл таблицы как"), "", tr("CSV Files (*.csv);;All Files (*)"));
         if (filePath.isEmpty())
             return;
 
-        QFile file(filePath);
-        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-        {
-            QMessageBox::warning(this, tr("Ошибка"), tr("Не удалось открыть файл для записи"));
+        saveTable(tableView, filePath);
+        ui->tabWidget->setTabToolTip(ui->tabWidget->currentIndex(), filePath);
+        ui->tabWidget->setTabText(ui->tabWidget->currentIndex(), QFileInfo(filePath).fileName());
+    }
+    else if (editor)
+    {
+        // Если активен текстовый редактор
+        filePath = QFileDialog::getSaveFileName(this, tr("Сохранить файл как"), "", tr("Text Files (*.txt);;All Files (*)"));
+        if (filePath.isEmpty())
             return;
-        }
-
-        QTextStream out(&file);
-        int rows = tableWidget->rowCount();
-        int columns = tableWidget->columnCount();
-
-        QJsonArray cellSettingsArray;
-        for (int i = 0; i < rows; ++i)
-        {
-            QStringList rowContents;
-            QJsonArray rowCellSettings;
-
-            for (int j = 0; j < columns; ++j)
-            {
-                QTableWidgetItem *item = tableWidget->item(i, j);
-
-                // Проверка на nullptr
-                if (!item)
-                {
-                    item = new QTableWidgetItem(""); // Создаем пустую ячейку, если она не существует
-                    tableWidget->setItem(i, j, item);
-                }
-
-                QString cellText = item->text();
-                rowContents << cellText;
-
-                // Сохраняем настройки ячейки
-                QJsonObject cellSettings;
-                cellSettings["textColor"] = item->foreground().color().name();
-                cellSettings["backgroundColor"] = item->background().color().name();
-                cellSettings["font"] = item->font().toString();
-                qDebug() << item->font().toString();
-                cellSettings["alignment"] = item->textAlignment();
-                rowCellSettings.append(cellSettings);
-            }
-
-            out << rowContents.join(",") << "\n";
-            cellSettingsArray.append(rowCellSettings);
-        }
-
-        // Сохраняем настройки в JSON файл
-        QFileInfo fileInfo(filePath);
-        QString relativePath = "../Visual_Lab5/Lab_5/tabSettings";
 
-        QDir settingsDir(relativePath);
-        if (!settingsDir.exists() && !settingsDir.mkpath("."))
+        if (!TextFileWriter::save(editor->document(), filePath))
         {
-            qDebug() << "Unable to create directory: " << settingsDir.absolutePath();
+            QMessageBox::warning(this, tr("Ошибка"), tr("Не удалось сохранить файл"));
             return;
         }
-        QString jsonFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".json");
-        QFile settingsFile(jsonFilePath);
-        if (settingsFile.open(QIODevice::WriteOnly))
-        {
-            QJsonDocument settingsDoc(cellSettingsArray);
-            settingsFile.write(settingsDoc.toJson());
-            settingsFile.close();
-        }
+        saveTextSettings(filePath);
 
-        file.close();
         ui->tabWidget->setTabToolTip(ui->tabWidget->currentIndex(), filePath);
         ui->tabWidget->setTabText(ui->tabWidget->currentIndex(), QFileInfo(filePath).fileName());
     }
-    else if (editor)
+    else if (LargeFileView *viewer = qobject_cast<LargeFileView *>(currentWidget))
     {
-        // Если активен текстовый редактор
         filePath = QFileDialog::getSaveFileName(this, tr("Сохранить файл как"), "", tr("Text Files (*.txt);;All Files (*)"));
         if (filePath.isEmpty())
             return;
 
-        QFile file(filePath);
-        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        if (!viewer->save(filePath))
         {
             QMessageBox::warning(this, tr("Ошибка"), tr("Не удалось сохранить файл"));
             return;
         }
-
-        QTextStream out(&file);
-        out << editor->toPlainText();
-        file.close();
-        saveTextSettings(filePath);
-
         ui->tabWidget->setTabToolTip(ui->tabWidget->currentIndex(), filePath);
         ui->tabWidget->setTabText(ui->tabWidget->currentIndex(), QFileInfo(filePath).fileName());
     }
@@ -543,7 +673,7 @@ void MainWindow::closeTab(int index)
     {
         // Попытка преобразования в QTextEdit
         QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
-        QTableWidget *table = qobject_cast<QTableWidget *>(widget);
+        QTableView *table = qobject_cast<QTableView *>(widget);
         QString filePath = ui->tabWidget->tabToolTip(index);
 
         // Проверка для QTextEdit
@@ -552,12 +682,18 @@ void MainWindow::closeTab(int index)
             ui->tabWidget->removeTab(index);
             editor->deleteLater(); // Используем deleteLater() вместо delete
         }
-        // Проверка для QTableWidget
-        else if (table && !tableWidget->property("modified").toBool())
+        // Проверка для таблицы
+        else if (table && !table->property("modified").toBool())
         {
             ui->tabWidget->removeTab(index);
             table->deleteLater(); // Используем deleteLater() вместо delete
         }
+        // Большой файл без несохранённых правок
+        else if (qobject_cast<LargeFileView *>(widget) && !qobject_cast<LargeFileView *>(widget)->isModified())
+        {
+            ui->tabWidget->removeTab(index);
+            widget->deleteLater();
+        }
         else
         {
             // Диалоговое окно для подтверждения действий
@@ -591,6 +727,7 @@ void MainWindow::setupShortcuts()
     ui->SaveFileAs->setShortcut(QKeySequence::SaveAs);
     ui->Copy->setShortcut(QKeySequence::Copy);
     ui->Clear->setShortcut(QKeySequence("Ctrl+Del"));
+    ui->GoToLine->setShortcut(QKeySequence("Ctrl+G"));
     ui->Cut->setShortcut(QKeySequence::Cut);
     ui->Search->setShortcut(QKeySequence::Find);
     ui->Paste->setShortcut(QKeySequence::Paste);
@@ -603,6 +740,12 @@ void MainWindow::on_Search_triggered()
 {
     // Получаем текущий виджет
     QWidget *currentWidget = ui->tabWidget->currentWidget();
+    QTableView *table = qobject_cast<QTableView *>(currentWidget);
+    if (tableModelOf(table))
+    {
+        searchTable(table, false);
+        return;
+    }
     editor = qobject_cast<QTextEdit *>(currentWidget);
 
     if (!editor)
@@ -755,6 +898,12 @@ void MainWindow::on_Replace_triggered()
 {
     // Получаем текущий виджет
     QWidget *currentWidget = ui->tabWidget->currentWidget();
+    QTableView *table = qobject_cast<QTableView *>(currentWidget);
+    if (tableModelOf(table))
+    {
+        searchTable(table, true);
+        return;
+    }
     editor = qobject_cast<QTextEdit *>(currentWidget);
 
     if (!editor)
@@ -844,6 +993,218 @@ void MainWindow::on_Replace_triggered()
     replaceDialog.exec();
 }
 
+void MainWindow::searchTable(QTableView *table, bool replace)
+{
+    TableModel *model = tableModelOf(table);
+    QDialog dialog(this);
+    dialog.setWindowTitle(replace ? "Поиск и замена" : "Поиск");
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+
+    QLineEdit *searchLineEdit = new QLineEdit(&dialog);
+    layout->addWidget(new QLabel("Введите текст для поиска:", &dialog));
+    layout->addWidget(searchLineEdit);
+    QLineEdit *replaceLineEdit = nullptr;
+    if (replace)
+    {
+        replaceLineEdit = new QLineEdit(&dialog);
+        layout->addWidget(new QLabel("Введите текст для замены:", &dialog));
+        layout->addWidget(replaceLineEdit);
+    }
+
+    QCheckBox *caseSensitiveCheckBox = new QCheckBox("Учитывать регистр", &dialog);
+    layout->addWidget(caseSensitiveCheckBox);
+    QCheckBox *wholeWordCheckBox = new QCheckBox("Искать только полные слова", &dialog);
+    layout->addWidget(wholeWordCheckBox);
+
+    // Где искать: вся таблица, выделение на момент открытия диалога или перечисленные столбцы
+    QComboBox *scopeComboBox = new QComboBox(&dialog);
+    scopeComboBox->addItems(QStringList() << "Вся таблица" << "Выделение" << "Столбцы");
+    QLineEdit *columnsLineEdit = new QLineEdit(&dialog);
+    columnsLineEdit->setPlaceholderText("Номера столбцов, например: 1, 3-5");
+    columnsLineEdit->setEnabled(false);
+    connect(scopeComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), columnsLineEdit, [columnsLineEdit](int index)
+            { columnsLineEdit->setEnabled(index == 2); });
+    layout->addWidget(scopeComboBox);
+    layout->addWidget(columnsLineEdit);
+
+    QVector<CellRange> selection;
+    for (const QItemSelectionRange &selected : table->selectionModel()->selection())
+    {
+        CellRange range;
+        range.top = selected.top();
+        range.left = selected.left();
+        range.bottom = selected.bottom();
+        range.right = selected.right();
+        selection.append(range);
+    }
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    QPushButton *nextButton = new QPushButton("Найти далее", &dialog);
+    QPushButton *allButton = new QPushButton("Найти все", &dialog);
+    buttonLayout->addWidget(nextButton);
+    buttonLayout->addWidget(allButton);
+    QPushButton *replaceButton = nullptr;
+    if (replace)
+    {
+        replaceButton = new QPushButton("Заменить все", &dialog);
+        buttonLayout->addWidget(replaceButton);
+    }
+    layout->addLayout(buttonLayout);
+    QLabel *statusLabel = new QLabel(&dialog);
+    layout->addWidget(statusLabel);
+    QPushButton *closeButton = new QPushButton("Закрыть", &dialog);
+    layout->addWidget(closeButton);
+
+    // Найденные ячейки запоминаются, пока не изменились условия поиска или таблица
+    QVector<quint64> matches;
+    QString matchesFor;
+    auto options = [&]()
+    {
+        TableSearchOptions searchOptions;
+        searchOptions.text = searchLineEdit->text();
+        searchOptions.caseSensitive = caseSensitiveCheckBox->isChecked();
+        searchOptions.wholeWord = wholeWordCheckBox->isChecked();
+        return searchOptions;
+    };
+    auto collect = [&]()
+    {
+        if (searchLineEdit->text().isEmpty())
+        {
+            QMessageBox::information(&dialog, "Поиск", "Введите текст для поиска.");
+            return false;
+        }
+
+        QVector<CellRange> ranges;
+        if (scopeComboBox->currentIndex() == 1)
+        {
+            if (selection.isEmpty())
+            {
+                QMessageBox::information(&dialog, "Поиск", "В таблице ничего не выделено.");
+                return false;
+            }
+            ranges = selection;
+        }
+        else if (scopeComboBox->currentIndex() == 2)
+        {
+            for (const QString &part : columnsLineEdit->text().split(QLatin1Char(','), QString::SkipEmptyParts))
+            {
+                const QStringList bounds = part.trimmed().split(QLatin1Char('-'));
+                bool firstOk = false;
+                bool lastOk = true;
+                CellRange range;
+                range.bottom = model->rowCount() - 1;
+                range.left = bounds.first().trimmed().toInt(&firstOk) - 1;
+                range.right = bounds.size() > 1 ? bounds.at(1).trimmed().toInt(&lastOk) - 1 : range.left;
+                if (!firstOk || !lastOk || bounds.size() > 2 || range.left < 0 || range.right < range.left)
+                {
+                    QMessageBox::warning(&dialog, "Ошибка", tr("Неверный номер столбца: %1").arg(part.trimmed()));
+                    return false;
+                }
+                ranges.append(range);
+            }
+        }
+        else
+        {
+            CellRange range;
+            range.bottom = model->rowCount() - 1;
+            range.right = model->columnCount() - 1;
+            ranges.append(range);
+        }
+
+        const QString signature = QStringList({searchLineEdit->text(), QString::number(caseSensitiveCheckBox->isChecked()),
+                                               QString::number(wholeWordCheckBox->isChecked()), QString::number(scopeComboBox->currentIndex()),
+                                               columnsLineEdit->text()})
+                                      .join(QChar(0));
+        if (signature != matchesFor)
+        {
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+            matches = TableSearch::findAll(model->tableData(), model->hasRowOrder() ? model->rowOrder() : QVector<int>(), ranges, options());
+            QApplication::restoreOverrideCursor();
+            matchesFor = signature;
+        }
+        if (matches.isEmpty())
+        {
+            statusLabel->setText("Текст не найден.");
+            return false;
+        }
+        return true;
+    };
+
+    // Следующая найденная ячейка после текущей, по строкам; после последней — снова первая
+    connect(nextButton, &QPushButton::clicked, [&]()
+            {
+                if (!collect())
+                    return;
+                const QModelIndex current = table->currentIndex();
+                const quint64 after = current.isValid() ? FormulaSheet::key(current.row(), current.column()) : 0;
+                auto next = current.isValid() ? std::upper_bound(matches.constBegin(), matches.constEnd(), after) : matches.constBegin();
+                if (next == matches.constEnd())
+                    next = matches.constBegin();
+                const int position = next - matches.constBegin();
+                const QModelIndex found = model->index(FormulaSheet::keyRow(*next), FormulaSheet::keyColumn(*next));
+                table->selectionModel()->setCurrentIndex(found, QItemSelectionModel::ClearAndSelect);
+                table->scrollTo(found);
+                statusLabel->setText(tr("Совпадение %1 из %2").arg(position + 1).arg(matches.size()));
+            });
+
+    // Все найденные ячейки выделяются; подряд идущие в столбце объединяются в один диапазон
+    connect(allButton, &QPushButton::clicked, [&]()
+            {
+                if (!collect())
+                    return;
+                QVector<quint64> byColumn;
+                byColumn.reserve(matches.size());
+                for (quint64 cell : matches)
+                {
+                    byColumn.append(FormulaSheet::key(FormulaSheet::keyColumn(cell), FormulaSheet::keyRow(cell)));
+                }
+                std::sort(byColumn.begin(), byColumn.end());
+
+                QItemSelection found;
+                for (int i = 0; i < byColumn.size();)
+                {
+                    const int column = FormulaSheet::keyRow(byColumn.at(i));
+                    const int top = FormulaSheet::keyColumn(byColumn.at(i));
+                    int bottom = top;
+                    for (++i; i < byColumn.size() && byColumn.at(i) == FormulaSheet::key(column, bottom + 1); ++i)
+                    {
+                        ++bottom;
+                    }
+                    found.append(QItemSelectionRange(model->index(top, column), model->index(bottom, column)));
+                }
+                table->selectionModel()->select(found, QItemSelectionModel::ClearAndSelect);
+                const QModelIndex first = model->index(FormulaSheet::keyRow(matches.first()), FormulaSheet::keyColumn(matches.first()));
+                table->selectionModel()->setCurrentIndex(first, QItemSelectionModel::NoUpdate);
+                table->scrollTo(first);
+                statusLabel->setText(tr("Найдено ячеек: %1").arg(matches.size()));
+            });
+
+    // Замена всех совпадений одним обновлением модели
+    if (replaceButton)
+    {
+        connect(replaceButton, &QPushButton::clicked, [&]()
+                {
+                    if (!collect())
+                        return;
+                    const CellMatcher matcher(options());
+                    QStringList texts;
+                    texts.reserve(matches.size());
+                    for (quint64 cell : matches)
+                    {
+                        texts.append(matcher.replaced(model->text(FormulaSheet::keyRow(cell), FormulaSheet::keyColumn(cell)), replaceLineEdit->text()));
+                    }
+                    const int replaced = model->replaceTexts(matches, texts);
+                    if (replaced > 0)
+                        table->setProperty("modified", true);
+                    matchesFor.clear();
+                    statusLabel->setText(tr("Заменено ячеек: %1").arg(replaced));
+                });
+    }
+    connect(closeButton, &QPushButton::clicked, &dialog, &QDialog::accept);
+
+    dialog.exec();
+}
+
 void MainWindow::on_Clear_triggered()
 {
     pageIndex = ui->tabWidget->currentIndex();
@@ -865,6 +1226,12 @@ void MainWindow::on_Clear_triggered()
 
 void MainWindow::on_Undo_triggered()
 {
+    if (LargeFileView *viewer = qobject_cast<LargeFileView *>(ui->tabWidget->currentWidget()))
+    {
+        viewer->undo();
+        return;
+    }
+
     QWidget *widget = ui->tabWidget->widget(pageIndex);
     editor = qobject_cast<QTextEdit *>(widget);
     if (editor)
@@ -898,6 +1265,52 @@ void MainWindow::on_Copy_triggered()
                 textEdit->copy();
             }
         }
+
+        // Из таблицы копируется прямоугольник выделения в виде TSV. Текст собирается в пуле потоков
+        // над снимком таблицы и попадает в буфер обмена, когда готов
+        QTableView *table = qobject_cast<QTableView *>(currentWidget);
+        TableModel *model = tableModelOf(table);
+        if (model && table->selectionModel()->hasSelection())
+        {
+            CellRange range;
+            range.top = model->rowCount();
+            range.left = model->columnCount();
+            qint64 selectedCells = 0;
+            const QItemSelection selection = table->selectionModel()->selection();
+            for (const QItemSelectionRange &selected : selection)
+            {
+                range.top = qMin(range.top, selected.top());
+                range.left = qMin(range.left, selected.left());
+                range.bottom = qMax(range.bottom, selected.bottom());
+                range.right = qMax(range.right, selected.right());
+                selectedCells += static_cast<qint64>(selected.height()) * selected.width();
+            }
+
+            // Несколько несмежных диапазонов в TSV не передать, а копировать всё между ними незачем
+            if (selection.size() > 1 && selectedCells < static_cast<qint64>(range.bottom - range.top + 1) * (range.right - range.left + 1))
+            {
+                QMessageBox::information(this, tr("Копирование"), tr("Скопировать можно только один прямоугольный диапазон"));
+                return;
+            }
+
+            QFutureWatcher<QByteArray> *formatting = new QFutureWatcher<QByteArray>(table);
+            connect(formatting, &QFutureWatcher<QByteArray>::finished, table, [this, formatting]()
+                    {
+                        formatting->deleteLater();
+                        const QByteArray tsv = formatting->result();
+                        if (tsv.isEmpty())
+                        {
+                            QMessageBox::information(this, tr("Копирование"), tr("Диапазон слишком велик для буфера обмена"));
+                            return;
+                        }
+                        QApplication::clipboard()->setText(QString::fromUtf8(tsv));
+                        statusBar()->showMessage(tr("Диапазон скопирован"), 3000);
+                    });
+            const TableData snapshot = model->tableData();
+            const QVector<int> order = model->hasRowOrder() ? model->rowOrder() : QVector<int>();
+            formatting->setFuture(QtConcurrent::run([snapshot, order, range]()
+                                                    { return TableClipboard::format(snapshot, order, range); }));
+        }
     }
 }
 
@@ -909,6 +1322,37 @@ void MainWindow::on_Paste_triggered()
         {
             textEdit->paste();
         }
+
+        // В таблицу вставляется диапазон TSV/CSV начиная с текущей ячейки. Разбор идёт в пуле потоков;
+        // если за это время строки вставляли, удаляли или сортировали, вставка отменяется
+        QTableView *table = qobject_cast<QTableView *>(currentWidget);
+        TableModel *model = tableModelOf(table);
+        const QString text = QApplication::clipboard()->text();
+        if (model && !text.isEmpty())
+        {
+            const QModelIndex current = table->currentIndex();
+            const int row = current.isValid() ? current.row() : 0;
+            const int column = current.isValid() ? current.column() : 0;
+            const int revision = model->structureRevision();
+            // Вставка идёт по строкам представления: после сортировки или фильтра те же номера
+            // указывают на другие строки данных
+            const bool ordered = model->hasRowOrder();
+            const QVector<int> order = model->rowOrder();
+            QFutureWatcher<ClipboardTable> *parsing = new QFutureWatcher<ClipboardTable>(table);
+            connect(parsing, &QFutureWatcher<ClipboardTable>::finished, table, [this, table, model, parsing, row, column, revision, ordered, order]()
+                    {
+                        parsing->deleteLater();
+                        if (model->structureRevision() != revision || model->hasRowOrder() != ordered || model->rowOrder() != order)
+                        {
+                            QMessageBox::information(this, tr("Вставка"), tr("Таблица изменилась во время разбора, вставка отменена"));
+                            return;
+                        }
+                        const ClipboardTable pasted = parsing->result();
+                        model->pasteBlock(row, column, pasted.columns, pasted.rowCount);
+                        table->setProperty("modified", true);
+                    });
+            parsing->setFuture(QtConcurrent::run(&TableClipboard::parse, text));
+        }
     }
 }
 
@@ -932,7 +1376,11 @@ void MainWindow::on_Redo_triggered()
     {
         if (auto textEdit = qobject_cast<QTextEdit *>(currentWidget))
         {
-            textEdit->document()->redo();
+            textEdit->document()->redo();
+        }
+        else if (auto viewer = qobject_cast<LargeFileView *>(currentWidget))
+        {
+            viewer->redo();
         }
     }
 }
@@ -947,7 +1395,8 @@ void MainWindow::closeEvent(QCloseEvent *event)
     {
         QWidget *currentWidget = ui->tabWidget->widget(i);
         editor = qobject_cast<QTextEdit *>(currentWidget);
-        tableWidget = qobject_cast<QTableWidget *>(currentWidget);
+        tableView = qobject_cast<QTableView *>(currentWidget);
+        LargeFileView *viewer = qobject_cast<LargeFileView *>(currentWidget);
 
         if (editor && editor->document()->isModified())
         {
@@ -993,7 +1442,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
                 delete currentWidget;
             }
         }
-        else if (tableWidget && tableWidget->property("modified").toBool())
+        else if ((tableView && tableView->property("modified").toBool()) || (viewer && viewer->isModified()))
         {
             QString fileName = ui->tabWidget->tabToolTip(i);
 
@@ -1031,8 +1480,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
             else if (reply == QMessageBox::No)
             {
                 // Пользователь решил не сохранять изменения // Отменяем изменения
-                ui->tabWidget->removeTab(i);
-                tableWidget->deleteLater(); // Закрываем вкладку без сохранения
+                ui->tabWidget->removeTab(i); // Закрываем вкладку без сохранения
                 delete currentWidget;
             }
         }
@@ -1053,9 +1501,10 @@ void MainWindow::on_Palette_triggered()
 {
     // Получаем текущий редактор или таблицу
     editor = qobject_cast<QTextEdit *>(ui->tabWidget->currentWidget());
-    QTableWidget *table = qobject_cast<QTableWidget *>(ui->tabWidget->currentWidget());
+    QTableView *table = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *model = tableModelOf(table);
 
-    if (!editor && !table)
+    if (!editor && !model)
         return; // Если нет активного редактора или таблицы, выходим
 
     if (editor)
@@ -1114,36 +1563,27 @@ void MainWindow::on_Palette_triggered()
             qDebug() << "editor->backgroundRole() " << editor->backgroundRole();
         }
     }
-    else if (table)
+    else if (model)
     {
         // Получаем текущую выбранную ячейку
-        QTableWidgetItem *currentItem = table->currentItem();
-
-        // Если нет активной ячейки, устанавливаем активной первую попавшуюся
-        if (!currentItem)
-        {
-            int row = table->currentRow();
-            int col = table->currentColumn();
-            if (row >= 0 && col >= 0)
-            {
-                table->setCurrentCell(row, col); // Устанавливаем ячейку как текущую
-                currentItem = table->currentItem();
-            }
-        }
-
-        if (!currentItem)
+        QModelIndex current = table->currentIndex();
+        if (!current.isValid())
             return; // Если нет активной ячейки, выходим
 
+        CellStyle style = model->cellStyle(current.row(), current.column());
+        QColor currentForegroundColor = style.foreground.isValid() ? style.foreground : table->palette().color(QPalette::Text);
+        QColor currentBackgroundColor = style.background.isValid() ? style.background : QColor(Qt::white);
+
         // Открываем диалог выбора цвета текста
-        QColor newTextColor = QColorDialog::getColor(currentItem->foreground().color(), this, tr("Выберите цвет текста"));
+        QColor newTextColor = QColorDialog::getColor(currentForegroundColor, this, tr("Выберите цвет текста"));
 
         // Открываем диалог выбора цвета фона
-        QColor newBackgroundColor = QColorDialog::getColor(currentItem->background().color(), this, tr("Выберите цвет фона"));
+        QColor newBackgroundColor = QColorDialog::getColor(currentBackgroundColor, this, tr("Выберите цвет фона"));
 
         // Если текстовый цвет не выбран, оставляем текущий или устанавливаем чёрный по умолчанию
         if (!newTextColor.isValid())
         {
-            newTextColor = currentItem->foreground().color().isValid() ? currentItem->foreground().color() : QColor(Qt::black);
+            newTextColor = currentForegroundColor.isValid() ? currentForegroundColor : QColor(Qt::black);
         }
 
         // Если цвет фона не выбран или прозрачный, устанавливаем белый по умолчанию
@@ -1159,8 +1599,10 @@ void MainWindow::on_Palette_triggered()
         }
 
         // Устанавливаем цвета для ячейки
-        currentItem->setForeground(newTextColor);
-        currentItem->setBackground(newBackgroundColor);
+        style.foreground = newTextColor;
+        style.background = newBackgroundColor;
+        model->setCellStyle(current.row(), current.column(), style);
+        table->setProperty("modified", true);
     }
 }
 
@@ -1168,9 +1610,10 @@ void MainWindow::on_FontAndSize_triggered()
 {
     // Проверяем текущий редактор
     editor = qobject_cast<QTextEdit *>(ui->tabWidget->currentWidget());
-    QTableWidget *table = qobject_cast<QTableWidget *>(ui->tabWidget->currentWidget());
+    QTableView *table = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *model = tableModelOf(table);
 
-    if (!editor && !table)
+    if (!editor && !model)
         return; // Если нет активного редактора или таблицы, прерываем выполнение
 
     bool ok;
@@ -1203,16 +1646,20 @@ void MainWindow::on_FontAndSize_triggered()
             // Обозначаем документ как измененный
             editor->document()->setModified(true);
         }
-        else if (table)
+        else if (model)
         {
             // Применяем шрифт к выделенной ячейке таблицы
-            QList<QTableWidgetItem *> selectedItems = table->selectedItems();
-            if (!selectedItems.isEmpty())
+            QModelIndexList selectedIndexes = table->selectionModel()->selectedIndexes();
+            if (!selectedIndexes.isEmpty())
             {
-                foreach (QTableWidgetItem *item, selectedItems)
+                foreach (const QModelIndex &index, selectedIndexes)
                 {
-                    item->setFont(font); // Устанавливаем шрифт для каждой выбранной ячейки
+                    CellStyle style = model->cellStyle(index.row(), index.column());
+                    style.font = font; // Устанавливаем шрифт для каждой выбранной ячейки
+                    style.hasFont = true;
+                    model->setCellStyle(index.row(), index.column(), style);
                 }
+                table->setProperty("modified", true);
 
                 qDebug() << "Applied Font to Selected Table Items.";
             }
@@ -1240,38 +1687,71 @@ void MainWindow::saveTextSettings(const QString &filePath)
         return;
     }
 
+    QString formatFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".format");
     QString jsonFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".html");
 
-    // Извлекаем HTML код документа
-    QString documentHtml = editor->toHtml();
+    // Документ с таблицами сериями не описать: для него остаётся HTML в JSON
+    if (!TextFormatSidecar::canStore(editor->document()))
+    {
+        QFile::remove(formatFilePath);
 
-    // Сохраняем HTML код в JSON объект
-    QJsonObject settingsObject;
-    settingsObject["html"] = documentHtml;
+        QJsonObject settingsObject;
+        settingsObject["html"] = editor->toHtml();
 
-    QJsonDocument settingsDoc(settingsObject);
-    QFile jsonFile(jsonFilePath);
-    if (jsonFile.open(QIODevice::WriteOnly))
+        QJsonDocument settingsDoc(settingsObject);
+        QFile jsonFile(jsonFilePath);
+        if (jsonFile.open(QIODevice::WriteOnly))
+        {
+            jsonFile.write(settingsDoc.toJson());
+            jsonFile.close();
+            qDebug() << "Settings saved to: " << jsonFilePath;
+        }
+        else
+        {
+            qDebug() << "Unable to open file for writing: " << jsonFilePath;
+        }
+        return;
+    }
+
+    // Сохраняются только оформленные участки текста; без них файл оформления не нужен
+    QFile::remove(jsonFilePath);
+    const TextFormatSidecar sidecar = TextFormatSidecar::fromDocument(editor->document());
+    if (sidecar.runs.isEmpty())
+    {
+        QFile::remove(formatFilePath);
+        return;
+    }
+
+    QFile formatFile(formatFilePath);
+    if (formatFile.open(QIODevice::WriteOnly) && sidecar.write(&formatFile))
     {
-        jsonFile.write(settingsDoc.toJson());
-        jsonFile.close();
-        qDebug() << "Settings saved to: " << jsonFilePath;
+        formatFile.close();
+        qDebug() << "Settings saved to: " << formatFilePath;
     }
     else
     {
-        qDebug() << "Unable to open file for writing: " << jsonFilePath;
+        qDebug() << "Unable to open file for writing: " << formatFilePath;
     }
 }
 
-void MainWindow::loadTextSettings(const QString &filePath)
+void MainWindow::loadTextSettings(QTextEdit *editor, const QString &filePath)
 {
-    QTextEdit *editor = qobject_cast<QTextEdit *>(ui->tabWidget->currentWidget());
-    if (!editor)
-        return;
-
     QFileInfo fileInfo(filePath);
     QString relativePath = "../Visual_Lab5/Lab_5/textSettings";
     QDir settingsDir(relativePath);
+
+    // Серии накладываются на уже загруженный текст, если он не менялся с сохранения оформления
+    QFile formatFile(settingsDir.absoluteFilePath(fileInfo.fileName() + ".format"));
+    if (formatFile.open(QIODevice::ReadOnly))
+    {
+        TextFormatSidecar sidecar;
+        if (!sidecar.read(&formatFile) || !sidecar.apply(editor->document()))
+            qDebug() << "Text format does not match: " << formatFile.fileName();
+        formatFile.close();
+        return;
+    }
+
+    // Старый формат: весь документ в HTML
     QString jsonFilePath = settingsDir.absoluteFilePath(fileInfo.fileName() + ".html");
 
     QFile jsonFile(jsonFilePath);
@@ -1306,12 +1786,12 @@ void MainWindow::on_Table_triggered()
     // Надписи и элементы для выбора строк и столбцов
     QLabel *rowsLabel = new QLabel(tr("Строки:"), &dialog);
     QSpinBox *rowsSpinBox = new QSpinBox(&dialog);
-    rowsSpinBox->setRange(1, 100);
+    rowsSpinBox->setRange(1, 1000000);
     rowsSpinBox->setValue(3);
 
     QLabel *columnsLabel = new QLabel(tr("Столбцы:"), &dialog);
     QSpinBox *columnsSpinBox = new QSpinBox(&dialog);
-    columnsSpinBox->setRange(1, 100);
+    columnsSpinBox->setRange(1, 10000);
     columnsSpinBox->setValue(3);
 
     // Радио-кнопки для выбора типа вставки
@@ -1347,6 +1827,12 @@ void MainWindow::on_Table_triggered()
 
         if (textEditorOption->isChecked())
         {
+            if (static_cast<qint64>(rows) * columns > MaxEditorTableCells)
+            {
+                QMessageBox::warning(this, tr("Ошибка"), tr("Слишком большая таблица для текстового редактора, создайте её как виджет"));
+                return;
+            }
+
             // Вставляем таблицу как HTML в QTextEdit
             editor = qobject_cast<QTextEdit *>(ui->tabWidget->currentWidget());
             if (editor)
@@ -1369,28 +1855,15 @@ void MainWindow::on_Table_triggered()
         }
         else if (widgetOption->isChecked())
         {
-            // Создаем таблицу в виде QTableWidget
-            tableWidget = new QTableWidget(rows, columns);
-            tableWidget->setWindowTitle("Таблица");
-            tableWidget->setEditTriggers(QAbstractItemView::DoubleClicked);
-            tableWidget->setProperty("modified", true);
-            for (int i = 0; i < rows; ++i)
-            {
-                for (int j = 0; j < columns; ++j)
-                {
-                    QTableWidgetItem *item = tableWidget->item(i, j);
-                    if (!item)
-                    {
-                        item = new QTableWidgetItem();
-                        tableWidget->setItem(i, j, item);
-                    }
-                    // Установка белого фона, если фон не был изменен
-                    item->setTextAlignment(Qt::AlignLeft | Qt::AlignVCenter);
-                    item->setBackground(QColor(Qt::white));
-                }
-            }
+            // Создаем таблицу: ячейки без оформления ничего не хранят, фон по умолчанию и так белый.
+            // Большая сетка хранит только заполненные блоки ячеек
+            TableData::Storage storage = static_cast<qint64>(rows) * columns > SparseTableCells ? TableData::Sparse : TableData::Dense;
+            tableView = createTableView(new TableModel(rows, columns, storage));
+            tableView->setWindowTitle("Таблица");
+            tableView->setEditTriggers(QAbstractItemView::DoubleClicked);
+            tableView->setProperty("modified", true);
             // Добавляем новую вкладку с таблицей в QTabWidget
-            int index = ui->tabWidget->addTab(tableWidget, tr("Таблица %1").arg(ui->tabWidget->count() + 1));
+            int index = ui->tabWidget->addTab(tableView, tr("Таблица %1").arg(ui->tabWidget->count() + 1));
             ui->tabWidget->setCurrentIndex(index);
         }
     }
@@ -1401,7 +1874,7 @@ void MainWindow::onTableCellChanged(int row, int column)
     Q_UNUSED(row);    // Если не используете эти параметры
     Q_UNUSED(column); // Если не используете эти параметры
 
-    QTableWidget *currentTable = qobject_cast<QTableWidget *>(ui->tabWidget->currentWidget());
+    QTableView *currentTable = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
     if (currentTable)
     {
         currentTable->setProperty("modified", true); // Устанавливаем свойство modified в true
@@ -1411,11 +1884,11 @@ void MainWindow::onTableCellChanged(int row, int column)
 void MainWindow::on_AddRow_triggered()
 {
     QWidget *currentWidget = ui->tabWidget->currentWidget();
-    if (QTableWidget *tableWidget = qobject_cast<QTableWidget *>(currentWidget))
+    if (TableModel *model = tableModelOf(qobject_cast<QTableView *>(currentWidget)))
     {
-        // Добавляем строку в QTableWidget
-        tableWidget->insertRow(tableWidget->rowCount());
-        tableWidget->setProperty("modified", true);
+        // Добавляем строку в таблицу
+        model->insertRow(model->rowCount());
+        currentWidget->setProperty("modified", true);
     }
     else if (QTextEdit *editor = qobject_cast<QTextEdit *>(currentWidget))
     {
@@ -1436,11 +1909,11 @@ void MainWindow::on_AddRow_triggered()
 void MainWindow::on_AddColumn_triggered()
 {
     QWidget *currentWidget = ui->tabWidget->currentWidget();
-    if (QTableWidget *tableWidget = qobject_cast<QTableWidget *>(currentWidget))
+    if (TableModel *model = tableModelOf(qobject_cast<QTableView *>(currentWidget)))
     {
-        // Добавляем столбец в QTableWidget
-        tableWidget->insertColumn(tableWidget->columnCount());
-        tableWidget->setProperty("modified", true);
+        // Добавляем столбец в таблицу
+        model->insertColumn(model->columnCount());
+        currentWidget->setProperty("modified", true);
     }
     else if (QTextEdit *editor = qobject_cast<QTextEdit *>(currentWidget))
     {
@@ -1461,22 +1934,23 @@ void MainWindow::on_AddColumn_triggered()
 void MainWindow::on_DeleteRow_triggered()
 {
     QWidget *currentWidget = ui->tabWidget->currentWidget();
-    if (QTableWidget *tableWidget = qobject_cast<QTableWidget *>(currentWidget))
+    if (QTableView *tableView = qobject_cast<QTableView *>(currentWidget))
     {
-        // Удаляем текущую строку в QTableWidget
-        if (tableWidget->rowCount() > 1)
+        // Удаляем текущую строку в таблице
+        TableModel *model = tableModelOf(tableView);
+        if (model->rowCount() > 1)
         {
-            int currentRow = tableWidget->currentRow();
+            int currentRow = tableView->currentIndex().row();
             if (currentRow != -1)
             {
-                tableWidget->removeRow(currentRow);
+                model->removeRow(currentRow);
             }
             else
             {
                 QMessageBox::warning(this, "Ошибка", "Выберите строку для удаления.");
             }
         }
-        tableWidget->setProperty("modified", true);
+        tableView->setProperty("modified", true);
     }
     else if (QTextEdit *editor = qobject_cast<QTextEdit *>(currentWidget))
     {
@@ -1500,22 +1974,23 @@ void MainWindow::on_DeleteRow_triggered()
 void MainWindow::on_DeleteColumn_triggered()
 {
     QWidget *currentWidget = ui->tabWidget->currentWidget();
-    if (QTableWidget *tableWidget = qobject_cast<QTableWidget *>(currentWidget))
+    if (QTableView *tableView = qobject_cast<QTableView *>(currentWidget))
     {
-        // Удаляем текущий столбец в QTableWidget
-        if (tableWidget->columnCount() > 1)
+        // Удаляем текущий столбец в таблице
+        TableModel *model = tableModelOf(tableView);
+        if (model->columnCount() > 1)
         {
-            int currentColumn = tableWidget->currentColumn();
+            int currentColumn = tableView->currentIndex().column();
             if (currentColumn != -1)
             {
-                tableWidget->removeColumn(currentColumn);
+                model->removeColumn(currentColumn);
             }
             else
             {
                 QMessageBox::warning(this, "Ошибка", "Выберите столбец для удаления.");
             }
         }
-        tableWidget->setProperty("modified", true);
+        tableView->setProperty("modified", true);
     }
     else if (QTextEdit *editor = qobject_cast<QTextEdit *>(currentWidget))
     {
@@ -1538,15 +2013,16 @@ void MainWindow::on_DeleteColumn_triggered()
 
 void MainWindow::on_Paddins_triggered()
 {
-    QTableWidget *tableWidget = qobject_cast<QTableWidget *>(ui->tabWidget->currentWidget());
-    if (!tableWidget)
+    QTableView *tableView = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *model = tableModelOf(tableView);
+    if (!model)
     {
         QMessageBox::warning(this, "Ошибка", "Текущая вкладка не является таблицей.");
         return;
     }
 
-    int currentRow = tableWidget->currentRow();
-    int currentColumn = tableWidget->currentColumn();
+    int currentRow = tableView->currentIndex().row();
+    int currentColumn = tableView->currentIndex().column();
     if (currentRow == -1 || currentColumn == -1)
     {
         QMessageBox::warning(this, "Ошибка", "Выберите ячейку для изменения выравнивания.");
@@ -1600,18 +2076,382 @@ void MainWindow::on_Paddins_triggered()
         }
 
         // Устанавливаем выравнивание для выбранной ячейки
-        QTableWidgetItem *item = tableWidget->item(currentRow, currentColumn);
-        if (item)
-        {
-            item->setTextAlignment(static_cast<int>(alignment));
+        CellStyle style = model->cellStyle(currentRow, currentColumn);
+        style.alignment = static_cast<int>(alignment);
+        model->setCellStyle(currentRow, currentColumn, style);
+        tableView->setProperty("modified", true);
+    }
+}
+
+void MainWindow::on_FollowFile_triggered()
+{
+    QTableView *tableView = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *model = tableModelOf(tableView);
+    if (!model)
+    {
+        QMessageBox::warning(this, "Ошибка", "Текущая вкладка не является таблицей.");
+        return;
+    }
+
+    // Повторный выбор пункта выключает слежение
+    if (CsvFollower *follower = tableView->findChild<CsvFollower *>())
+    {
+        delete follower;
+        statusBar()->showMessage(tr("Слежение за файлом выключено"), 3000);
+        return;
+    }
+
+    const CsvLayout &layout = model->fileLayout();
+    if (tableView->findChild<CsvLoader *>() || !layout.isValid())
+    {
+        QMessageBox::warning(this, "Ошибка", "Таблица ещё не загружена из файла или не совпадает с ним. Сохраните таблицу или откройте файл заново.");
+        return;
+    }
+
+    // Новые строки дописываются блоками; если таблица была прокручена до конца, она остаётся в конце
+    CsvFollower *follower = new CsvFollower(layout.filePath, layout.rowOffsets.last(), model->columnCount(), layout.dialect, tableView);
+    connect(follower, &CsvFollower::blockReady, tableView, [tableView, model](const CsvBlock &block, qint64 end)
+            {
+                QScrollBar *scrollBar = tableView->verticalScrollBar();
+                const bool atBottom = scrollBar->value() == scrollBar->maximum();
+                model->appendFileTail(block.columns, block.rowCount, block.rowOffsets, end);
+                if (atBottom)
+                    tableView->scrollToBottom();
+            });
+    connect(follower, &CsvFollower::stopped, tableView, [this, follower](const QString &reason)
+            {
+                follower->deleteLater();
+                QMessageBox::warning(this, "Слежение за файлом", reason);
+            });
+    statusBar()->showMessage(tr("Слежение за файлом %1 включено").arg(QFileInfo(layout.filePath).fileName()), 3000);
+}
+
+void MainWindow::on_SortFilter_triggered()
+{
+    QTableView *tableView = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *model = tableModelOf(tableView);
+    if (!model)
+    {
+        QMessageBox::warning(this, "Ошибка", "Текущая вкладка не является таблицей.");
+        return;
+    }
+
+    TableQuery *query = tableView->findChild<TableQuery *>();
+    if (query && query->isRunning())
+    {
+        QMessageBox::information(this, "Сортировка и фильтр", "Предыдущий запрос к таблице ещё выполняется.");
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Сортировка и фильтр");
+
+    QStringList columnNames;
+    columnNames << "(нет)";
+    for (int j = 0; j < model->columnCount(); ++j)
+    {
+        columnNames << model->columnLabel(j);
+    }
+
+    // Ключи сортировки: столбец и направление, пустые ключи пропускаются
+    QGridLayout *layout = new QGridLayout;
+    layout->addWidget(new QLabel("Сортировать по:", &dialog), 0, 0, 1, 4);
+    QVector<QComboBox *> sortColumns;
+    QVector<QComboBox *> sortOrders;
+    for (int k = 0; k < SortKeyCount; ++k)
+    {
+        QComboBox *column = new QComboBox(&dialog);
+        column->addItems(columnNames);
+        QComboBox *order = new QComboBox(&dialog);
+        order->addItems(QStringList() << "По возрастанию" << "По убыванию");
+        layout->addWidget(column, k + 1, 0, 1, 2);
+        layout->addWidget(order, k + 1, 2, 1, 2);
+        sortColumns.append(column);
+        sortOrders.append(order);
+    }
+
+    // Условия отбора: строка остаётся, если выполнены все заданные условия
+    const int filterTop = SortKeyCount + 1;
+    layout->addWidget(new QLabel("Отбирать строки:", &dialog), filterTop, 0, 1, 4);
+    QVector<QComboBox *> filterColumns;
+    QVector<QComboBox *> filterKinds;
+    QVector<QLineEdit *> filterValues;
+    QVector<QLineEdit *> filterUppers;
+    for (int k = 0; k < FilterCount; ++k)
+    {
+        QComboBox *column = new QComboBox(&dialog);
+        column->addItems(columnNames);
+        QComboBox *kind = new QComboBox(&dialog);
+        kind->addItems(QStringList() << "Равно" << "Содержит" << "Диапазон" << "Регулярное выражение");
+        QLineEdit *value = new QLineEdit(&dialog);
+        QLineEdit *upper = new QLineEdit(&dialog);
+        upper->setPlaceholderText("до");
+        upper->setEnabled(false);
+        connect(kind, QOverload<int>::of(&QComboBox::currentIndexChanged), upper, [upper](int index)
+                { upper->setEnabled(index == RowFilter::Range); });
+        layout->addWidget(column, filterTop + k + 1, 0);
+        layout->addWidget(kind, filterTop + k + 1, 1);
+        layout->addWidget(value, filterTop + k + 1, 2);
+        layout->addWidget(upper, filterTop + k + 1, 3);
+        filterColumns.append(column);
+        filterKinds.append(kind);
+        filterValues.append(value);
+        filterUppers.append(upper);
+    }
+
+    QPushButton *okButton = new QPushButton("Применить", &dialog);
+    QPushButton *resetButton = new QPushButton("Сбросить", &dialog);
+    QPushButton *cancelButton = new QPushButton("Отмена", &dialog);
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(okButton);
+    buttonLayout->addWidget(resetButton);
+    buttonLayout->addWidget(cancelButton);
+    layout->addLayout(buttonLayout, filterTop + FilterCount + 1, 0, 1, 4);
+    dialog.setLayout(layout);
+
+    connect(okButton, &QPushButton::clicked, &dialog, &QDialog::accept);
+    connect(resetButton, &QPushButton::clicked, &dialog, [&dialog]()
+            { dialog.done(ResetOrderResult); });
+    connect(cancelButton, &QPushButton::clicked, &dialog, &QDialog::reject);
+
+    const int result = dialog.exec();
+    if (result == ResetOrderResult)
+    {
+        model->clearRowOrder();
+        return;
+    }
+    if (result != QDialog::Accepted)
+        return;
+
+    QVector<SortKey> keys;
+    for (int k = 0; k < SortKeyCount; ++k)
+    {
+        if (sortColumns.at(k)->currentIndex() == 0)
+            continue;
+        SortKey key;
+        key.column = sortColumns.at(k)->currentIndex() - 1;
+        key.order = sortOrders.at(k)->currentIndex() == 0 ? Qt::AscendingOrder : Qt::DescendingOrder;
+        keys.append(key);
+    }
+
+    QVector<RowFilter> filters;
+    for (int k = 0; k < FilterCount; ++k)
+    {
+        if (filterColumns.at(k)->currentIndex() == 0)
+            continue;
+        RowFilter filter;
+        filter.column = filterColumns.at(k)->currentIndex() - 1;
+        filter.kind = static_cast<RowFilter::Kind>(filterKinds.at(k)->currentIndex());
+        filter.value = filterValues.at(k)->text();
+        filter.upper = filterUppers.at(k)->text();
+        if (filter.kind == RowFilter::RegExp && !QRegularExpression(filter.value).isValid())
+        {
+            QMessageBox::warning(this, "Ошибка", tr("Неверное регулярное выражение: %1").arg(filter.value));
+            return;
         }
-        else
+        filters.append(filter);
+    }
+
+    if (keys.isEmpty() && filters.isEmpty())
+    {
+        model->clearRowOrder();
+        return;
+    }
+
+    // Запрос идёт в пуле потоков над снимком; если за это время строки вставляли или удаляли,
+    // номера в результате уже не соответствуют таблице и он отбрасывается
+    if (!query)
+    {
+        query = new TableQuery(tableView);
+        connect(query, &TableQuery::finished, tableView, [model, query](const QVector<int> &rows)
+                {
+                    if (query->property("revision").toInt() == model->structureRevision())
+                        model->setRowOrder(rows);
+                });
+    }
+    query->setProperty("revision", model->structureRevision());
+    query->run(model->tableData(), filters, keys);
+}
+
+void MainWindow::on_QueryConsole_triggered()
+{
+    if (queryDock)
+    {
+        queryDock->show();
+        queryDock->raise();
+        return;
+    }
+
+    // Панель запросов создаётся один раз и остаётся внизу окна
+    queryDock = new QDockWidget("Запрос к таблицам", this);
+    QWidget *panel = new QWidget(queryDock);
+    QPlainTextEdit *queryEdit = new QPlainTextEdit(panel);
+    queryEdit->setPlaceholderText("SELECT A, SUM(C) FROM \"data.csv\" WHERE B >= 10 GROUP BY A ORDER BY 2 DESC LIMIT 20");
+    QPushButton *runButton = new QPushButton("Выполнить", panel);
+    QLabel *statusLabel = new QLabel(panel);
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(runButton);
+    buttonLayout->addWidget(statusLabel, 1);
+    QVBoxLayout *layout = new QVBoxLayout(panel);
+    layout->addWidget(queryEdit);
+    layout->addLayout(buttonLayout);
+    queryDock->setWidget(panel);
+    addDockWidget(Qt::BottomDockWidgetArea, queryDock);
+
+    QueryEngine *engine = new QueryEngine(queryDock);
+
+    connect(runButton, &QPushButton::clicked, this, [this, engine, queryEdit, statusLabel]()
+            {
+                if (engine->isRunning())
+                {
+                    statusLabel->setText("Предыдущий запрос ещё выполняется");
+                    return;
+                }
+
+                // Запрос выполняется над снимками всех открытых таблиц, правка вкладок ему не мешает.
+                // У вкладок с одинаковыми ярлыками есть и имя с номером вкладки: «data.csv (3)»
+                QHash<QString, int> names;
+                for (int i = 0; i < ui->tabWidget->count(); ++i)
+                {
+                    if (tableModelOf(qobject_cast<QTableView *>(ui->tabWidget->widget(i))))
+                        ++names[ui->tabWidget->tabText(i)];
+                }
+                QHash<QString, TableData> relations;
+                for (int i = 0; i < ui->tabWidget->count(); ++i)
+                {
+                    TableModel *model = tableModelOf(qobject_cast<QTableView *>(ui->tabWidget->widget(i)));
+                    if (!model)
+                        continue;
+                    const QString name = ui->tabWidget->tabText(i);
+                    relations.insertMulti(name, model->tableData());
+                    if (names.value(name) > 1)
+                        relations.insert(tr("%1 (%2)").arg(name).arg(i + 1), model->tableData());
+                }
+                statusLabel->setText("Выполняется...");
+                queryTimer.start();
+                engine->run(queryEdit->toPlainText(), relations);
+            });
+
+    connect(engine, &QueryEngine::finished, this, [this, statusLabel](const QueryResult &result)
+            {
+                if (!result.errorMessage.isEmpty())
+                {
+                    statusLabel->setText(result.errorMessage);
+                    return;
+                }
+                if (result.rowCount == 0)
+                {
+                    statusLabel->setText("Запрос не вернул строк");
+                    return;
+                }
+
+                // Результат открывается новой несохранённой таблицей
+                TableModel *model = new TableModel();
+                model->appendColumns(result.columns, result.rowCount);
+                QTableView *table = createTableView(model);
+                table->setEditTriggers(QAbstractItemView::DoubleClicked);
+                table->setProperty("modified", true);
+                int index = ui->tabWidget->addTab(table, tr("Запрос %1").arg(ui->tabWidget->count() + 1));
+                ui->tabWidget->setCurrentIndex(index);
+                statusLabel->setText(tr("Строк: %1, %2 мс").arg(result.rowCount).arg(queryTimer.elapsed()));
+            });
+}
+
+void MainWindow::on_JoinTables_triggered()
+{
+    if (tableJoin && tableJoin->isRunning())
+    {
+        QMessageBox::information(this, "Соединение таблиц", "Предыдущее соединение ещё выполняется.");
+        return;
+    }
+
+    QVector<TableModel *> models;
+    QStringList names;
+    for (int i = 0; i < ui->tabWidget->count(); ++i)
+    {
+        TableModel *model = tableModelOf(qobject_cast<QTableView *>(ui->tabWidget->widget(i)));
+        if (model)
         {
-            item = new QTableWidgetItem();
-            item->setTextAlignment(static_cast<int>(alignment));
-            tableWidget->setItem(currentRow, currentColumn, item);
+            models.append(model);
+            names.append(ui->tabWidget->tabText(i));
         }
     }
+    if (models.size() < 2)
+    {
+        QMessageBox::warning(this, "Ошибка", "Для соединения нужны две открытые таблицы.");
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Соединение таблиц");
+
+    // Таблица и ключевой столбец с каждой стороны; список столбцов следует за выбранной таблицей
+    QGridLayout *layout = new QGridLayout;
+    QVector<QComboBox *> tables;
+    QVector<QComboBox *> columns;
+    const QStringList sides = QStringList() << "Левая таблица:" << "Правая таблица:";
+    for (int side = 0; side < sides.size(); ++side)
+    {
+        QComboBox *table = new QComboBox(&dialog);
+        table->addItems(names);
+        QComboBox *column = new QComboBox(&dialog);
+        connect(table, QOverload<int>::of(&QComboBox::currentIndexChanged), column, [column, models](int index)
+                {
+                    column->clear();
+                    for (int j = 0; index >= 0 && j < models.at(index)->columnCount(); ++j)
+                    {
+                        column->addItem(models.at(index)->columnLabel(j));
+                    }
+                });
+        table->setCurrentIndex(-1);
+        table->setCurrentIndex(side);
+        layout->addWidget(new QLabel(sides.at(side), &dialog), side, 0);
+        layout->addWidget(table, side, 1);
+        layout->addWidget(column, side, 2);
+        tables.append(table);
+        columns.append(column);
+    }
+
+    QComboBox *kind = new QComboBox(&dialog);
+    kind->addItems(QStringList() << "Внутреннее" << "Левое" << "Анти (строки левой без пары)");
+    layout->addWidget(new QLabel("Вид соединения:", &dialog), 2, 0);
+    layout->addWidget(kind, 2, 1, 1, 2);
+
+    QPushButton *okButton = new QPushButton("Соединить", &dialog);
+    QPushButton *cancelButton = new QPushButton("Отмена", &dialog);
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(okButton);
+    buttonLayout->addWidget(cancelButton);
+    layout->addLayout(buttonLayout, 3, 0, 1, 3);
+    dialog.setLayout(layout);
+
+    connect(okButton, &QPushButton::clicked, &dialog, &QDialog::accept);
+    connect(cancelButton, &QPushButton::clicked, &dialog, &QDialog::reject);
+
+    if (dialog.exec() != QDialog::Accepted || columns.at(0)->currentIndex() < 0 || columns.at(1)->currentIndex() < 0)
+        return;
+
+    // Соединение идёт в пуле потоков над снимками таблиц; результат — новая вкладка
+    if (!tableJoin)
+    {
+        tableJoin = new TableJoin(this);
+        connect(tableJoin, &TableJoin::finished, this, [this](const JoinedTable &joined)
+                {
+                    TableModel *model = new TableModel();
+                    model->appendColumns(joined.columns, joined.rowCount);
+                    QTableView *table = createTableView(model);
+                    table->setEditTriggers(QAbstractItemView::DoubleClicked);
+                    table->setProperty("modified", true);
+                    int index = ui->tabWidget->addTab(table, tableJoin->property("title").toString());
+                    ui->tabWidget->setCurrentIndex(index);
+                });
+    }
+    const int left = tables.at(0)->currentIndex();
+    const int right = tables.at(1)->currentIndex();
+    tableJoin->setProperty("title", tr("%1 + %2").arg(names.at(left), names.at(right)));
+    tableJoin->run(models.at(left)->tableData(), columns.at(0)->currentIndex(),
+                   models.at(right)->tableData(), columns.at(1)->currentIndex(),
+                   static_cast<TableJoin::Kind>(kind->currentIndex()));
 }
 
 void MainWindow::on_GoToGraphic_clicked(){
@@ -1629,3 +2469,223 @@ void MainWindow::resetEditorWindow()
 {
     graphicEditor = nullptr;
 }
+
+void MainWindow::on_GroupPivot_triggered()
+{
+    QTableView *sourceView = qobject_cast<QTableView *>(ui->tabWidget->currentWidget());
+    TableModel *source = tableModelOf(sourceView);
+    if (!source)
+    {
+        QMessageBox::warning(this, "Ошибка", "Текущая вкладка не является таблицей.");
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Группировка и сводная таблица");
+
+    QStringList columnNames;
+    columnNames << "(нет)";
+    for (int j = 0; j < source->columnCount(); ++j)
+    {
+        columnNames << source->columnLabel(j);
+    }
+
+    // Ключи группировки, необязательный столбец сводки и агрегаты; в сводной таблице — только первый агрегат
+    QGridLayout *layout = new QGridLayout;
+    layout->addWidget(new QLabel("Группировать по:", &dialog), 0, 0, 1, 2);
+    QVector<QComboBox *> groupColumns;
+    for (int k = 0; k < GroupKeyCount; ++k)
+    {
+        QComboBox *column = new QComboBox(&dialog);
+        column->addItems(columnNames);
+        layout->addWidget(column, k + 1, 0, 1, 2);
+        groupColumns.append(column);
+    }
+
+    const int pivotTop = GroupKeyCount + 1;
+    layout->addWidget(new QLabel("Значения в столбцы (сводная таблица):", &dialog), pivotTop, 0, 1, 2);
+    QComboBox *pivotColumn = new QComboBox(&dialog);
+    pivotColumn->addItems(columnNames);
+    layout->addWidget(pivotColumn, pivotTop + 1, 0, 1, 2);
+
+    const int aggregateTop = pivotTop + 2;
+    layout->addWidget(new QLabel("Вычислить:", &dialog), aggregateTop, 0, 1, 2);
+    QVector<QComboBox *> functions;
+    QVector<QComboBox *> aggregateColumns;
+    for (int k = 0; k < AggregateCount; ++k)
+    {
+        QComboBox *function = new QComboBox(&dialog);
+        function->addItems(QStringList() << "(нет)" << "Количество строк" << "Количество" << "Сумма" << "Минимум" << "Максимум" << "Среднее");
+        QComboBox *column = new QComboBox(&dialog);
+        column->addItems(columnNames.mid(1));
+        layout->addWidget(function, aggregateTop + k + 1, 0);
+        layout->addWidget(column, aggregateTop + k + 1, 1);
+        functions.append(function);
+        aggregateColumns.append(column);
+    }
+
+    QPushButton *okButton = new QPushButton("Построить", &dialog);
+    QPushButton *cancelButton = new QPushButton("Отмена", &dialog);
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(okButton);
+    buttonLayout->addWidget(cancelButton);
+    layout->addLayout(buttonLayout, aggregateTop + AggregateCount + 1, 0, 1, 2);
+    dialog.setLayout(layout);
+
+    connect(okButton, &QPushButton::clicked, &dialog, &QDialog::accept);
+    connect(cancelButton, &QPushButton::clicked, &dialog, &QDialog::reject);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    QVector<int> keys;
+    for (QComboBox *column : groupColumns)
+    {
+        if (column->currentIndex() > 0 && !keys.contains(column->currentIndex() - 1))
+            keys.append(column->currentIndex() - 1);
+    }
+    QVector<AggregateSpec> specs;
+    for (int k = 0; k < AggregateCount; ++k)
+    {
+        if (functions.at(k)->currentIndex() == 0)
+            continue;
+        AggregateSpec spec;
+        spec.function = static_cast<AggregateSpec::Function>(functions.at(k)->currentIndex() - 1);
+        spec.column = aggregateColumns.at(k)->currentIndex();
+        specs.append(spec);
+    }
+    if (specs.isEmpty())
+        specs.append(AggregateSpec());
+
+    // В отчёт попадают видимые строки: после фильтра — только отобранные
+    QVector<int> rows = source->rowOrder();
+    if (!source->hasRowOrder())
+    {
+        rows.resize(source->tableData().rowCount());
+        std::iota(rows.begin(), rows.end(), 0);
+    }
+
+    // Объект группировки переходит к вкладке с отчётом и по двойному щелчку открывает строки группы,
+    // пока в исходной таблице не вставляли и не удаляли строки
+    TableGrouping *grouping = new TableGrouping(this);
+    QPointer<TableModel> sourceModel = source;
+    const int revision = source->structureRevision();
+    const QString title = ui->tabWidget->tabText(ui->tabWidget->currentIndex());
+    connect(grouping, &TableGrouping::finished, this, [this, grouping, sourceModel, revision, title](const GroupedTable &grouped)
+            {
+                if (!grouped.errorMessage.isEmpty() || grouped.rowCount == 0)
+                {
+                    QMessageBox::information(this, "Группировка и сводная таблица",
+                                             grouped.errorMessage.isEmpty() ? QString("Нет строк для отчёта.") : grouped.errorMessage);
+                    grouping->deleteLater();
+                    return;
+                }
+
+                TableModel *model = new TableModel();
+                model->appendColumns(grouped.columns, grouped.rowCount);
+                model->setColumnTitles(grouped.titles);
+                QTableView *table = createTableView(model);
+                table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+                table->setProperty("modified", true);
+                grouping->setParent(table);
+                connect(table, &QTableView::doubleClicked, table, [this, grouping, model, sourceModel, revision, title](const QModelIndex &index)
+                        {
+                            if (!sourceModel || sourceModel->structureRevision() != revision)
+                            {
+                                QMessageBox::information(this, "Строки группы", "Строки исходной таблицы изменились, постройте отчёт заново.");
+                                return;
+                            }
+
+                            const QVector<int> rows = grouping->sourceRows(model->sourceRow(index.row()), index.column());
+                            if (rows.isEmpty())
+                                return;
+                            QVector<TableColumn> columns;
+                            for (int j = 0; j < sourceModel->tableData().columnCount(); ++j)
+                            {
+                                columns.append(sourceModel->tableData().gatherColumn(j, rows));
+                            }
+                            TableModel *detail = new TableModel();
+                            detail->appendColumns(columns, rows.size());
+                            detail->setColumnTitles(sourceModel->columnTitles());
+                            QTableView *detailTable = createTableView(detail);
+                            detailTable->setEditTriggers(QAbstractItemView::DoubleClicked);
+                            detailTable->setProperty("modified", true);
+                            int detailIndex = ui->tabWidget->addTab(detailTable, tr("%1: строки группы").arg(title));
+                            ui->tabWidget->setCurrentIndex(detailIndex);
+                        });
+
+                int index = ui->tabWidget->addTab(table, tr("%1: %2").arg(title, grouped.pivotValues > 0 ? QString("сводная") : QString("группы")));
+                ui->tabWidget->setCurrentIndex(index);
+            });
+
+    if (pivotColumn->currentIndex() > 0)
+        grouping->runPivot(source->tableData(), source->columnTitles(), rows, keys, pivotColumn->currentIndex() - 1, specs.first());
+    else
+        grouping->runGroups(source->tableData(), source->columnTitles(), rows, keys, specs);
+}
+
+void MainWindow::on_GoToLine_triggered()
+{
+    QWidget *currentWidget = ui->tabWidget->currentWidget();
+    LargeFileView *viewer = qobject_cast<LargeFileView *>(currentWidget);
+    editor = qobject_cast<QTextEdit *>(currentWidget);
+    if (!viewer && !editor)
+    {
+        QMessageBox::warning(this, tr("Ошибка"), tr("Переход к строке доступен только для текстовых вкладок"));
+        return;
+    }
+    if (viewer && viewer->isIndexing())
+    {
+        QMessageBox::information(this, tr("Переход к строке"), tr("Индекс строк файла ещё строится"));
+        return;
+    }
+
+    const int lines = viewer ? static_cast<int>(qMin<qint64>(viewer->lineCount(), INT_MAX)) : editor->document()->blockCount();
+    bool ok = false;
+    const int line = QInputDialog::getInt(this, tr("Переход к строке"), tr("Номер строки (1-%1):").arg(lines), 1, 1, qMax(1, lines), 1, &ok);
+    if (!ok)
+        return;
+
+    if (viewer)
+    {
+        viewer->goToLine(line - 1);
+        return;
+    }
+    QTextCursor cursor(editor->document()->findBlockByNumber(line - 1));
+    editor->setTextCursor(cursor);
+    editor->ensureCursorVisible();
+}
+
+void MainWindow::on_LargeFileThreshold_triggered()
+{
+    bool ok = false;
+    const int megabytes = QInputDialog::getInt(this, tr("Просмотр больших файлов"),
+                                               tr("Открывать только для просмотра текстовые файлы от (МБ):"),
+                                               largeFileMegabytes(), 1, 1024 * 1024, 1, &ok);
+    if (!ok)
+        return;
+
+    QSettings settings("Visual_Lab5", "Lab_5");
+    settings.setValue("viewer/largeFileMegabytes", megabytes);
+}
+
+void MainWindow::on_EditLargeFile_triggered()
+{
+    LargeFileView *viewer = qobject_cast<LargeFileView *>(ui->tabWidget->currentWidget());
+    if (!viewer)
+    {
+        QMessageBox::warning(this, tr("Ошибка"), tr("Текущая вкладка не является просмотром большого файла"));
+        return;
+    }
+    // Без индекса строк нельзя делить куски текста при правке
+    if (viewer->isIndexing())
+    {
+        QMessageBox::information(this, tr("Правка большого файла"), tr("Индекс строк файла ещё строится"));
+        return;
+    }
+
+    // Повторный выбор пункта возвращает вкладку к просмотру; правки при этом сохраняются в истории
+    viewer->setReadOnly(!viewer->isReadOnly());
+    viewer->setFocus();
+    statusBar()->showMessage(viewer->isReadOnly() ? tr("Правка файла выключена") : tr("Правка файла включена"), 3000);
+}
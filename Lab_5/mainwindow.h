@@ -4,8 +4,8 @@
 #include <QMainWindow>
 #include <QTextEdit>
 #include <QFile>
-#include <QTableWidget>
-#include <QTableWidgetItem>
+#include <QTableView>
+#include <QHeaderView>
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QInputDialog>
@@ -27,9 +27,34 @@
 #include <QSpinBox>
 #include <QTextTableCell>
 #include <QRadioButton>
+#include <QComboBox>
 #include <QTemporaryFile>
+#include <QStatusBar>
+#include <QProgressBar>
+#include <QDockWidget>
+#include <QPlainTextEdit>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QScrollBar>
+#include <QClipboard>
 
 #include "graphicseditor.h"
+#include "csvloader.h"
+#include "csvfollower.h"
+#include "tablemodel.h"
+#include "tableserializer.h"
+#include "tablequery.h"
+#include "selectionstats.h"
+#include "queryengine.h"
+#include "tablejoin.h"
+#include "tablegrouping.h"
+#include "tablesearch.h"
+#include "tableclipboard.h"
+#include "stylesidecar.h"
+#include "largefileview.h"
+#include "textloader.h"
+#include "textfilewriter.h"
+#include "textformatsidecar.h"
 
 namespace Ui {
 class MainWindow;
@@ -76,7 +101,7 @@ private slots:
 
     void on_Clear_triggered();
 
-    void loadTextSettings(const QString& filePath);
+    void loadTextSettings(QTextEdit *editor, const QString& filePath);
 
     void saveTextSettings(const QString& filePath);
 
@@ -98,15 +123,41 @@ private slots:
 
     void on_Paddins_triggered();
 
+    void on_SortFilter_triggered();
+
+    void on_QueryConsole_triggered();
+
+    void on_JoinTables_triggered();
+
+    void on_GroupPivot_triggered();
+
+    void on_FollowFile_triggered();
+
+    void on_GoToLine_triggered();
+
+    void on_LargeFileThreshold_triggered();
+
+    void on_EditLargeFile_triggered();
+
     void on_GoToGraphic_clicked();
 
     void resetEditorWindow();
 
 private:
+    QTableView *createTableView(TableModel *model);
+    static TableModel *tableModelOf(QTableView *view);
+    void startCsvLoad(QTableView *table, const QString &fileName);
+    void startTextLoad(QTextEdit *textEdit, const QString &fileName);
+    bool applyTableSettings(TableModel *model, const QString &fileName, const StyleSidecar &styles);
+    void saveTable(QTableView *table, const QString &filePath);
+    void updateSelectionStats();
+    void showSelectionStats(const SelectionSummary &summary);
+    void searchTable(QTableView *table, bool replace);
+
     Ui::MainWindow *ui;
     int pageIndex;
     QTextEdit *editor;
-    QTableWidget *tableWidget;
+    QTableView *tableView;
     QFont currentFont;
     QColor textColor;
     QColor backgroundColor;
@@ -114,6 +165,11 @@ private:
     bool tableModified = true;
     static QTemporaryFile tempFile;
     GraphicsEditor *graphicEditor;
+    QLabel *selectionLabel;
+    SelectionStats *selectionStats;
+    QDockWidget *queryDock = nullptr;
+    QElapsedTimer queryTimer;
+    TableJoin *tableJoin = nullptr;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,362 @@
+#include "piecetable.h"
+
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cstring>
+
+PieceTable::PieceTable()
+{
+}
+
+PieceTable::PieceTable(const char *original, qint64 size) : original(original),
+                                                            originalSize(size)
+{
+    if (size > 0)
+    {
+        Piece piece;
+        piece.length = size;
+        root = leaf(piece);
+    }
+    savedRoot = root;
+}
+
+void PieceTable::setOriginalIndex(const LineIndex &index)
+{
+    // Индекс приходит до первой правки: дерево ещё из одного куска на весь файл
+    originalIndex = index;
+    indexed = true;
+    if (originalSize > 0)
+    {
+        Piece piece;
+        piece.length = originalSize;
+        piece.newlines = index.newlineCount;
+        root = leaf(piece);
+    }
+    savedRoot = root;
+    undoStack.clear();
+    redoStack.clear();
+}
+
+qint64 PieceTable::size() const
+{
+    return lengthOf(root);
+}
+
+qint64 PieceTable::lineCount() const
+{
+    if (!indexed)
+        return 0;
+    const qint64 length = size();
+    return newlinesOf(root) + (length > 0 && at(length - 1) != '\n' ? 1 : 0);
+}
+
+qint64 PieceTable::lineStart(qint64 line) const
+{
+    if (!indexed)
+        return originalIndex.lineStart(original, originalSize, line);
+    if (line <= 0)
+        return 0;
+
+    // Спуск к куску, в котором лежит перевод строки номер line
+    qint64 remaining = line;
+    qint64 offset = 0;
+    const Node *node = root.data();
+    while (node)
+    {
+        const qint64 leftNewlines = newlinesOf(node->left);
+        if (remaining <= leftNewlines)
+        {
+            node = node->left.data();
+            continue;
+        }
+        remaining -= leftNewlines;
+        offset += lengthOf(node->left);
+
+        const Piece &piece = node->piece;
+        if (remaining <= piece.newlines)
+        {
+            if (!piece.added)
+            {
+                const qint64 ordinal = originalIndex.newlinesBefore(original, piece.start) + remaining;
+                return offset + originalIndex.lineStart(original, originalSize, ordinal) - piece.start;
+            }
+            const char *data = pieceData(piece);
+            const char *pos = data;
+            for (qint64 i = 0; i < remaining; ++i)
+            {
+                pos = static_cast<const char *>(std::memchr(pos, '\n', static_cast<size_t>(data + piece.length - pos))) + 1;
+            }
+            return offset + (pos - data);
+        }
+        remaining -= piece.newlines;
+        offset += piece.length;
+        node = node->right.data();
+    }
+    return size();
+}
+
+qint64 PieceTable::lineOf(qint64 pos) const
+{
+    if (!indexed)
+        return 0;
+
+    qint64 line = 0;
+    const Node *node = root.data();
+    while (node)
+    {
+        const qint64 leftLength = lengthOf(node->left);
+        if (pos < leftLength)
+        {
+            node = node->left.data();
+            continue;
+        }
+        pos -= leftLength;
+        line += newlinesOf(node->left);
+
+        const Piece &piece = node->piece;
+        if (pos < piece.length)
+        {
+            const char *data = pieceData(piece);
+            return line + (piece.added ? std::count(data, data + pos, '\n')
+                                       : originalIndex.newlinesBefore(original, piece.start + pos) -
+                                             originalIndex.newlinesBefore(original, piece.start));
+        }
+        pos -= piece.length;
+        line += piece.newlines;
+        node = node->right.data();
+    }
+    return line;
+}
+
+qint64 PieceTable::findNewline(qint64 pos) const
+{
+    const qint64 length = size();
+    while (pos < length)
+    {
+        qint64 available = 0;
+        const char *data = chunk(pos, &available);
+        const void *newline = std::memchr(data, '\n', static_cast<size_t>(available));
+        if (newline)
+            return pos + (static_cast<const char *>(newline) - data);
+        pos += available;
+    }
+    return length;
+}
+
+const char *PieceTable::chunk(qint64 pos, qint64 *available) const
+{
+    const Node *node = root.data();
+    while (node)
+    {
+        const qint64 leftLength = lengthOf(node->left);
+        if (pos < leftLength)
+        {
+            node = node->left.data();
+            continue;
+        }
+        pos -= leftLength;
+        if (pos < node->piece.length)
+        {
+            *available = node->piece.length - pos;
+            return pieceData(node->piece) + pos;
+        }
+        pos -= node->piece.length;
+        node = node->right.data();
+    }
+    *available = 0;
+    return nullptr;
+}
+
+QByteArray PieceTable::read(qint64 pos, qint64 length) const
+{
+    QByteArray bytes;
+    length = qMin(length, size() - pos);
+    bytes.reserve(static_cast<int>(qMax<qint64>(length, 0)));
+    while (length > 0)
+    {
+        qint64 available = 0;
+        const char *data = chunk(pos, &available);
+        const qint64 take = qMin(available, length);
+        bytes.append(data, static_cast<int>(take));
+        pos += take;
+        length -= take;
+    }
+    return bytes;
+}
+
+char PieceTable::at(qint64 pos) const
+{
+    qint64 available = 0;
+    const char *data = chunk(pos, &available);
+    return data ? *data : '\0';
+}
+
+void PieceTable::insert(qint64 pos, const QByteArray &utf8, bool continuing)
+{
+    if (utf8.isEmpty() || !indexed)
+        return;
+    record(pos, continuing);
+
+    Piece piece;
+    piece.added = true;
+    piece.start = added.size();
+    piece.length = utf8.size();
+    piece.newlines = std::count(utf8.constBegin(), utf8.constEnd(), '\n');
+    added.append(utf8);
+
+    NodePtr left;
+    NodePtr right;
+    split(root, pos, left, right);
+    root = merge(merge(left, leaf(piece)), right);
+}
+
+void PieceTable::remove(qint64 pos, qint64 length, bool continuing)
+{
+    if (length <= 0 || !indexed)
+        return;
+    record(pos, continuing);
+
+    NodePtr left;
+    NodePtr rest;
+    NodePtr removed;
+    NodePtr right;
+    split(root, pos, left, rest);
+    split(rest, length, removed, right);
+    root = merge(left, right);
+}
+
+qint64 PieceTable::undo()
+{
+    if (undoStack.isEmpty())
+        return -1;
+    const Revision revision = undoStack.takeLast();
+    redoStack.append({root, revision.position});
+    root = revision.root;
+    return revision.position;
+}
+
+qint64 PieceTable::redo()
+{
+    if (redoStack.isEmpty())
+        return -1;
+    const Revision revision = redoStack.takeLast();
+    undoStack.append({root, revision.position});
+    root = revision.root;
+    return revision.position;
+}
+
+void PieceTable::record(qint64 position, bool continuing)
+{
+    // Версия до правки; набор подряд остаётся в одной версии с началом набора
+    if (!continuing || undoStack.isEmpty())
+        undoStack.append({root, position});
+    redoStack.clear();
+}
+
+bool PieceTable::write(QIODevice *device) const
+{
+    // Обход по порядку без рекурсии: глубина дерева мала, но стек явный дешевле
+    QVector<const Node *> stack;
+    const Node *node = root.data();
+    while (node || !stack.isEmpty())
+    {
+        while (node)
+        {
+            stack.append(node);
+            node = node->left.data();
+        }
+        node = stack.takeLast();
+        if (device->write(pieceData(node->piece), node->piece.length) != node->piece.length)
+            return false;
+        node = node->right.data();
+    }
+    return true;
+}
+
+PieceTable::NodePtr PieceTable::make(const Piece &piece, quint32 priority, const NodePtr &left, const NodePtr &right)
+{
+    Node *node = new Node;
+    node->piece = piece;
+    node->priority = priority;
+    node->length = lengthOf(left) + piece.length + lengthOf(right);
+    node->newlines = newlinesOf(left) + piece.newlines + newlinesOf(right);
+    node->left = left;
+    node->right = right;
+    return NodePtr(node);
+}
+
+PieceTable::NodePtr PieceTable::leaf(const Piece &piece)
+{
+    // Случайные приоритеты держат глубину дерева логарифмической при любом порядке правок
+    return make(piece, QRandomGenerator::global()->generate(), NodePtr(), NodePtr());
+}
+
+PieceTable::NodePtr PieceTable::merge(const NodePtr &left, const NodePtr &right)
+{
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+    if (left->priority > right->priority)
+        return make(left->piece, left->priority, left->left, merge(left->right, right));
+    return make(right->piece, right->priority, merge(left, right->left), right->right);
+}
+
+void PieceTable::split(const NodePtr &node, qint64 pos, NodePtr &left, NodePtr &right) const
+{
+    // Граница по краю поддерева: узлы не копируются
+    if (!node || pos <= 0)
+    {
+        left.reset();
+        right = node;
+        return;
+    }
+    if (pos >= node->length)
+    {
+        left = node;
+        right.reset();
+        return;
+    }
+
+    const qint64 leftLength = lengthOf(node->left);
+    const qint64 pieceEnd = leftLength + node->piece.length;
+    NodePtr first;
+    NodePtr second;
+    if (pos <= leftLength)
+    {
+        split(node->left, pos, first, second);
+        left = first;
+        right = make(node->piece, node->priority, second, node->right);
+    }
+    else if (pos >= pieceEnd)
+    {
+        split(node->right, pos - pieceEnd, first, second);
+        left = make(node->piece, node->priority, node->left, first);
+        right = second;
+    }
+    else
+    {
+        // Граница внутри куска: он делится надвое, переводы строки считаются в левой части
+        Piece head = node->piece;
+        head.length = pos - leftLength;
+        head.newlines = countNewlines(head);
+        Piece tail = node->piece;
+        tail.start += head.length;
+        tail.length -= head.length;
+        tail.newlines -= head.newlines;
+        left = merge(node->left, leaf(head));
+        right = merge(leaf(tail), node->right);
+    }
+}
+
+const char *PieceTable::pieceData(const Piece &piece) const
+{
+    return (piece.added ? added.constData() : original) + piece.start;
+}
+
+qint64 PieceTable::countNewlines(const Piece &piece) const
+{
+    if (piece.added)
+        return std::count(pieceData(piece), pieceData(piece) + piece.length, '\n');
+    return originalIndex.newlinesBefore(original, piece.start + piece.length) - originalIndex.newlinesBefore(original, piece.start);
+}
@@ -0,0 +1,106 @@
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QSharedPointer>
+#include <QIODevice>
+
+#include "lineindex.h"
+
+// Текст как таблица кусков: исходный файл (отображён в память, только чтение) и буфер
+// добавленного текста, в который попадают все вставки. Куски лежат в декартовом дереве
+// по позиции, в узлах — длины и число переводов строки поддеревьев. Узлы после создания
+// не меняются: правка строит O(log n) новых узлов, а остальные разделяет с прежним деревом.
+// Поэтому версии для отмены почти ничего не стоят, и память растёт с правками, а не с файлом
+class PieceTable
+{
+public:
+    PieceTable();
+    // original должен оставаться доступным, пока жива таблица
+    PieceTable(const char *original, qint64 size);
+
+    // Индекс строк исходного файла. До него известна только первая страница строк,
+    // а правка недоступна: при делении кусков нужно число переводов строки в них
+    void setOriginalIndex(const LineIndex &index);
+    bool isIndexed() const { return indexed; }
+    // Тот же исходный файл отображён заново по другому адресу
+    void setOriginal(const char *original) { this->original = original; }
+
+    qint64 size() const;
+    qint64 lineCount() const;
+    qint64 lineStart(qint64 line) const; // За последней строкой — size()
+    qint64 lineOf(qint64 pos) const;
+    qint64 findNewline(qint64 pos) const; // Первый перевод строки не раньше pos или size()
+
+    // Непрерывные байты с позиции pos в пределах одного куска; available — сколько их
+    const char *chunk(qint64 pos, qint64 *available) const;
+    QByteArray read(qint64 pos, qint64 length) const;
+    char at(qint64 pos) const;
+
+    // continuing — правка продолжает предыдущую (набор подряд) и отменяется вместе с ней
+    void insert(qint64 pos, const QByteArray &utf8, bool continuing = false);
+    void remove(qint64 pos, qint64 length, bool continuing = false);
+
+    // Возвращают позицию отменённой (повторённой) правки; -1 — история пуста
+    qint64 undo();
+    qint64 redo();
+
+    // Изменён ли текст с последнего сохранения: версии сравниваются по корню дерева
+    bool isModified() const { return root != savedRoot; }
+    void setSaved() { savedRoot = root; }
+
+    // Куски пишутся по порядку прямо из отображения файла и буфера добавлений
+    bool write(QIODevice *device) const;
+
+private:
+    struct Piece
+    {
+        bool added = false; // Из буфера добавлений, иначе из исходного файла
+        qint64 start = 0;
+        qint64 length = 0;
+        qint64 newlines = 0;
+    };
+
+    struct Node;
+    typedef QSharedPointer<const Node> NodePtr;
+
+    struct Node
+    {
+        Piece piece;
+        quint32 priority;
+        qint64 length;   // Всего поддерева
+        qint64 newlines; // Всего поддерева
+        NodePtr left;
+        NodePtr right;
+    };
+
+    struct Revision
+    {
+        NodePtr root;
+        qint64 position;
+    };
+
+    static qint64 lengthOf(const NodePtr &node) { return node ? node->length : 0; }
+    static qint64 newlinesOf(const NodePtr &node) { return node ? node->newlines : 0; }
+    static NodePtr make(const Piece &piece, quint32 priority, const NodePtr &left, const NodePtr &right);
+    static NodePtr leaf(const Piece &piece);
+    static NodePtr merge(const NodePtr &left, const NodePtr &right);
+    void split(const NodePtr &node, qint64 pos, NodePtr &left, NodePtr &right) const;
+
+    const char *pieceData(const Piece &piece) const;
+    qint64 countNewlines(const Piece &piece) const;
+    void record(qint64 position, bool continuing);
+
+    const char *original = nullptr;
+    qint64 originalSize = 0;
+    LineIndex originalIndex;
+    bool indexed = false;
+    QByteArray added;
+    NodePtr root;
+    NodePtr savedRoot;
+    QVector<Revision> undoStack;
+    QVector<Revision> redoStack;
+};
+
+#endif // PIECETABLE_H
@@ -0,0 +1,906 @@
+#include "queryengine.h"
+#include "tableaggregate.h"
+#include "tablequery.h"
+
+#include <QDate>
+#include <QFileInfo>
+#include <QThread>
+#include <QRegularExpression>
+#include <QtConcurrent>
+#include <cstring>
+#include <numeric>
+
+namespace
+{
+    const int BatchRows = 4096;            // Строк в пачке: номера пачки помещаются в кэш L1
+    const int MinRowsPerTask = 64 * 1024;  // Меньшие части не окупают передачу в другой поток
+    const int MaxColumnLetters = 4;
+
+    struct Token
+    {
+        enum Kind
+        {
+            End,
+            Word,
+            QuotedName,
+            String,
+            Number,
+            Symbol
+        };
+
+        Kind kind = End;
+        QString text;
+        double number = 0;
+    };
+
+    bool isLatinLetter(QChar c)
+    {
+        return (c >= QLatin1Char('A') && c <= QLatin1Char('Z')) || (c >= QLatin1Char('a') && c <= QLatin1Char('z'));
+    }
+
+    bool tokenize(const QString &source, QVector<Token> &tokens, QString &error)
+    {
+        int i = 0;
+        while (i < source.size())
+        {
+            const QChar c = source.at(i);
+            if (c.isSpace())
+            {
+                ++i;
+                continue;
+            }
+
+            Token token;
+            if (c.isLetter() || c == QLatin1Char('_'))
+            {
+                // Имя вкладки без кавычек может содержать точку: orders.csv
+                int end = i;
+                while (end < source.size() && (source.at(end).isLetterOrNumber() || source.at(end) == QLatin1Char('_') || source.at(end) == QLatin1Char('.')))
+                {
+                    ++end;
+                }
+                token.kind = Token::Word;
+                token.text = source.mid(i, end - i);
+                i = end;
+            }
+            else if (c.isDigit() || (c == QLatin1Char('.') && i + 1 < source.size() && source.at(i + 1).isDigit()))
+            {
+                int end = i;
+                while (end < source.size() && (source.at(end).isDigit() || source.at(end) == QLatin1Char('.') ||
+                                               source.at(end) == QLatin1Char('e') || source.at(end) == QLatin1Char('E') ||
+                                               ((source.at(end) == QLatin1Char('+') || source.at(end) == QLatin1Char('-')) &&
+                                                (source.at(end - 1) == QLatin1Char('e') || source.at(end - 1) == QLatin1Char('E')))))
+                {
+                    ++end;
+                }
+                bool ok = false;
+                token.kind = Token::Number;
+                token.text = source.mid(i, end - i);
+                token.number = token.text.toDouble(&ok);
+                if (!ok)
+                {
+                    error = QueryEngine::tr("Неверное число: %1").arg(token.text);
+                    return false;
+                }
+                i = end;
+            }
+            else if (c == QLatin1Char('\'') || c == QLatin1Char('"') || c == QLatin1Char('['))
+            {
+                // Строки в одинарных кавычках, имена в двойных или квадратных; кавычка удваивается
+                const QChar close = c == QLatin1Char('[') ? QLatin1Char(']') : c;
+                token.kind = c == QLatin1Char('\'') ? Token::String : Token::QuotedName;
+                int end = i + 1;
+                while (true)
+                {
+                    if (end >= source.size())
+                    {
+                        error = QueryEngine::tr("Не закрыта кавычка");
+                        return false;
+                    }
+                    if (source.at(end) == close)
+                    {
+                        if (close != QLatin1Char(']') && end + 1 < source.size() && source.at(end + 1) == close)
+                        {
+                            token.text += close;
+                            end += 2;
+                            continue;
+                        }
+                        break;
+                    }
+                    token.text += source.at(end);
+                    ++end;
+                }
+                i = end + 1;
+            }
+            else
+            {
+                static const QStringList pairs = {QStringLiteral("<="), QStringLiteral(">="), QStringLiteral("<>"), QStringLiteral("!=")};
+                token.kind = Token::Symbol;
+                token.text = c;
+                const QString pair = source.mid(i, 2);
+                if (pairs.contains(pair))
+                    token.text = pair;
+                else if (!QStringLiteral(",()*=<>-;").contains(c))
+                {
+                    error = QueryEngine::tr("Непонятный символ: %1").arg(c);
+                    return false;
+                }
+                i += token.text.size();
+            }
+            tokens.append(token);
+        }
+        tokens.append(Token());
+        return true;
+    }
+
+    struct Predicate
+    {
+        enum Op
+        {
+            Equal,
+            NotEqual,
+            Less,
+            LessEqual,
+            Greater,
+            GreaterEqual,
+            Like,
+            NotLike,
+            IsNull,
+            IsNotNull
+        };
+
+        int column = 0;
+        Op op = Equal;
+        QString text;
+        bool numeric = false;
+        double number = 0;
+    };
+
+    struct SelectItem
+    {
+        bool aggregate = false;
+        int column = 0;
+        AggregateSpec spec;
+    };
+
+    struct OrderItem
+    {
+        int position = -1; // Номер столбца результата (с нуля) или -1, тогда column — столбец таблицы
+        int column = 0;
+        Qt::SortOrder order = Qt::AscendingOrder;
+    };
+
+    struct Query
+    {
+        bool star = false;
+        QVector<SelectItem> select;
+        QString relation;
+        QVector<Predicate> where;
+        QVector<int> groupBy;
+        QVector<OrderItem> orderBy;
+        int limit = -1;
+    };
+
+    class Parser
+    {
+    public:
+        explicit Parser(const QVector<Token> &tokens) : tokens(tokens)
+        {
+        }
+
+        bool parse(Query &query)
+        {
+            if (!expectKeyword("SELECT") || !parseSelect(query) || !expectKeyword("FROM"))
+                return false;
+
+            if (peek().kind != Token::Word && peek().kind != Token::QuotedName)
+                return fail(QueryEngine::tr("Ожидалось имя таблицы после FROM"));
+            query.relation = next().text;
+
+            if (acceptKeyword("WHERE"))
+            {
+                do
+                {
+                    Predicate predicate;
+                    if (!parsePredicate(predicate))
+                        return false;
+                    query.where.append(predicate);
+                } while (acceptKeyword("AND"));
+            }
+
+            if (acceptKeyword("GROUP"))
+            {
+                if (!expectKeyword("BY"))
+                    return false;
+                do
+                {
+                    int column = 0;
+                    if (!parseColumn(column))
+                        return false;
+                    query.groupBy.append(column);
+                } while (acceptSymbol(","));
+            }
+
+            if (acceptKeyword("ORDER"))
+            {
+                if (!expectKeyword("BY"))
+                    return false;
+                do
+                {
+                    OrderItem item;
+                    if (peek().kind == Token::Number)
+                    {
+                        item.position = static_cast<int>(next().number) - 1;
+                        if (item.position < 0)
+                            return fail(QueryEngine::tr("Номер столбца в ORDER BY начинается с 1"));
+                    }
+                    else if (!parseColumn(item.column))
+                    {
+                        return false;
+                    }
+                    if (acceptKeyword("DESC"))
+                        item.order = Qt::DescendingOrder;
+                    else
+                        acceptKeyword("ASC");
+                    query.orderBy.append(item);
+                } while (acceptSymbol(","));
+            }
+
+            if (acceptKeyword("LIMIT"))
+            {
+                if (peek().kind != Token::Number || peek().number < 0)
+                    return fail(QueryEngine::tr("Ожидалось число после LIMIT"));
+                query.limit = static_cast<int>(qMin<double>(next().number, INT_MAX));
+            }
+
+            acceptSymbol(";");
+            if (peek().kind != Token::End)
+                return fail(QueryEngine::tr("Лишний текст в конце запроса: %1").arg(peek().text));
+            return true;
+        }
+
+        QString error;
+
+    private:
+        const Token &peek() const { return tokens.at(qMin(position, tokens.size() - 1)); }
+        const Token &next() { return tokens.at(qMin(position++, tokens.size() - 1)); }
+
+        bool fail(const QString &message)
+        {
+            error = message;
+            return false;
+        }
+
+        bool isKeyword(const char *keyword) const
+        {
+            return peek().kind == Token::Word && peek().text.compare(QLatin1String(keyword), Qt::CaseInsensitive) == 0;
+        }
+
+        bool acceptKeyword(const char *keyword)
+        {
+            if (!isKeyword(keyword))
+                return false;
+            ++position;
+            return true;
+        }
+
+        bool expectKeyword(const char *keyword)
+        {
+            return acceptKeyword(keyword) || fail(QueryEngine::tr("Ожидалось %1").arg(QLatin1String(keyword)));
+        }
+
+        bool acceptSymbol(const char *symbol)
+        {
+            if (peek().kind != Token::Symbol || peek().text != QLatin1String(symbol))
+                return false;
+            ++position;
+            return true;
+        }
+
+        // Столбец — буквы, как в формулах: A, B, ..., Z, AA
+        bool parseColumn(int &column)
+        {
+            const Token &token = peek();
+            bool valid = token.kind == Token::Word && token.text.size() <= MaxColumnLetters;
+            int value = 0;
+            for (int i = 0; valid && i < token.text.size(); ++i)
+            {
+                valid = isLatinLetter(token.text.at(i));
+                value = value * 26 + (token.text.at(i).toUpper().unicode() - 'A' + 1);
+            }
+            if (!valid)
+                return fail(QueryEngine::tr("Ожидался столбец (A, B, ...), а не «%1»").arg(token.text));
+            ++position;
+            column = value - 1;
+            return true;
+        }
+
+        bool parseSelect(Query &query)
+        {
+            if (acceptSymbol("*"))
+            {
+                query.star = true;
+                return true;
+            }
+
+            static const QHash<QString, AggregateSpec::Function> functions = {{QStringLiteral("COUNT"), AggregateSpec::Count},
+                                                                              {QStringLiteral("SUM"), AggregateSpec::Sum},
+                                                                              {QStringLiteral("MIN"), AggregateSpec::Min},
+                                                                              {QStringLiteral("MAX"), AggregateSpec::Max},
+                                                                              {QStringLiteral("AVG"), AggregateSpec::Average},
+                                                                              {QStringLiteral("AVERAGE"), AggregateSpec::Average}};
+            do
+            {
+                SelectItem item;
+                const auto function = functions.constFind(peek().text.toUpper());
+                if (peek().kind == Token::Word && function != functions.constEnd() &&
+                    position + 1 < tokens.size() && tokens.at(position + 1).text == QLatin1String("("))
+                {
+                    position += 2;
+                    item.aggregate = true;
+                    item.spec.function = function.value();
+                    if (item.spec.function == AggregateSpec::Count && acceptSymbol("*"))
+                        item.spec.function = AggregateSpec::CountAll;
+                    else if (!parseColumn(item.spec.column))
+                        return false;
+                    if (!acceptSymbol(")"))
+                        return fail(QueryEngine::tr("Ожидалась «)»"));
+                }
+                else if (!parseColumn(item.column))
+                {
+                    return false;
+                }
+                query.select.append(item);
+            } while (acceptSymbol(","));
+            return true;
+        }
+
+        bool parsePredicate(Predicate &predicate)
+        {
+            if (!parseColumn(predicate.column))
+                return false;
+
+            if (acceptKeyword("IS"))
+            {
+                predicate.op = acceptKeyword("NOT") ? Predicate::IsNotNull : Predicate::IsNull;
+                return expectKeyword("NULL");
+            }
+
+            if (acceptKeyword("NOT"))
+            {
+                if (!expectKeyword("LIKE"))
+                    return false;
+                predicate.op = Predicate::NotLike;
+            }
+            else if (acceptKeyword("LIKE"))
+            {
+                predicate.op = Predicate::Like;
+            }
+            else
+            {
+                static const QHash<QString, Predicate::Op> operators = {{QStringLiteral("="), Predicate::Equal},
+                                                                        {QStringLiteral("!="), Predicate::NotEqual},
+                                                                        {QStringLiteral("<>"), Predicate::NotEqual},
+                                                                        {QStringLiteral("<"), Predicate::Less},
+                                                                        {QStringLiteral("<="), Predicate::LessEqual},
+                                                                        {QStringLiteral(">"), Predicate::Greater},
+                                                                        {QStringLiteral(">="), Predicate::GreaterEqual}};
+                const auto op = operators.constFind(peek().text);
+                if (peek().kind != Token::Symbol || op == operators.constEnd())
+                    return fail(QueryEngine::tr("Ожидалось сравнение после столбца"));
+                predicate.op = op.value();
+                ++position;
+            }
+
+            const bool negative = acceptSymbol("-");
+            const Token &literal = next();
+            if (literal.kind == Token::Number)
+            {
+                predicate.numeric = true;
+                predicate.number = negative ? -literal.number : literal.number;
+                predicate.text = (negative ? QStringLiteral("-") : QString()) + literal.text;
+            }
+            else if (literal.kind == Token::String && !negative)
+            {
+                predicate.text = literal.text;
+            }
+            else
+            {
+                return fail(QueryEngine::tr("Ожидалось число или строка в кавычках"));
+            }
+
+            if ((predicate.op == Predicate::Like || predicate.op == Predicate::NotLike) && predicate.numeric)
+                predicate.numeric = false;
+            return true;
+        }
+
+        const QVector<Token> &tokens;
+        int position = 0;
+    };
+
+    bool accepts(Predicate::Op op, int order)
+    {
+        switch (op)
+        {
+        case Predicate::Equal:
+            return order == 0;
+        case Predicate::NotEqual:
+            return order != 0;
+        case Predicate::Less:
+            return order < 0;
+        case Predicate::LessEqual:
+            return order <= 0;
+        case Predicate::Greater:
+            return order > 0;
+        case Predicate::GreaterEqual:
+            return order >= 0;
+        default:
+            return false;
+        }
+    }
+
+    // Условие, подготовленное под тип столбца таблицы
+    struct PreparedPredicate
+    {
+        enum Mode
+        {
+            IntegerValues, // Сравнение значений Integer/Date-столбца с числом (для дат — юлианский день)
+            RealValues,
+            ParsedNumbers, // Текстовый столбец и числовое условие: ячейки разбираются как числа
+            Bytes,         // Сравнение текста ячейки с текстом условия по байтам UTF-8
+            Pattern,       // LIKE
+            Emptiness      // IS [NOT] NULL
+        };
+
+        Predicate predicate;
+        Mode mode = Bytes;
+        double number = 0;
+        QByteArray utf8;
+        QRegularExpression pattern;
+    };
+
+    PreparedPredicate prepare(const TableData &snapshot, const Predicate &predicate)
+    {
+        PreparedPredicate prepared;
+        prepared.predicate = predicate;
+        prepared.number = predicate.number;
+        prepared.utf8 = predicate.text.toUtf8();
+
+        if (predicate.op == Predicate::IsNull || predicate.op == Predicate::IsNotNull)
+        {
+            prepared.mode = PreparedPredicate::Emptiness;
+            return prepared;
+        }
+        if (predicate.op == Predicate::Like || predicate.op == Predicate::NotLike)
+        {
+            // % — любая последовательность, _ — один символ; регистр не важен, как в SQLite
+            QString regex;
+            for (const QChar c : predicate.text)
+            {
+                if (c == QLatin1Char('%'))
+                    regex += QStringLiteral(".*");
+                else if (c == QLatin1Char('_'))
+                    regex += QLatin1Char('.');
+                else
+                    regex += QRegularExpression::escape(QString(c));
+            }
+            prepared.pattern.setPattern(QRegularExpression::anchoredPattern(regex));
+            prepared.pattern.setPatternOptions(QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+            prepared.mode = PreparedPredicate::Pattern;
+            return prepared;
+        }
+
+        const TableColumn::Type type = snapshot.isSparse() ? TableColumn::Text : snapshot.column(predicate.column).type();
+        if (type == TableColumn::Date && !predicate.numeric)
+        {
+            const QDate date = QDate::fromString(predicate.text, Qt::ISODate);
+            if (date.isValid())
+            {
+                prepared.mode = PreparedPredicate::IntegerValues;
+                prepared.number = date.toJulianDay();
+            }
+            return prepared;
+        }
+        if (predicate.numeric)
+        {
+            if (type == TableColumn::Integer)
+                prepared.mode = PreparedPredicate::IntegerValues;
+            else if (type == TableColumn::Real)
+                prepared.mode = PreparedPredicate::RealValues;
+            else if (type == TableColumn::Text)
+                prepared.mode = PreparedPredicate::ParsedNumbers;
+        }
+        return prepared;
+    }
+
+    // Сжатие вектора выборки: номер строки пишется всегда, а позиция сдвигается только
+    // для прошедших — без ветвлений в цикле
+    template <typename T, typename Test>
+    int filterValues(const T *values, const uchar *nullBits, int *selection, int count, Test test)
+    {
+        int kept = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const int row = selection[i];
+            const bool empty = nullBits && ((nullBits[row >> 3] >> (row & 7)) & 1);
+            selection[kept] = row;
+            kept += test(values[row]) && !empty;
+        }
+        return kept;
+    }
+
+    template <typename T>
+    int compareValues(const T *values, const uchar *nullBits, double literal, Predicate::Op op, int *selection, int count)
+    {
+        switch (op)
+        {
+        case Predicate::Equal:
+            return filterValues(values, nullBits, selection, count, [literal](T value)
+                                { return value == literal; });
+        case Predicate::NotEqual:
+            return filterValues(values, nullBits, selection, count, [literal](T value)
+                                { return value != literal; });
+        case Predicate::Less:
+            return filterValues(values, nullBits, selection, count, [literal](T value)
+                                { return value < literal; });
+        case Predicate::LessEqual:
+            return filterValues(values, nullBits, selection, count, [literal](T value)
+                                { return value <= literal; });
+        case Predicate::Greater:
+            return filterValues(values, nullBits, selection, count, [literal](T value)
+                                { return value > literal; });
+        case Predicate::GreaterEqual:
+            return filterValues(values, nullBits, selection, count, [literal](T value)
+                                { return value >= literal; });
+        default:
+            return 0;
+        }
+    }
+
+    // Одна ячейка для общего пути (текст и разреженные таблицы)
+    bool matchesCell(const TableData &snapshot, const PreparedPredicate &prepared, int row)
+    {
+        const Predicate &predicate = prepared.predicate;
+        QByteArray bytes;
+        if (snapshot.isSparse())
+        {
+            bytes = snapshot.sparseGrid().bytes(row, predicate.column);
+        }
+        else
+        {
+            const TableColumn &column = snapshot.column(predicate.column);
+            bytes = column.type() == TableColumn::Text ? QByteArray::fromRawData(column.rawData(row), column.rawSize(row))
+                                                       : column.bytes(row);
+        }
+
+        switch (prepared.mode)
+        {
+        case PreparedPredicate::Emptiness:
+            return bytes.isEmpty() == (predicate.op == Predicate::IsNull);
+        case PreparedPredicate::Pattern:
+            return !bytes.isEmpty() && prepared.pattern.match(QString::fromUtf8(bytes)).hasMatch() == (predicate.op == Predicate::Like);
+        case PreparedPredicate::ParsedNumbers:
+        {
+            bool ok = false;
+            const double value = bytes.toDouble(&ok);
+            return ok && accepts(predicate.op, value < prepared.number ? -1 : (value > prepared.number ? 1 : 0));
+        }
+        default:
+        {
+            if (bytes.isEmpty())
+                return false;
+            const int common = qMin(bytes.size(), prepared.utf8.size());
+            int order = std::memcmp(bytes.constData(), prepared.utf8.constData(), common);
+            if (order == 0)
+                order = bytes.size() - prepared.utf8.size();
+            return accepts(predicate.op, order);
+        }
+        }
+    }
+
+    int applyPredicate(const TableData &snapshot, const PreparedPredicate &prepared, int *selection, int count)
+    {
+        if (!snapshot.isSparse() && (prepared.mode == PreparedPredicate::IntegerValues || prepared.mode == PreparedPredicate::RealValues))
+        {
+            const TableColumn &column = snapshot.column(prepared.predicate.column);
+            const QBitArray &nulls = column.nullMap();
+            const uchar *nullBits = nulls.isEmpty() ? nullptr : reinterpret_cast<const uchar *>(nulls.bits());
+            if (prepared.mode == PreparedPredicate::RealValues)
+                return compareValues(column.realData(), nullBits, prepared.number, prepared.predicate.op, selection, count);
+            return compareValues(column.integerData(), nullBits, prepared.number, prepared.predicate.op, selection, count);
+        }
+
+        int kept = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const int row = selection[i];
+            selection[kept] = row;
+            kept += matchesCell(snapshot, prepared, row);
+        }
+        return kept;
+    }
+
+    // Строки [first, last), прошедшие все условия: пачка номеров проходит условия по очереди
+    // и после каждого сжимается до прошедших
+    QVector<int> filterRange(const TableData &snapshot, const QVector<PreparedPredicate> &predicates, int first, int last)
+    {
+        QVector<int> rows;
+        int selection[BatchRows];
+        for (int batch = first; batch < last; batch += BatchRows)
+        {
+            int count = qMin(BatchRows, last - batch);
+            std::iota(selection, selection + count, batch);
+            for (const PreparedPredicate &predicate : predicates)
+            {
+                count = applyPredicate(snapshot, predicate, selection, count);
+                if (count == 0)
+                    break;
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                rows.append(selection[i]);
+            }
+        }
+        return rows;
+    }
+
+    QVector<int> filterRows(const TableData &snapshot, const QVector<PreparedPredicate> &predicates)
+    {
+        const int rows = snapshot.rowCount();
+        const int parts = qMax(1, QThread::idealThreadCount()) * 2;
+        const int step = qMax(MinRowsPerTask, (rows + parts - 1) / parts);
+        QList<QFuture<QVector<int>>> pending;
+        for (int first = 0; first < rows; first += step)
+        {
+            pending.append(QtConcurrent::run(&filterRange, snapshot, predicates, first, qMin(first + step, rows)));
+        }
+
+        QVector<int> result;
+        for (QFuture<QVector<int>> &part : pending)
+        {
+            result += part.result();
+        }
+        return result;
+    }
+
+    // Имя вкладки: точное, без учёта регистра или без расширения файла. Возвращает число
+    // подходящих вкладок; snapshot заполняется, только если вкладка одна
+    int findRelation(const QHash<QString, TableData> &relations, const QString &name, TableData &snapshot)
+    {
+        const int exact = relations.count(name);
+        if (exact == 1)
+            snapshot = relations.value(name);
+        if (exact > 0)
+            return exact;
+
+        QStringList matches;
+        for (auto it = relations.constBegin(); it != relations.constEnd(); ++it)
+        {
+            const QString &tab = it.key();
+            if (tab.compare(name, Qt::CaseInsensitive) == 0 || QFileInfo(tab).completeBaseName().compare(name, Qt::CaseInsensitive) == 0)
+                matches.append(tab);
+        }
+        if (matches.size() == 1)
+            snapshot = relations.value(matches.first());
+        return matches.size();
+    }
+
+    QVector<TableColumn> gatherRows(const QVector<TableColumn> &columns, const QVector<int> &rows)
+    {
+        QVector<TableColumn> result;
+        result.reserve(columns.size());
+        for (const TableColumn &column : columns)
+        {
+            result.append(column.gather(rows));
+        }
+        return result;
+    }
+}
+
+QueryEngine::QueryEngine(QObject *parent) : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<QueryResult>::finished, this, [this]()
+            {
+                emit finished(watcher.result());
+            });
+}
+
+QueryEngine::~QueryEngine()
+{
+    watcher.waitForFinished();
+}
+
+bool QueryEngine::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+void QueryEngine::run(const QString &text, const QHash<QString, TableData> &relations)
+{
+    watcher.setFuture(QtConcurrent::run(&QueryEngine::execute, text, relations));
+}
+
+QueryResult QueryEngine::execute(const QString &text, const QHash<QString, TableData> &relations)
+{
+    QueryResult result;
+    QVector<Token> tokens;
+    if (!tokenize(text, tokens, result.errorMessage))
+        return result;
+
+    Query query;
+    Parser parser(tokens);
+    if (!parser.parse(query))
+    {
+        result.errorMessage = parser.error;
+        return result;
+    }
+
+    // Одинаковые ярлыки (один файл из разных папок) не выбираются наугад
+    TableData snapshot;
+    const int found = findRelation(relations, query.relation, snapshot);
+    if (found == 0)
+    {
+        result.errorMessage = tr("Нет открытой таблицы «%1»").arg(query.relation);
+        return result;
+    }
+    if (found > 1)
+    {
+        result.errorMessage = tr("Таблиц «%1» открыто несколько: укажите «%1 (N)», где N — номер вкладки").arg(query.relation);
+        return result;
+    }
+
+    // Проверка столбцов и формы запроса до того, как трогать данные
+    const int columns = snapshot.columnCount();
+    bool aggregated = !query.groupBy.isEmpty();
+    if (query.star)
+    {
+        for (int j = 0; j < columns; ++j)
+        {
+            SelectItem item;
+            item.column = j;
+            query.select.append(item);
+        }
+    }
+    QVector<int> referenced = query.groupBy;
+    for (const SelectItem &item : query.select)
+    {
+        aggregated = aggregated || item.aggregate;
+        if (!item.aggregate)
+            referenced.append(item.column);
+        else if (item.spec.function != AggregateSpec::CountAll)
+            referenced.append(item.spec.column);
+    }
+    for (const Predicate &predicate : query.where)
+    {
+        referenced.append(predicate.column);
+    }
+    for (const OrderItem &item : query.orderBy)
+    {
+        if (item.position >= query.select.size())
+        {
+            result.errorMessage = tr("В ORDER BY нет столбца с номером %1").arg(item.position + 1);
+            return result;
+        }
+        if (item.position < 0)
+            referenced.append(item.column);
+    }
+    for (int column : referenced)
+    {
+        if (column >= columns)
+        {
+            result.errorMessage = tr("В таблице «%1» только %2 столбцов").arg(query.relation).arg(columns);
+            return result;
+        }
+    }
+    if (aggregated)
+    {
+        if (query.star)
+        {
+            result.errorMessage = tr("SELECT * нельзя сочетать с группировкой");
+            return result;
+        }
+        for (const SelectItem &item : query.select)
+        {
+            if (!item.aggregate && !query.groupBy.contains(item.column))
+            {
+                result.errorMessage = tr("Столбец без агрегатной функции должен быть в GROUP BY");
+                return result;
+            }
+        }
+    }
+
+    // Номера столбцов результата для ORDER BY по имени столбца
+    QVector<SortKey> keys;
+    for (const OrderItem &item : query.orderBy)
+    {
+        SortKey key;
+        key.order = item.order;
+        key.column = item.position;
+        if (key.column < 0)
+        {
+            for (int k = 0; k < query.select.size() && key.column < 0; ++k)
+            {
+                if (!query.select.at(k).aggregate && query.select.at(k).column == item.column)
+                    key.column = k;
+            }
+            if (key.column < 0)
+            {
+                // Без группировки можно сортировать и по столбцу, которого нет в выборке
+                if (aggregated)
+                {
+                    result.errorMessage = tr("Сортировать группы можно только по выбранным столбцам");
+                    return result;
+                }
+                key.column = -1 - item.column;
+            }
+        }
+        keys.append(key);
+    }
+
+    QVector<PreparedPredicate> predicates;
+    for (const Predicate &predicate : query.where)
+    {
+        predicates.append(prepare(snapshot, predicate));
+    }
+    QVector<int> rows = predicates.isEmpty() ? QVector<int>(snapshot.rowCount()) : filterRows(snapshot, predicates);
+    if (predicates.isEmpty())
+        std::iota(rows.begin(), rows.end(), 0);
+
+    if (!aggregated)
+    {
+        // Сортируются номера строк исходной таблицы, копируются только выбранные строки
+        if (!keys.isEmpty())
+        {
+            QVector<SortKey> sourceKeys = keys;
+            for (SortKey &key : sourceKeys)
+            {
+                key.column = key.column < 0 ? -1 - key.column : query.select.at(key.column).column;
+            }
+            TableQuery::sortRows(snapshot, rows, sourceKeys);
+        }
+        if (query.limit >= 0 && rows.size() > query.limit)
+            rows.resize(query.limit);
+
+        for (const SelectItem &item : query.select)
+        {
+            result.columns.append(snapshot.gatherColumn(item.column, rows));
+        }
+        result.rowCount = rows.size();
+        return result;
+    }
+
+    QVector<AggregateSpec> specs;
+    for (const SelectItem &item : query.select)
+    {
+        if (item.aggregate)
+            specs.append(item.spec);
+    }
+    const GroupedRows groups = TableAggregate::aggregate(snapshot, rows, query.groupBy, specs);
+
+    int aggregate = 0;
+    for (const SelectItem &item : query.select)
+    {
+        if (item.aggregate)
+            result.columns.append(groups.aggregates.at(aggregate++));
+        else
+            result.columns.append(snapshot.gatherColumn(item.column, groups.firstRows));
+    }
+    result.rowCount = groups.firstRows.size();
+
+    if (!keys.isEmpty() || (query.limit >= 0 && result.rowCount > query.limit))
+    {
+        QVector<int> order(result.rowCount);
+        std::iota(order.begin(), order.end(), 0);
+        if (!keys.isEmpty())
+        {
+            TableData grouped;
+            grouped.appendColumns(result.columns, result.rowCount);
+            TableQuery::sortRows(grouped, order, keys);
+        }
+        if (query.limit >= 0 && order.size() > query.limit)
+            order.resize(query.limit);
+        result.columns = gatherRows(result.columns, order);
+        result.rowCount = order.size();
+    }
+    return result;
+}
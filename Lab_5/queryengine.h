@@ -0,0 +1,49 @@
+#ifndef QUERYENGINE_H
+#define QUERYENGINE_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "tabledata.h"
+
+// Итог запроса: столбцы новой таблицы или текст ошибки
+struct QueryResult
+{
+    QString errorMessage;
+    QVector<TableColumn> columns;
+    int rowCount = 0;
+};
+
+// Запросы к открытым таблицам на небольшом диалекте SQL:
+//   SELECT * | A, B, COUNT(*), COUNT(C), SUM(C), AVG(C), MIN(C), MAX(C)
+//   FROM "имя вкладки"
+//   [WHERE A = 5 AND B >= '2024-01-01' AND C LIKE 'abc%' AND D IS NOT NULL]
+//   [GROUP BY A, B] [ORDER BY 2 DESC, A] [LIMIT 100]
+// Столбцы называются буквами, как в формулах; таблица — текстом ярлыка вкладки.
+// Условия проверяются пачками строк по столбцам хранения, без построения строк таблицы
+class QueryEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QueryEngine(QObject *parent = nullptr);
+    ~QueryEngine() override;
+
+    bool isRunning() const;
+    // relations — снимки таблиц по тексту ярлыков вкладок; одинаковые ярлыки лежат в нём
+    // несколько раз (insertMulti) и делают имя неоднозначным
+    void run(const QString &text, const QHash<QString, TableData> &relations);
+
+    static QueryResult execute(const QString &text, const QHash<QString, TableData> &relations);
+
+signals:
+    void finished(const QueryResult &result);
+
+private:
+    QFutureWatcher<QueryResult> watcher;
+};
+
+#endif // QUERYENGINE_H
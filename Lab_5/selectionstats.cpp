@@ -0,0 +1,426 @@
+#include "selectionstats.h"
+
+#include <QSet>
+#include <QtConcurrent>
+#include <qsimd.h>
+#include <cstring>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const qint64 SyncCells = 64 * 1024; // Выделение меньше этого считается сразу, без фонового потока
+    const int CheckRows = 16 * 1024;    // Как часто фоновый подсчёт проверяет, не устарел ли он
+    const int IntegerBlock = 512;       // Целые складываются точно блоками такого размера
+    const qint64 MaxBlockMagnitude = std::numeric_limits<qint64>::max() / IntegerBlock; // Сумма блока таких целых не переполняет qint64
+
+    // Накопитель сводки; числа для подсчёта различных значений сравниваются по значению, текст — по байтам
+    class Accumulator
+    {
+    public:
+        void addNumbers(qint64 count, double sum, double minimum, double maximum)
+        {
+            if (summary.numericCount == 0)
+            {
+                summary.minimum = minimum;
+                summary.maximum = maximum;
+            }
+            else
+            {
+                summary.minimum = qMin(summary.minimum, minimum);
+                summary.maximum = qMax(summary.maximum, maximum);
+            }
+            summary.count += count;
+            summary.numericCount += count;
+            summary.sum += sum;
+        }
+
+        void noteNumber(double value)
+        {
+            quint64 bits = 0;
+            if (value != 0) // -0 и 0 — одно значение
+                std::memcpy(&bits, &value, sizeof(bits));
+            numbers.insert(bits);
+        }
+
+        void addNumber(double value)
+        {
+            addNumbers(1, value, value, value);
+            noteNumber(value);
+        }
+
+        void addDate(qint64 day)
+        {
+            ++summary.count;
+            days.insert(day);
+        }
+
+        void addText(const char *data, int size)
+        {
+            if (size == 0)
+                return;
+
+            bool ok = false;
+            const double value = QByteArray::fromRawData(data, size).toDouble(&ok);
+            if (ok && qIsFinite(value))
+            {
+                addNumber(value);
+                return;
+            }
+            ++summary.count;
+            texts.insert(QByteArray(data, size));
+        }
+
+        SelectionSummary result()
+        {
+            summary.distinct = numbers.size() + days.size() + texts.size();
+            return summary;
+        }
+
+    private:
+        SelectionSummary summary;
+        QSet<quint64> numbers;
+        QSet<qint64> days;
+        QSet<QByteArray> texts;
+    };
+
+    bool isNull(const uchar *nullBits, int row)
+    {
+        return nullBits[row >> 3] & (1 << (row & 7));
+    }
+
+    // Вызывает add(first, count) для каждого участка подряд идущих непустых значений;
+    // байты карты без пустых ячеек пропускаются целиком
+    template <typename AddRun>
+    void forEachRun(const uchar *nullBits, int first, int last, AddRun add)
+    {
+        if (!nullBits)
+        {
+            if (first < last)
+                add(first, last - first);
+            return;
+        }
+
+        int row = first;
+        while (row < last)
+        {
+            if (isNull(nullBits, row))
+            {
+                ++row;
+                continue;
+            }
+
+            int end = row + 1;
+            while (end < last)
+            {
+                if ((end & 7) == 0 && end + 8 <= last && nullBits[end >> 3] == 0)
+                {
+                    end += 8;
+                    continue;
+                }
+                if (isNull(nullBits, end))
+                    break;
+                ++end;
+            }
+            add(row, end - row);
+            row = end;
+        }
+    }
+
+    void addRealRun(const double *values, int count, Accumulator &accumulator)
+    {
+        double sum = 0;
+        double minimum = values[0];
+        double maximum = values[0];
+        int i = 0;
+#ifdef __SSE2__
+        if (count >= 4)
+        {
+            __m128d sums = _mm_setzero_pd();
+            __m128d lows = _mm_set1_pd(values[0]);
+            __m128d highs = lows;
+            for (; i + 2 <= count; i += 2)
+            {
+                const __m128d value = _mm_loadu_pd(values + i);
+                sums = _mm_add_pd(sums, value);
+                lows = _mm_min_pd(lows, value);
+                highs = _mm_max_pd(highs, value);
+            }
+
+            double lanes[2];
+            _mm_storeu_pd(lanes, sums);
+            sum = lanes[0] + lanes[1];
+            _mm_storeu_pd(lanes, lows);
+            minimum = qMin(lanes[0], lanes[1]);
+            _mm_storeu_pd(lanes, highs);
+            maximum = qMax(lanes[0], lanes[1]);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            sum += values[i];
+            minimum = qMin(minimum, values[i]);
+            maximum = qMax(maximum, values[i]);
+        }
+        accumulator.addNumbers(count, sum, minimum, maximum);
+
+        for (i = 0; i < count; ++i)
+        {
+            accumulator.noteNumber(values[i]);
+        }
+    }
+
+    // Целые складываются точно блоками по IntegerBlock. Блок с большими по модулю значениями
+    // (столбец Integer принимает любые qint64) складывается в double, чтобы не переполнить сумму.
+    // В SSE2 нет сравнения 64-битных целых, поэтому минимум и максимум считаются обычным циклом
+    void addIntegerRun(const qint64 *values, int count, Accumulator &accumulator)
+    {
+        double sum = 0;
+        qint64 minimum = values[0];
+        qint64 maximum = values[0];
+        for (int first = 0; first < count; first += IntegerBlock)
+        {
+            const int last = qMin(first + IntegerBlock, count);
+            qint64 blockMinimum = values[first];
+            qint64 blockMaximum = values[first];
+            for (int i = first + 1; i < last; ++i)
+            {
+                blockMinimum = qMin(blockMinimum, values[i]);
+                blockMaximum = qMax(blockMaximum, values[i]);
+            }
+            minimum = qMin(minimum, blockMinimum);
+            maximum = qMax(maximum, blockMaximum);
+
+            if (blockMaximum > MaxBlockMagnitude || blockMinimum < -MaxBlockMagnitude)
+            {
+                for (int i = first; i < last; ++i)
+                {
+                    sum += static_cast<double>(values[i]);
+                }
+                continue;
+            }
+
+            qint64 blockSum = 0;
+            int i = first;
+#ifdef __SSE2__
+            __m128i sums = _mm_setzero_si128();
+            for (; i + 2 <= last; i += 2)
+            {
+                sums = _mm_add_epi64(sums, _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i)));
+            }
+            qint64 lanes[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+            blockSum = lanes[0] + lanes[1];
+#endif
+            for (; i < last; ++i)
+            {
+                blockSum += values[i];
+            }
+            sum += static_cast<double>(blockSum);
+        }
+        accumulator.addNumbers(count, sum, static_cast<double>(minimum), static_cast<double>(maximum));
+
+        for (int i = 0; i < count; ++i)
+        {
+            accumulator.noteNumber(static_cast<double>(values[i]));
+        }
+    }
+
+    // Строки [first, last) одного столбца плотной таблицы
+    void addRows(const TableColumn &column, int first, int last, Accumulator &accumulator)
+    {
+        const QBitArray &nulls = column.nullMap();
+        const uchar *nullBits = nulls.isEmpty() ? nullptr : reinterpret_cast<const uchar *>(nulls.bits());
+        switch (column.type())
+        {
+        case TableColumn::Integer:
+            forEachRun(nullBits, first, last, [&](int row, int count)
+                       { addIntegerRun(column.integerData() + row, count, accumulator); });
+            break;
+        case TableColumn::Real:
+            forEachRun(nullBits, first, last, [&](int row, int count)
+                       { addRealRun(column.realData() + row, count, accumulator); });
+            break;
+        case TableColumn::Date:
+            forEachRun(nullBits, first, last, [&](int row, int count)
+                       {
+                           for (int i = row; i < row + count; ++i)
+                           {
+                               accumulator.addDate(column.integerAt(i));
+                           }
+                       });
+            break;
+        default:
+            for (int i = first; i < last; ++i)
+            {
+                accumulator.addText(column.rawData(i), column.rawSize(i));
+            }
+            break;
+        }
+    }
+
+    // Одна ячейка — для переставленных строк, где подряд идущих участков нет
+    void addCell(const TableColumn &column, int row, Accumulator &accumulator)
+    {
+        if (column.isEmpty(row))
+            return;
+
+        switch (column.type())
+        {
+        case TableColumn::Integer:
+            accumulator.addNumber(static_cast<double>(column.integerAt(row)));
+            break;
+        case TableColumn::Real:
+            accumulator.addNumber(column.realAt(row));
+            break;
+        case TableColumn::Date:
+            accumulator.addDate(column.integerAt(row));
+            break;
+        default:
+            accumulator.addText(column.rawData(row), column.rawSize(row));
+            break;
+        }
+    }
+
+    bool isStale(const QAtomicInt *generation, int expected)
+    {
+        return generation && generation->loadAcquire() != expected;
+    }
+}
+
+SelectionStats::SelectionStats(QObject *parent) : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<SelectionSummary>::finished, this, [this]()
+            {
+                SelectionSummary summary = watcher.result();
+                if (!summary.cancelled && watchedGeneration == generation.loadAcquire())
+                    emit finished(summary);
+            });
+}
+
+SelectionStats::~SelectionStats()
+{
+    cancel();
+    watcher.waitForFinished();
+}
+
+bool SelectionStats::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+void SelectionStats::compute(const TableData &snapshot, const QVector<int> &rowOrder, const QVector<CellRange> &ranges)
+{
+    const int expected = generation.fetchAndAddOrdered(1) + 1;
+
+    qint64 cells = 0;
+    for (const CellRange &range : ranges)
+    {
+        cells += qint64(range.bottom - range.top + 1) * (range.right - range.left + 1);
+    }
+
+    if (cells <= SyncCells)
+    {
+        emit finished(summarize(snapshot, rowOrder, ranges, nullptr, 0));
+        return;
+    }
+
+    watchedGeneration = expected;
+    watcher.setFuture(QtConcurrent::run(&SelectionStats::summarize, snapshot, rowOrder, ranges, &generation, expected));
+}
+
+void SelectionStats::cancel()
+{
+    generation.ref();
+}
+
+SelectionSummary SelectionStats::summarize(const TableData &snapshot, const QVector<int> &rowOrder, const QVector<CellRange> &ranges,
+                                           const QAtomicInt *generation, int expected)
+{
+    Accumulator accumulator;
+    SelectionSummary cancelled;
+    cancelled.cancelled = true;
+
+    const bool ordered = !rowOrder.isEmpty();
+    const int rows = ordered ? rowOrder.size() : snapshot.rowCount();
+    const int columns = snapshot.columnCount();
+    const QVector<QPair<int, int>> origins = snapshot.isSparse() && !ordered ? snapshot.sparseGrid().chunkOrigins()
+                                                                             : QVector<QPair<int, int>>();
+
+    for (const CellRange &range : ranges)
+    {
+        const int top = qMax(range.top, 0);
+        const int bottom = qMin(range.bottom, rows - 1);
+        const int left = qMax(range.left, 0);
+        const int right = qMin(range.right, columns - 1);
+        if (top > bottom || left > right)
+            continue;
+
+        if (snapshot.isSparse())
+        {
+            const SparseGrid &grid = snapshot.sparseGrid();
+            if (!ordered)
+            {
+                // Пустые блоки ничего не добавляют: обходим только заполненные, пересекающие выделение
+                for (const QPair<int, int> &origin : origins)
+                {
+                    const int firstRow = qMax(top, origin.first);
+                    const int lastRow = qMin(bottom, origin.first + SparseGrid::ChunkRows - 1);
+                    const int firstColumn = qMax(left, origin.second);
+                    const int lastColumn = qMin(right, origin.second + SparseGrid::ChunkColumns - 1);
+                    for (int i = firstRow; i <= lastRow; ++i)
+                    {
+                        for (int j = firstColumn; j <= lastColumn; ++j)
+                        {
+                            const QByteArray bytes = grid.bytes(i, j);
+                            accumulator.addText(bytes.constData(), bytes.size());
+                        }
+                    }
+                    if (isStale(generation, expected))
+                        return cancelled;
+                }
+                continue;
+            }
+
+            for (int i = top; i <= bottom; ++i)
+            {
+                for (int j = left; j <= right; ++j)
+                {
+                    const QByteArray bytes = grid.bytes(rowOrder.at(i), j);
+                    accumulator.addText(bytes.constData(), bytes.size());
+                }
+                if ((i - top) % CheckRows == 0 && isStale(generation, expected))
+                    return cancelled;
+            }
+            continue;
+        }
+
+        for (int j = left; j <= right; ++j)
+        {
+            const TableColumn &column = snapshot.column(j);
+            for (int first = top; first <= bottom; first += CheckRows)
+            {
+                const int last = qMin(first + CheckRows, bottom + 1);
+                if (ordered)
+                {
+                    for (int i = first; i < last; ++i)
+                    {
+                        addCell(column, rowOrder.at(i), accumulator);
+                    }
+                }
+                else
+                {
+                    addRows(column, first, last, accumulator);
+                }
+
+                if (isStale(generation, expected))
+                    return cancelled;
+            }
+        }
+    }
+
+    return accumulator.result();
+}
@@ -0,0 +1,61 @@
+#ifndef SELECTIONSTATS_H
+#define SELECTIONSTATS_H
+
+#include <QObject>
+#include <QVector>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+
+#include "tabledata.h"
+
+// Сводка по выделенным ячейкам для строки состояния
+struct SelectionSummary
+{
+    qint64 count = 0;        // Непустые ячейки
+    qint64 numericCount = 0; // Из них числа (даты не считаются)
+    double sum = 0;
+    double minimum = 0;
+    double maximum = 0;
+    qint64 distinct = 0; // Различные непустые значения
+    bool cancelled = false;
+
+    double mean() const { return numericCount > 0 ? sum / numericCount : 0; }
+};
+
+// Прямоугольник выделения в строках представления, границы включительно
+struct CellRange
+{
+    int top = 0;
+    int left = 0;
+    int bottom = -1;
+    int right = -1;
+};
+
+// Подсчёт сводки по выделению. Небольшое выделение считается сразу, большое — в пуле потоков
+// над снимком TableData; каждое новое выделение отменяет незаконченный подсчёт предыдущего
+class SelectionStats : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SelectionStats(QObject *parent = nullptr);
+    ~SelectionStats() override;
+
+    bool isRunning() const;
+    // rowOrder — порядок строк модели (пустой, если строки не переставлены)
+    void compute(const TableData &snapshot, const QVector<int> &rowOrder, const QVector<CellRange> &ranges);
+    void cancel();
+
+signals:
+    void finished(const SelectionSummary &summary);
+
+private:
+    static SelectionSummary summarize(const TableData &snapshot, const QVector<int> &rowOrder, const QVector<CellRange> &ranges,
+                                      const QAtomicInt *generation, int expected);
+
+    QFutureWatcher<SelectionSummary> watcher;
+    QAtomicInt generation; // Растёт с каждым выделением; подсчёт со старым значением прерывается
+    int watchedGeneration = 0;
+};
+
+#endif // SELECTIONSTATS_H
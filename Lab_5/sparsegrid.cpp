@@ -0,0 +1,224 @@
+#include "sparsegrid.h"
+
+#include <algorithm>
+
+namespace
+{
+    const int ChunkCells = SparseGrid::ChunkRows * SparseGrid::ChunkColumns;
+}
+
+quint64 SparseGrid::key(int row, int column)
+{
+    return (static_cast<quint64>(row / ChunkRows) << 32) | static_cast<quint32>(column / ChunkColumns);
+}
+
+bool SparseGrid::isUsed(const Chunk &chunk, int index)
+{
+    return !chunk.texts.at(index).isEmpty() || (!chunk.styleIds.isEmpty() && chunk.styleIds.at(index) != 0);
+}
+
+QString SparseGrid::text(int row, int column) const
+{
+    QHash<quint64, Chunk>::const_iterator it = chunks.constFind(key(row, column));
+    if (it == chunks.constEnd())
+        return QString();
+    const QByteArray &utf8 = it.value().texts.at(cellIndex(row, column));
+    return utf8.isEmpty() ? QString() : QString::fromUtf8(utf8);
+}
+
+QByteArray SparseGrid::bytes(int row, int column) const
+{
+    QHash<quint64, Chunk>::const_iterator it = chunks.constFind(key(row, column));
+    return it == chunks.constEnd() ? QByteArray() : it.value().texts.at(cellIndex(row, column));
+}
+
+void SparseGrid::setBytes(int row, int column, const QByteArray &utf8)
+{
+    QHash<quint64, Chunk>::iterator it = chunks.find(key(row, column));
+    if (it == chunks.end())
+    {
+        // Пустое значение в пустой области ничего не меняет — блок не заводим
+        if (utf8.isEmpty())
+            return;
+        Chunk chunk;
+        chunk.texts.resize(ChunkCells);
+        it = chunks.insert(key(row, column), chunk);
+    }
+
+    Chunk &chunk = it.value();
+    const int index = cellIndex(row, column);
+    const bool wasUsed = isUsed(chunk, index);
+    chunk.texts[index] = utf8;
+    chunk.used += int(isUsed(chunk, index)) - int(wasUsed);
+    if (chunk.used == 0)
+        chunks.erase(it);
+}
+
+int SparseGrid::styleId(int row, int column) const
+{
+    QHash<quint64, Chunk>::const_iterator it = chunks.constFind(key(row, column));
+    if (it == chunks.constEnd() || it.value().styleIds.isEmpty())
+        return 0;
+    return it.value().styleIds.at(cellIndex(row, column));
+}
+
+void SparseGrid::setStyleId(int row, int column, int id)
+{
+    QHash<quint64, Chunk>::iterator it = chunks.find(key(row, column));
+    if (it == chunks.end())
+    {
+        if (id == 0)
+            return;
+        Chunk chunk;
+        chunk.texts.resize(ChunkCells);
+        it = chunks.insert(key(row, column), chunk);
+    }
+
+    Chunk &chunk = it.value();
+    if (chunk.styleIds.isEmpty())
+    {
+        if (id == 0)
+            return;
+        chunk.styleIds.fill(0, ChunkCells);
+    }
+
+    const int index = cellIndex(row, column);
+    const bool wasUsed = isUsed(chunk, index);
+    styledCells += int(id != 0) - int(chunk.styleIds.at(index) != 0);
+    chunk.styleIds[index] = static_cast<quint16>(id);
+    chunk.used += int(isUsed(chunk, index)) - int(wasUsed);
+    if (chunk.used == 0)
+        chunks.erase(it);
+}
+
+void SparseGrid::clearStyles()
+{
+    QHash<quint64, Chunk>::iterator it = chunks.begin();
+    while (it != chunks.end())
+    {
+        Chunk &chunk = it.value();
+        if (!chunk.styleIds.isEmpty())
+        {
+            chunk.styleIds.clear();
+            chunk.used = 0;
+            for (const QByteArray &utf8 : chunk.texts)
+            {
+                if (!utf8.isEmpty())
+                    ++chunk.used;
+            }
+        }
+        if (chunk.used == 0)
+            it = chunks.erase(it);
+        else
+            ++it;
+    }
+    styledCells = 0;
+}
+
+QVector<QPair<int, int>> SparseGrid::chunkOrigins() const
+{
+    QVector<QPair<int, int>> origins;
+    origins.reserve(chunks.size());
+    for (QHash<quint64, Chunk>::const_iterator it = chunks.constBegin(); it != chunks.constEnd(); ++it)
+    {
+        origins.append(qMakePair(static_cast<int>(it.key() >> 32) * ChunkRows,
+                                 static_cast<int>(it.key() & 0xFFFFFFFFu) * ChunkColumns));
+    }
+    std::sort(origins.begin(), origins.end());
+    return origins;
+}
+
+QVector<QVector<quint16>> SparseGrid::columnStyleIds(int rows, int columns) const
+{
+    QVector<QVector<quint16>> result(columns);
+    if (styledCells == 0)
+        return result;
+
+    for (QHash<quint64, Chunk>::const_iterator it = chunks.constBegin(); it != chunks.constEnd(); ++it)
+    {
+        const Chunk &chunk = it.value();
+        if (chunk.styleIds.isEmpty())
+            continue;
+
+        const int originRow = static_cast<int>(it.key() >> 32) * ChunkRows;
+        const int originColumn = static_cast<int>(it.key() & 0xFFFFFFFFu) * ChunkColumns;
+        for (int i = 0; i < ChunkCells; ++i)
+        {
+            const quint16 id = chunk.styleIds.at(i);
+            const int row = originRow + i / ChunkColumns;
+            const int column = originColumn + i % ChunkColumns;
+            if (id == 0 || row >= rows || column >= columns)
+                continue;
+
+            QVector<quint16> &ids = result[column];
+            if (ids.isEmpty())
+                ids.fill(0, rows);
+            ids[row] = id;
+        }
+    }
+    return result;
+}
+
+void SparseGrid::place(QHash<quint64, Chunk> &target, int row, int column, const QByteArray &utf8, quint16 id)
+{
+    Chunk &chunk = target[key(row, column)];
+    if (chunk.texts.isEmpty())
+        chunk.texts.resize(ChunkCells);
+    if (id != 0 && chunk.styleIds.isEmpty())
+        chunk.styleIds.fill(0, ChunkCells);
+
+    const int index = cellIndex(row, column);
+    chunk.texts[index] = utf8;
+    if (id != 0)
+        chunk.styleIds[index] = id;
+    ++chunk.used;
+}
+
+void SparseGrid::shift(bool vertical, int position, int count, bool remove)
+{
+    // Перестраиваем только блоки на месте вставки и после него; стоящие раньше переносим целиком
+    QHash<quint64, Chunk> moved;
+    moved.reserve(chunks.size());
+    for (QHash<quint64, Chunk>::const_iterator it = chunks.constBegin(); it != chunks.constEnd(); ++it)
+    {
+        const Chunk &chunk = it.value();
+        const int originRow = static_cast<int>(it.key() >> 32) * ChunkRows;
+        const int originColumn = static_cast<int>(it.key() & 0xFFFFFFFFu) * ChunkColumns;
+        const int last = vertical ? originRow + ChunkRows - 1 : originColumn + ChunkColumns - 1;
+        if (last < position)
+        {
+            moved.insert(it.key(), chunk);
+            continue;
+        }
+
+        for (int i = 0; i < ChunkCells; ++i)
+        {
+            const quint16 id = chunk.styleIds.isEmpty() ? 0 : chunk.styleIds.at(i);
+            if (id == 0 && chunk.texts.at(i).isEmpty())
+                continue;
+
+            int row = originRow + i / ChunkColumns;
+            int column = originColumn + i % ChunkColumns;
+            int &coordinate = vertical ? row : column;
+            if (coordinate >= position)
+            {
+                if (!remove)
+                {
+                    coordinate += count;
+                }
+                else if (coordinate < position + count)
+                {
+                    if (id != 0)
+                        --styledCells;
+                    continue;
+                }
+                else
+                {
+                    coordinate -= count;
+                }
+            }
+            place(moved, row, column, chunk.texts.at(i), id);
+        }
+    }
+    chunks = moved;
+}
@@ -0,0 +1,64 @@
+#ifndef SPARSEGRID_H
+#define SPARSEGRID_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+// Разреженное хранение большой, почти пустой таблицы. Сетка делится на блоки
+// ChunkRows x ChunkColumns; в хеше лежат только блоки, где есть текст или оформление,
+// поэтому память растёт с числом заполненных ячеек, а не с размером таблицы.
+// Размер таблицы хранит владелец (TableData), сетка знает только о заполненных ячейках
+class SparseGrid
+{
+public:
+    enum
+    {
+        ChunkRows = 64,
+        ChunkColumns = 16
+    };
+
+    QString text(int row, int column) const;
+    QByteArray bytes(int row, int column) const;
+    void setBytes(int row, int column, const QByteArray &utf8);
+
+    int styleId(int row, int column) const;
+    void setStyleId(int row, int column, int id);
+    bool hasStyles() const { return styledCells > 0; }
+    void clearStyles();
+
+    int chunkCount() const { return chunks.size(); }
+
+    // Левые верхние углы заполненных блоков, по строкам, затем по столбцам
+    QVector<QPair<int, int>> chunkOrigins() const;
+
+    // Номера стилей по столбцам; пустой вектор — столбец без оформления
+    QVector<QVector<quint16>> columnStyleIds(int rows, int columns) const;
+
+    void insertRows(int row, int count) { shift(true, row, count, false); }
+    void removeRows(int row, int count) { shift(true, row, count, true); }
+    void insertColumns(int column, int count) { shift(false, column, count, false); }
+    void removeColumns(int column, int count) { shift(false, column, count, true); }
+
+private:
+    struct Chunk
+    {
+        QVector<QByteArray> texts;  // ChunkRows * ChunkColumns ячеек по строкам
+        QVector<quint16> styleIds;  // Пустой — в блоке нет оформления
+        int used = 0;               // Ячейки с текстом или оформлением
+    };
+
+    static quint64 key(int row, int column);
+    static int cellIndex(int row, int column) { return (row % ChunkRows) * ChunkColumns + column % ChunkColumns; }
+
+    static bool isUsed(const Chunk &chunk, int index);
+    static void place(QHash<quint64, Chunk> &target, int row, int column, const QByteArray &utf8, quint16 id);
+    void shift(bool vertical, int position, int count, bool remove);
+
+    QHash<quint64, Chunk> chunks;
+    int styledCells = 0;
+};
+
+#endif // SPARSEGRID_H
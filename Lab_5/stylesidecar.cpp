@@ -0,0 +1,193 @@
+#include "stylesidecar.h"
+
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QHash>
+#include <algorithm>
+
+namespace
+{
+    const quint32 Magic = 0x54544553; // "TTES"
+    const quint16 Version = 1;
+}
+
+bool StyleSidecar::write(QIODevice *device, const TableData &table)
+{
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << Magic << Version;
+    out << static_cast<qint32>(table.rowCount()) << static_cast<qint32>(table.columnCount());
+
+    const QVector<CellStyle> &palette = table.palette();
+    out << static_cast<quint32>(palette.size());
+    for (const CellStyle &style : palette)
+    {
+        out << style.foreground << style.background << style.hasFont << style.font << static_cast<qint32>(style.alignment);
+    }
+
+    // Серии идут по столбцам подряд и могут переходить через границу столбца.
+    // У разреженных таблиц пустые области бывают длиннее quint32 — такие серии дробим
+    quint64 runLength = 0;
+    quint16 runId = 0;
+    auto flushRun = [&out, &runLength, &runId]()
+    {
+        while (runLength > 0)
+        {
+            const quint32 length = static_cast<quint32>(qMin<quint64>(runLength, 0xFFFFFFFFu));
+            out << length << runId;
+            runLength -= length;
+        }
+    };
+
+    const quint64 rows = static_cast<quint64>(table.rowCount());
+    const QVector<QVector<quint16>> columnStyles = table.columnStyleIds();
+    for (const QVector<quint16> &ids : columnStyles)
+    {
+        if (ids.isEmpty())
+        {
+            if (runId != 0)
+            {
+                flushRun();
+                runId = 0;
+            }
+            runLength += rows;
+            continue;
+        }
+
+        for (quint16 id : ids)
+        {
+            if (id == runId)
+            {
+                ++runLength;
+                continue;
+            }
+            flushRun();
+            runId = id;
+            runLength = 1;
+        }
+    }
+    flushRun();
+
+    return out.status() == QDataStream::Ok;
+}
+
+bool StyleSidecar::read(QIODevice *device)
+{
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+    if (magic != Magic || version == 0 || version > Version)
+        return false;
+
+    qint32 rowCount = 0;
+    qint32 columnCount = 0;
+    quint32 paletteSize = 0;
+    in >> rowCount >> columnCount >> paletteSize;
+    if (in.status() != QDataStream::Ok || rowCount < 0 || columnCount < 0 || paletteSize == 0 || paletteSize > 0x10000)
+        return false;
+
+    rows = rowCount;
+    columns = columnCount;
+    palette.clear();
+    palette.reserve(static_cast<int>(paletteSize));
+    for (quint32 i = 0; i < paletteSize; ++i)
+    {
+        CellStyle style;
+        qint32 alignment = 0;
+        in >> style.foreground >> style.background >> style.hasFont >> style.font >> alignment;
+        style.alignment = alignment;
+        palette.append(style);
+    }
+
+    columnStyles.clear();
+    columnStyles.resize(columns);
+    if (rows == 0 || columns == 0)
+        return in.status() == QDataStream::Ok;
+
+    // Разворачиваем серии прямо в номера стилей столбцов
+    int column = 0;
+    int row = 0;
+    while (column < columns)
+    {
+        quint32 length = 0;
+        quint16 id = 0;
+        in >> length >> id;
+        if (in.status() != QDataStream::Ok || length == 0)
+            return false;
+        if (id >= paletteSize)
+            id = 0;
+
+        while (length > 0 && column < columns)
+        {
+            const int take = static_cast<int>(qMin<quint32>(length, static_cast<quint32>(rows - row)));
+            if (id != 0)
+            {
+                QVector<quint16> &ids = columnStyles[column];
+                if (ids.isEmpty())
+                    ids.fill(0, rows);
+                std::fill(ids.begin() + row, ids.begin() + row + take, id);
+            }
+            row += take;
+            length -= static_cast<quint32>(take);
+            if (row == rows)
+            {
+                row = 0;
+                ++column;
+            }
+        }
+    }
+    return true;
+}
+
+bool StyleSidecar::readLegacyJson(const QByteArray &json, int tableRows, int tableColumns)
+{
+    QJsonDocument settingsDoc = QJsonDocument::fromJson(json);
+    if (!settingsDoc.isArray())
+        return false;
+
+    rows = tableRows;
+    columns = tableColumns;
+    palette.clear();
+    palette.append(CellStyle());
+    columnStyles.clear();
+    columnStyles.resize(columns);
+
+    // Одинаковые объекты настроек сводим к одному стилю палитры
+    QHash<CellStyle, int> index;
+    index.insert(CellStyle(), 0);
+
+    QJsonArray cellSettingsArray = settingsDoc.array();
+    const int settingsRows = qMin(cellSettingsArray.size(), rows);
+    for (int i = 0; i < settingsRows; ++i)
+    {
+        QJsonArray rowSettings = cellSettingsArray[i].toArray();
+        const int settingsColumns = qMin(rowSettings.size(), columns);
+        for (int j = 0; j < settingsColumns; ++j)
+        {
+            CellStyle style = CellStyle::fromJson(rowSettings[j].toObject());
+            if (style.isEmpty())
+                continue;
+
+            int id = index.value(style, -1);
+            if (id == -1)
+            {
+                if (palette.size() >= 0xFFFF)
+                    continue;
+                id = palette.size();
+                palette.append(style);
+                index.insert(style, id);
+            }
+
+            QVector<quint16> &ids = columnStyles[j];
+            if (ids.isEmpty())
+                ids.fill(0, rows);
+            ids[i] = static_cast<quint16>(id);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef STYLESIDECAR_H
+#define STYLESIDECAR_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QVector>
+
+#include "tabledata.h"
+
+// Файл оформления таблицы (tabSettings/<имя>.styles). Формат двоичный и версионный:
+//   заголовок: сигнатура, версия, число строк и столбцов;
+//   палитра уникальных стилей (стиль 0 — по умолчанию);
+//   серии (длина, номер стиля), которые покрывают ячейки по столбцам сверху вниз.
+// Одинаково оформленные области сворачиваются в одну серию, файл читается за один проход
+class StyleSidecar
+{
+public:
+    int rows = 0;
+    int columns = 0;
+    QVector<CellStyle> palette;
+    QVector<QVector<quint16>> columnStyles; // Пустой вектор — столбец без оформления
+
+    static bool write(QIODevice *device, const TableData &table);
+    bool read(QIODevice *device);
+
+    // Старый формат: JSON-массив строк с объектом настроек на каждую ячейку
+    bool readLegacyJson(const QByteArray &json, int tableRows, int tableColumns);
+};
+
+#endif // STYLESIDECAR_H
@@ -0,0 +1,267 @@
+#include "tableaggregate.h"
+
+#include <QHash>
+#include <QThread>
+#include <QtConcurrent>
+#include <cstring>
+
+namespace
+{
+    const int MinRowsPerTask = 64 * 1024;
+
+    struct AggregateState
+    {
+        qint64 rows = 0;    // Все строки группы
+        qint64 values = 0;  // Непустые ячейки
+        qint64 numbers = 0; // Из них числа
+        double sum = 0;
+        double minimum = 0;
+        double maximum = 0;
+
+        void addNumber(double value)
+        {
+            minimum = numbers == 0 ? value : qMin(minimum, value);
+            maximum = numbers == 0 ? value : qMax(maximum, value);
+            sum += value;
+            ++numbers;
+        }
+
+        void merge(const AggregateState &other)
+        {
+            if (other.numbers > 0)
+            {
+                minimum = numbers == 0 ? other.minimum : qMin(minimum, other.minimum);
+                maximum = numbers == 0 ? other.maximum : qMax(maximum, other.maximum);
+            }
+            rows += other.rows;
+            values += other.values;
+            numbers += other.numbers;
+            sum += other.sum;
+        }
+    };
+
+    // Группы одной части строк: ключи, представители и состояния (specs.size() на группу подряд)
+    struct PartialGroups
+    {
+        QHash<QByteArray, int> index;
+        QVector<QByteArray> keys;
+        QVector<int> firstRows;
+        QVector<AggregateState> states;
+        QVector<int> rowGroups; // Группа каждой строки части, если нужна привязка строк к группам
+    };
+
+    // Ключ группы — значения ключевых столбцов подряд: у типизированных столбцов признак пустоты
+    // и 8 байт значения, у текстовых длина и байты UTF-8. Такой ключ однозначен и без разделителей
+    void appendKey(QByteArray &key, const TableData &snapshot, int column, int row)
+    {
+        if (!snapshot.isSparse())
+        {
+            const TableColumn &cells = snapshot.column(column);
+            if (cells.type() != TableColumn::Text)
+            {
+                const bool empty = cells.isEmpty(row);
+                key.append(empty ? '\0' : '\1');
+                if (!empty)
+                {
+                    char value[8];
+                    if (cells.type() == TableColumn::Real)
+                        std::memcpy(value, cells.realData() + row, sizeof(value));
+                    else
+                        std::memcpy(value, cells.integerData() + row, sizeof(value));
+                    key.append(value, sizeof(value));
+                }
+                return;
+            }
+
+            const qint32 size = cells.rawSize(row);
+            key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+            key.append(cells.rawData(row), size);
+            return;
+        }
+
+        const QByteArray bytes = snapshot.sparseGrid().bytes(row, column);
+        const qint32 size = bytes.size();
+        key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        key.append(bytes);
+    }
+
+    void accumulate(AggregateState &state, const TableData &snapshot, int column, int row)
+    {
+        ++state.rows;
+        if (snapshot.isSparse())
+        {
+            const QByteArray bytes = snapshot.sparseGrid().bytes(row, column);
+            if (bytes.isEmpty())
+                return;
+            ++state.values;
+            bool ok = false;
+            const double value = bytes.toDouble(&ok);
+            if (ok && qIsFinite(value))
+                state.addNumber(value);
+            return;
+        }
+
+        const TableColumn &cells = snapshot.column(column);
+        if (cells.isEmpty(row))
+            return;
+        ++state.values;
+        bool ok = false;
+        const double value = cells.number(row, &ok);
+        if (ok && qIsFinite(value))
+            state.addNumber(value);
+    }
+
+    PartialGroups groupRange(const TableData &snapshot, const QVector<int> &rows, int first, int last,
+                             const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs, bool trackRows)
+    {
+        PartialGroups partial;
+        if (trackRows)
+            partial.rowGroups.reserve(last - first);
+        const int width = specs.size();
+        QByteArray key;
+        for (int i = first; i < last; ++i)
+        {
+            const int row = rows.at(i);
+            key.resize(0);
+            for (int column : groupColumns)
+            {
+                appendKey(key, snapshot, column, row);
+            }
+
+            int group = partial.index.value(key, -1);
+            if (group < 0)
+            {
+                group = partial.firstRows.size();
+                partial.index.insert(key, group);
+                partial.keys.append(key);
+                partial.firstRows.append(row);
+                partial.states.resize(partial.states.size() + width);
+            }
+            if (trackRows)
+                partial.rowGroups.append(group);
+
+            AggregateState *states = partial.states.data() + group * width;
+            for (int k = 0; k < width; ++k)
+            {
+                if (specs.at(k).function == AggregateSpec::CountAll)
+                    ++states[k].rows;
+                else
+                    accumulate(states[k], snapshot, specs.at(k).column, row);
+            }
+        }
+        return partial;
+    }
+
+    QByteArray formatNumber(double value)
+    {
+        return QByteArray::number(value, 'f', QLocale::FloatingPointShortest);
+    }
+}
+
+GroupedRows TableAggregate::aggregate(const TableData &snapshot, const QVector<int> &rows,
+                                      const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs,
+                                      QVector<int> *rowGroups)
+{
+    const bool trackRows = rowGroups != nullptr;
+    const int parts = qMax(1, QThread::idealThreadCount());
+    const int step = qMax(MinRowsPerTask, (rows.size() + parts - 1) / parts);
+    QList<QFuture<PartialGroups>> pending;
+    for (int first = 0; first < rows.size(); first += step)
+    {
+        const int last = qMin(first + step, rows.size());
+        pending.append(QtConcurrent::run([&snapshot, &rows, &groupColumns, &specs, first, last, trackRows]()
+                                         { return groupRange(snapshot, rows, first, last, groupColumns, specs, trackRows); }));
+    }
+
+    // Слияние по порядку частей сохраняет порядок первого появления групп
+    const int width = specs.size();
+    PartialGroups merged;
+    if (trackRows)
+        rowGroups->fill(-1, snapshot.rowCount());
+    int offset = 0;
+    for (QFuture<PartialGroups> &future : pending)
+    {
+        const PartialGroups partial = future.result();
+        if (pending.size() == 1)
+        {
+            merged = partial;
+            for (int i = 0; i < partial.rowGroups.size(); ++i)
+            {
+                (*rowGroups)[rows.at(i)] = partial.rowGroups.at(i);
+            }
+            break;
+        }
+
+        QVector<int> mergedGroups(partial.keys.size());
+        for (int g = 0; g < partial.keys.size(); ++g)
+        {
+            int group = merged.index.value(partial.keys.at(g), -1);
+            if (group < 0)
+            {
+                group = merged.firstRows.size();
+                merged.index.insert(partial.keys.at(g), group);
+                merged.keys.append(partial.keys.at(g));
+                merged.firstRows.append(partial.firstRows.at(g));
+                merged.states.resize(merged.states.size() + width);
+            }
+            for (int k = 0; k < width; ++k)
+            {
+                merged.states[group * width + k].merge(partial.states.at(g * width + k));
+            }
+            mergedGroups[g] = group;
+        }
+
+        // Номера групп части переводятся в общие
+        for (int i = 0; i < partial.rowGroups.size(); ++i)
+        {
+            (*rowGroups)[rows.at(offset + i)] = mergedGroups.at(partial.rowGroups.at(i));
+        }
+        offset += partial.rowGroups.size();
+    }
+
+    if (groupColumns.isEmpty() && merged.firstRows.isEmpty())
+    {
+        merged.firstRows.append(-1);
+        merged.states.resize(width);
+    }
+
+    GroupedRows result;
+    result.firstRows = merged.firstRows;
+    const int groups = merged.firstRows.size();
+    for (int k = 0; k < width; ++k)
+    {
+        // Значения пишутся текстом и типизируются тем же выводом, что и у загруженных столбцов
+        TableColumn column;
+        column.reserve(groups, groups * 8);
+        for (int g = 0; g < groups; ++g)
+        {
+            const AggregateState &state = merged.states.at(g * width + k);
+            QByteArray value;
+            switch (specs.at(k).function)
+            {
+            case AggregateSpec::CountAll:
+                value = QByteArray::number(state.rows);
+                break;
+            case AggregateSpec::Count:
+                value = QByteArray::number(state.values);
+                break;
+            case AggregateSpec::Sum:
+                value = state.numbers > 0 ? formatNumber(state.sum) : QByteArray();
+                break;
+            case AggregateSpec::Min:
+                value = state.numbers > 0 ? formatNumber(state.minimum) : QByteArray();
+                break;
+            case AggregateSpec::Max:
+                value = state.numbers > 0 ? formatNumber(state.maximum) : QByteArray();
+                break;
+            case AggregateSpec::Average:
+                value = state.numbers > 0 ? formatNumber(state.sum / state.numbers) : QByteArray();
+                break;
+            }
+            column.append(value.constData(), value.size());
+        }
+        column.inferType();
+        result.aggregates.append(column);
+    }
+    return result;
+}
@@ -0,0 +1,45 @@
+#ifndef TABLEAGGREGATE_H
+#define TABLEAGGREGATE_H
+
+#include <QVector>
+
+#include "tabledata.h"
+
+// Агрегатная функция над столбцом; числа берутся из числовых ячеек, остальные пропускаются
+struct AggregateSpec
+{
+    enum Function
+    {
+        CountAll, // COUNT(*) — все строки группы, column не используется
+        Count,    // Непустые ячейки
+        Sum,
+        Min,
+        Max,
+        Average
+    };
+
+    Function function = CountAll;
+    int column = 0;
+};
+
+// Группы в порядке первого появления: строка-представитель (для значений ключевых столбцов)
+// и готовые столбцы агрегатов
+struct GroupedRows
+{
+    QVector<int> firstRows;
+    QVector<TableColumn> aggregates;
+};
+
+// Группировка по хешу ключа. Строки делятся на части, каждая часть собирает свою хеш-таблицу
+// групп и частичные агрегаты в пуле потоков, затем частичные результаты сливаются по порядку
+class TableAggregate
+{
+public:
+    // Без ключевых столбцов все строки — одна группа (даже если строк нет).
+    // rowGroups, если задан, получает номер группы для каждой строки snapshot (-1 — строки нет в rows)
+    static GroupedRows aggregate(const TableData &snapshot, const QVector<int> &rows,
+                                 const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs,
+                                 QVector<int> *rowGroups = nullptr);
+};
+
+#endif // TABLEAGGREGATE_H
@@ -0,0 +1,171 @@
+#include "tableclipboard.h"
+#include "csvtokenizer.h"
+
+#include <QThread>
+#include <QHash>
+#include <QtConcurrent>
+
+namespace
+{
+    const int MinRowsPerTask = 16 * 1024; // Меньшие куски не окупают передачу в другой поток
+    const int MaxBytes = 256 * 1024 * 1024; // Больше не копируем: в UTF-16 буфера обмена текст станет вдвое длиннее
+
+    // Номер полосы строк разреженной таблицы -> первые столбцы её заполненных блоков в диапазоне
+    typedef QHash<int, QVector<int>> SparseBands;
+
+    SparseBands sparseBands(const SparseGrid &grid, const CellRange &range)
+    {
+        SparseBands bands;
+        for (const QPair<int, int> &origin : grid.chunkOrigins())
+        {
+            if (origin.second + SparseGrid::ChunkColumns > range.left && origin.second <= range.right)
+                bands[origin.first / SparseGrid::ChunkRows].append(origin.second);
+        }
+        return bands;
+    }
+
+    // Строка разреженной таблицы: пустые ячейки дают только разделители, текст берётся
+    // из заполненных блоков полосы
+    void formatSparseRow(QByteArray &out, const TableData &snapshot, const SparseBands &bands, const CellRange &range,
+                         int row, const CsvTokenizer &tokenizer)
+    {
+        int last = range.left;
+        const auto band = bands.constFind(row / SparseGrid::ChunkRows);
+        if (band != bands.constEnd())
+        {
+            for (int origin : band.value())
+            {
+                const int stop = qMin(origin + SparseGrid::ChunkColumns - 1, range.right);
+                for (int j = qMax(origin, range.left); j <= stop; ++j)
+                {
+                    const QByteArray bytes = snapshot.bytes(row, j);
+                    if (bytes.isEmpty())
+                        continue;
+                    out.append(j - last, '\t');
+                    tokenizer.appendField(out, bytes);
+                    last = j;
+                }
+            }
+        }
+        out.append(range.right - last, '\t');
+    }
+
+    char guessDelimiter(const QByteArray &utf8)
+    {
+        const int lineEnd = utf8.indexOf('\n');
+        const QByteArray firstLine = lineEnd < 0 ? utf8 : utf8.left(lineEnd);
+        if (firstLine.contains('\t'))
+            return '\t';
+        if (firstLine.contains(';') && !firstLine.contains(','))
+            return ';';
+        return ',';
+    }
+
+    QByteArray formatRows(const TableData &snapshot, const QVector<int> &rowOrder, const SparseBands &bands,
+                          const CellRange &range, int first, int last)
+    {
+        CsvTokenizer tokenizer('\t');
+        QByteArray out;
+        for (int i = first; i <= last && out.size() <= MaxBytes; ++i)
+        {
+            const int row = rowOrder.isEmpty() ? i : rowOrder.at(i);
+            if (snapshot.isSparse())
+            {
+                formatSparseRow(out, snapshot, bands, range, row, tokenizer);
+                out.append('\n');
+                continue;
+            }
+            for (int j = range.left; j <= range.right; ++j)
+            {
+                if (j > range.left)
+                    out.append('\t');
+                if (!snapshot.isSparse() && snapshot.column(j).type() == TableColumn::Text)
+                    tokenizer.appendField(out, snapshot.column(j).rawData(row), snapshot.column(j).rawSize(row));
+                else
+                    tokenizer.appendField(out, snapshot.bytes(row, j));
+            }
+            out.append('\n');
+        }
+        return out;
+    }
+}
+
+ClipboardTable TableClipboard::parse(const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    CsvTokenizer tokenizer(guessDelimiter(utf8));
+    QVector<CsvField> fields;
+    ClipboardTable table;
+    const char *end = utf8.constData() + utf8.size();
+    for (const char *pos = utf8.constData(); pos < end;)
+    {
+        pos = tokenizer.readRecord(pos, end, fields);
+
+        // Строка шире прежних: новые столбцы сверху дополняются пустыми ячейками
+        if (fields.size() > table.columns.size())
+        {
+            const int known = table.columns.size();
+            table.columns.resize(fields.size());
+            for (int j = known; j < table.columns.size(); ++j)
+            {
+                table.columns[j].resize(table.rowCount);
+            }
+        }
+
+        for (int j = 0; j < table.columns.size(); ++j)
+        {
+            if (j >= fields.size())
+            {
+                table.columns[j].append("", 0);
+            }
+            else if (fields.at(j).escaped)
+            {
+                const QByteArray bytes = tokenizer.fieldBytes(fields.at(j));
+                table.columns[j].append(bytes.constData(), bytes.size());
+            }
+            else
+            {
+                table.columns[j].append(fields.at(j).data, fields.at(j).size);
+            }
+        }
+        ++table.rowCount;
+    }
+    return table;
+}
+
+QByteArray TableClipboard::format(const TableData &snapshot, const QVector<int> &rowOrder, const CellRange &range)
+{
+    // Один разделитель на ячейку уже больше предела — форматировать нечего
+    const int rows = range.bottom - range.top + 1;
+    if (static_cast<qint64>(rows) * (range.right - range.left + 1) > MaxBytes)
+        return QByteArray();
+
+    const SparseBands bands = snapshot.isSparse() ? sparseBands(snapshot.sparseGrid(), range) : SparseBands();
+    const int parts = qMax(1, QThread::idealThreadCount());
+    const int step = qMax(MinRowsPerTask, (rows + parts - 1) / parts);
+    QList<QFuture<QByteArray>> pending;
+    for (int first = range.top; first <= range.bottom; first += step)
+    {
+        const int last = qMin(first + step - 1, range.bottom);
+        pending.append(QtConcurrent::run([&snapshot, &rowOrder, &bands, &range, first, last]()
+                                         { return formatRows(snapshot, rowOrder, bands, range, first, last); }));
+    }
+
+    QList<QByteArray> results;
+    qint64 total = 0;
+    for (QFuture<QByteArray> &part : pending)
+    {
+        results.append(part.result());
+        total += results.last().size();
+    }
+    if (total > MaxBytes)
+        return QByteArray();
+
+    QByteArray tsv;
+    tsv.reserve(static_cast<int>(total));
+    for (const QByteArray &part : results)
+    {
+        tsv += part;
+    }
+    return tsv;
+}
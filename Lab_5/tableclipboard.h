@@ -0,0 +1,32 @@
+#ifndef TABLECLIPBOARD_H
+#define TABLECLIPBOARD_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "tabledata.h"
+#include "selectionstats.h"
+
+// Прямоугольник ячеек из буфера обмена, по столбцам; короткие строки дополнены пустыми ячейками
+struct ClipboardTable
+{
+    QVector<TableColumn> columns;
+    int rowCount = 0;
+};
+
+// Обмен диапазонами таблицы с другими программами в виде TSV (как в электронных таблицах)
+class TableClipboard
+{
+public:
+    // Разделитель угадывается по первой строке: табуляция, иначе точка с запятой или запятая.
+    // Поля в кавычках могут содержать разделители и переводы строк
+    static ClipboardTable parse(const QString &text);
+
+    // Диапазон в строках представления (rowOrder пуст — исходный порядок) в TSV;
+    // куски строк форматируются в пуле потоков. У разреженной таблицы ячейки ищутся только
+    // в заполненных блоках. Пустой результат — текст не уместился бы в буфер обмена
+    static QByteArray format(const TableData &snapshot, const QVector<int> &rowOrder, const CellRange &range);
+};
+
+#endif // TABLECLIPBOARD_H
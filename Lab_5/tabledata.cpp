@@ -0,0 +1,811 @@
+#include "tabledata.h"
+
+#include <QDebug>
+#include <QDate>
+#include <QLocale>
+#include <QtNumeric>
+#include <cstring>
+#include <climits>
+
+namespace
+{
+    const int CompactThreshold = 64 * 1024; // Меньшие буферы не сжимаем: выигрыш не стоит копирования
+    const int MaxStyles = 0xFFFF;           // Номер стиля хранится в quint16
+    const qint64 MaxExactInteger = Q_INT64_C(1) << 53;
+
+    // Дробные числа записываем кратчайшим видом без экспоненты: так выглядят почти все выгрузки
+    QByteArray formatReal(double value)
+    {
+        return QByteArray::number(value, 'f', QLocale::FloatingPointShortest);
+    }
+
+    // Разбор текста ячейки как значения типа. Годится только текст, который
+    // обратное форматирование восстановит байт в байт, иначе файл изменился бы при сохранении
+    bool parseValue(TableColumn::Type type, const char *data, int size, qint64 &integer, double &real)
+    {
+        const QByteArray raw = QByteArray::fromRawData(data, size);
+        bool ok = false;
+        switch (type)
+        {
+        case TableColumn::Integer:
+            if (size > 20)
+                return false;
+            integer = raw.toLongLong(&ok);
+            return ok && QByteArray::number(integer) == raw;
+        case TableColumn::Real:
+            real = raw.toDouble(&ok);
+            return ok && qIsFinite(real) && formatReal(real) == raw;
+        case TableColumn::Date:
+        {
+            if (size != 10 || data[4] != '-' || data[7] != '-')
+                return false;
+            QDate date = QDate::fromString(QString::fromLatin1(data, size), Qt::ISODate);
+            integer = date.toJulianDay();
+            return date.isValid() && date.toString(Qt::ISODate).toLatin1() == raw;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // QBitArray не умеет вставлять и удалять биты: собираем новый массив. Пустой bits — все биты сброшены
+    QBitArray spliceBits(const QBitArray &bits, int size, int position, int removed, int insertedCount, const QBitArray &inserted)
+    {
+        QBitArray result(size - removed + insertedCount);
+        if (!bits.isEmpty())
+        {
+            for (int i = 0; i < position; ++i)
+            {
+                if (bits.testBit(i))
+                    result.setBit(i);
+            }
+            for (int i = position + removed; i < size; ++i)
+            {
+                if (bits.testBit(i))
+                    result.setBit(i - removed + insertedCount);
+            }
+        }
+        if (!inserted.isEmpty())
+        {
+            for (int i = 0; i < insertedCount; ++i)
+            {
+                if (inserted.testBit(i))
+                    result.setBit(position + i);
+            }
+        }
+        return result;
+    }
+}
+
+bool CellStyle::isEmpty() const
+{
+    return !foreground.isValid() && !background.isValid() && !hasFont && alignment == 0;
+}
+
+QJsonObject CellStyle::toJson() const
+{
+    QJsonObject cellSettings;
+    if (foreground.isValid())
+        cellSettings["textColor"] = foreground.name();
+    if (background.isValid())
+        cellSettings["backgroundColor"] = background.name();
+    if (hasFont)
+        cellSettings["font"] = font.toString();
+    if (alignment)
+        cellSettings["alignment"] = alignment;
+    return cellSettings;
+}
+
+CellStyle CellStyle::fromJson(const QJsonObject &cellSettings)
+{
+    CellStyle style;
+    style.foreground = QColor(cellSettings["textColor"].toString());
+    style.background = QColor(cellSettings["backgroundColor"].toString());
+    if (cellSettings.contains("font"))
+        style.hasFont = style.font.fromString(cellSettings["font"].toString());
+    style.alignment = cellSettings["alignment"].toInt();
+    return style;
+}
+
+bool CellStyle::operator==(const CellStyle &other) const
+{
+    return foreground == other.foreground && background == other.background && hasFont == other.hasFont && (!hasFont || font == other.font) && alignment == other.alignment;
+}
+
+uint qHash(const CellStyle &style, uint seed)
+{
+    uint hash = seed;
+    hash = hash * 31 + (style.foreground.isValid() ? style.foreground.rgba() : 0u);
+    hash = hash * 31 + (style.background.isValid() ? style.background.rgba() : 0u);
+    hash = hash * 31 + (style.hasFont ? qHash(style.font) : 0u);
+    hash = hash * 31 + static_cast<uint>(style.alignment);
+    return hash;
+}
+
+int TableColumn::size() const
+{
+    switch (columnType)
+    {
+    case Integer:
+    case Date:
+        return integers.size();
+    case Real:
+        return reals.size();
+    default:
+        return cells.size();
+    }
+}
+
+QString TableColumn::text(int row) const
+{
+    if (columnType != Text)
+        return QString::fromLatin1(bytes(row));
+    const CellRef &ref = cells.at(row);
+    return ref.size ? QString::fromUtf8(arena.constData() + ref.offset, ref.size) : QString();
+}
+
+QByteArray TableColumn::bytes(int row) const
+{
+    if (columnType == Text)
+    {
+        const CellRef &ref = cells.at(row);
+        return arena.mid(ref.offset, ref.size);
+    }
+    if (isEmpty(row))
+        return QByteArray();
+
+    switch (columnType)
+    {
+    case Integer:
+        return QByteArray::number(integers.at(row));
+    case Real:
+        return formatReal(reals.at(row));
+    default:
+        return QDate::fromJulianDay(integers.at(row)).toString(Qt::ISODate).toLatin1();
+    }
+}
+
+bool TableColumn::isEmpty(int row) const
+{
+    if (columnType == Text)
+        return cells.at(row).size == 0;
+    return !nulls.isEmpty() && nulls.testBit(row);
+}
+
+double TableColumn::number(int row, bool *ok) const
+{
+    if (columnType == Integer || columnType == Real)
+    {
+        *ok = !isEmpty(row);
+        return columnType == Integer ? static_cast<double>(integers.at(row)) : reals.at(row);
+    }
+    if (columnType == Date)
+    {
+        *ok = false;
+        return 0;
+    }
+    const CellRef &ref = cells.at(row);
+    return QByteArray::fromRawData(arena.constData() + ref.offset, ref.size).toDouble(ok);
+}
+
+void TableColumn::setStyleId(int row, int id)
+{
+    if (styleIds.isEmpty())
+    {
+        if (id == 0)
+            return;
+        styleIds.fill(0, size());
+    }
+    styleIds[row] = static_cast<quint16>(id);
+}
+
+void TableColumn::inferType()
+{
+    if (columnType != Text || cells.isEmpty())
+        return;
+
+    // Текстовый столбец отсеивается уже на первой непустой ячейке, поэтому перебор дешёвый
+    if (!convertTo(Integer) && !convertTo(Real))
+        convertTo(Date);
+}
+
+bool TableColumn::convertTo(Type target)
+{
+    const int rows = cells.size();
+    QVector<qint64> values;
+    QVector<double> realValues;
+    QBitArray empty;
+    if (target == Real)
+        realValues.resize(rows);
+    else
+        values.resize(rows);
+
+    bool hasValues = false;
+    for (int i = 0; i < rows; ++i)
+    {
+        const CellRef &ref = cells.at(i);
+        if (ref.size == 0)
+        {
+            if (empty.isEmpty())
+                empty.resize(rows);
+            empty.setBit(i);
+            continue;
+        }
+
+        qint64 integer = 0;
+        double real = 0;
+        if (!parseValue(target, arena.constData() + ref.offset, ref.size, integer, real))
+            return false;
+        if (target == Real)
+            realValues[i] = real;
+        else
+            values[i] = integer;
+        hasValues = true;
+    }
+
+    // Совсем пустой столбец оставляем текстовым: по нему тип не определить
+    if (!hasValues)
+        return false;
+
+    columnType = target;
+    integers = values;
+    reals = realValues;
+    nulls = empty;
+    arena.clear();
+    cells.clear();
+    garbage = 0;
+    return true;
+}
+
+bool TableColumn::promoteToReal()
+{
+    // Целые до 2^53 представимы в double точно и записываются так же, как раньше
+    if (columnType != Integer)
+        return columnType == Real;
+
+    QVector<double> values(integers.size());
+    for (int i = 0; i < integers.size(); ++i)
+    {
+        if (qAbs(integers.at(i)) > MaxExactInteger)
+            return false;
+        values[i] = static_cast<double>(integers.at(i));
+    }
+    columnType = Real;
+    reals = values;
+    integers.clear();
+    return true;
+}
+
+void TableColumn::convertToText()
+{
+    if (columnType == Text)
+        return;
+
+    const int rows = size();
+    QByteArray packed;
+    QVector<CellRef> refs(rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        const QByteArray value = bytes(i);
+        refs[i].offset = packed.size();
+        refs[i].size = value.size();
+        packed.append(value);
+    }
+
+    columnType = Text;
+    arena = packed;
+    cells = refs;
+    integers.clear();
+    reals.clear();
+    nulls.clear();
+    garbage = 0;
+}
+
+void TableColumn::setNull(int row, bool null)
+{
+    if (nulls.isEmpty())
+    {
+        if (!null)
+            return;
+        nulls.resize(size());
+    }
+    nulls.setBit(row, null);
+}
+
+void TableColumn::append(const char *data, int size)
+{
+    Q_ASSERT(columnType == Text);
+    CellRef ref;
+    ref.offset = arena.size();
+    ref.size = size;
+    arena.append(data, size);
+    cells.append(ref);
+}
+
+void TableColumn::append(const TableColumn &other)
+{
+    const int added = other.size();
+    if (added == 0)
+        return;
+
+    // Блоки одного столбца могли получить разные типы — приводим к общему
+    TableColumn tail = other;
+    const int first = size();
+    if (first == 0)
+    {
+        *this = TableColumn();
+        columnType = tail.columnType;
+    }
+    else if (tail.columnType != columnType)
+    {
+        if (!(promoteToReal() && tail.promoteToReal()))
+        {
+            convertToText();
+            tail.convertToText();
+        }
+    }
+
+    if (!styleIds.isEmpty() || !tail.styleIds.isEmpty())
+    {
+        styleIds.resize(first);
+        if (tail.styleIds.isEmpty())
+            styleIds.insert(first, added, 0);
+        else
+            styleIds.append(tail.styleIds);
+    }
+
+    switch (columnType)
+    {
+    case Integer:
+    case Date:
+        integers += tail.integers;
+        break;
+    case Real:
+        reals += tail.reals;
+        break;
+    default:
+    {
+        const int base = arena.size();
+        arena.append(tail.arena);
+        garbage += tail.garbage;
+        cells.append(tail.cells);
+        CellRef *ref = cells.data() + first;
+        CellRef *end = cells.data() + cells.size();
+        for (; ref != end; ++ref)
+        {
+            ref->offset += base;
+        }
+        return;
+    }
+    }
+
+    if (!nulls.isEmpty() || !tail.nulls.isEmpty())
+        nulls = spliceBits(nulls, first, first, 0, added, tail.nulls);
+}
+
+TableColumn TableColumn::gather(const QVector<int> &rows) const
+{
+    TableColumn result;
+    result.columnType = columnType;
+    const int count = rows.size();
+
+    if (columnType == Text)
+    {
+        qint64 bytes = 0;
+        for (int row : rows)
+        {
+            if (row >= 0)
+                bytes += cells.at(row).size;
+        }
+        result.cells.reserve(count);
+        result.arena.reserve(static_cast<int>(qMin<qint64>(bytes, INT_MAX)));
+        for (int row : rows)
+        {
+            if (row < 0)
+                result.append(nullptr, 0);
+            else
+                result.append(rawData(row), cells.at(row).size);
+        }
+        return result;
+    }
+
+    // Значения копируются как есть, без форматирования в текст
+    if (columnType == Real)
+    {
+        result.reals.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            result.reals[i] = rows.at(i) < 0 ? 0 : reals.at(rows.at(i));
+        }
+    }
+    else
+    {
+        result.integers.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            result.integers[i] = rows.at(i) < 0 ? 0 : integers.at(rows.at(i));
+        }
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int row = rows.at(i);
+        if (row < 0 || isEmpty(row))
+            result.setNull(i, true);
+    }
+    return result;
+}
+
+void TableColumn::setBytes(int row, const QByteArray &utf8)
+{
+    if (columnType != Text)
+    {
+        if (utf8.isEmpty())
+        {
+            setNull(row, true);
+            return;
+        }
+
+        qint64 integer = 0;
+        double real = 0;
+        if (parseValue(columnType, utf8.constData(), utf8.size(), integer, real))
+        {
+            if (columnType == Real)
+                reals[row] = real;
+            else
+                integers[row] = integer;
+            setNull(row, false);
+            return;
+        }
+
+        // Дробное число в целом столбце: столбец становится дробным, как при добавлении блоков
+        if (columnType == Integer && parseValue(Real, utf8.constData(), utf8.size(), integer, real) && promoteToReal())
+        {
+            reals[row] = real;
+            setNull(row, false);
+            return;
+        }
+
+        // Значение другого вида — столбец становится текстовым
+        convertToText();
+    }
+
+    CellRef &ref = cells[row];
+
+    // Новое значение помещается на место старого — буфер не растёт
+    if (utf8.size() <= ref.size)
+    {
+        std::memcpy(arena.data() + ref.offset, utf8.constData(), utf8.size());
+        garbage += ref.size - utf8.size();
+        ref.size = utf8.size();
+        return;
+    }
+
+    garbage += ref.size;
+    ref.offset = arena.size();
+    ref.size = utf8.size();
+    arena.append(utf8);
+
+    if (arena.size() > CompactThreshold && garbage > arena.size() / 2)
+        compact();
+}
+
+void TableColumn::insert(int row, int count)
+{
+    const int rows = size();
+    switch (columnType)
+    {
+    case Integer:
+    case Date:
+        integers.insert(row, count, 0);
+        break;
+    case Real:
+        reals.insert(row, count, 0.0);
+        break;
+    default:
+    {
+        CellRef empty;
+        empty.offset = 0;
+        empty.size = 0;
+        cells.insert(row, count, empty);
+        break;
+    }
+    }
+
+    // Новые ячейки типизированного столбца пустые
+    if (columnType != Text)
+    {
+        QBitArray inserted(count, true);
+        nulls = spliceBits(nulls, rows, row, 0, count, inserted);
+    }
+    if (!styleIds.isEmpty())
+        styleIds.insert(row, count, 0);
+}
+
+void TableColumn::remove(int row, int count)
+{
+    if (!styleIds.isEmpty())
+        styleIds.remove(row, count);
+
+    if (columnType != Text)
+    {
+        if (!nulls.isEmpty())
+            nulls = spliceBits(nulls, size(), row, count, 0, QBitArray());
+        if (columnType == Real)
+            reals.remove(row, count);
+        else
+            integers.remove(row, count);
+        return;
+    }
+
+    for (int i = row; i < row + count; ++i)
+    {
+        garbage += cells.at(i).size;
+    }
+    cells.remove(row, count);
+
+    if (arena.size() > CompactThreshold && garbage > arena.size() / 2)
+        compact();
+}
+
+void TableColumn::resize(int rows)
+{
+    if (rows < size())
+        remove(rows, size() - rows);
+    else if (rows > size())
+        insert(size(), rows - size());
+}
+
+void TableColumn::reserve(int rows, int bytes)
+{
+    cells.reserve(rows);
+    arena.reserve(bytes);
+}
+
+void TableColumn::compact()
+{
+    QByteArray packed;
+    packed.reserve(arena.size() - garbage);
+    for (CellRef &ref : cells)
+    {
+        const int offset = packed.size();
+        packed.append(arena.constData() + ref.offset, ref.size);
+        ref.offset = offset;
+    }
+    arena = packed;
+    garbage = 0;
+}
+
+TableData::TableData(int rows, int columns, Storage storage) : rows(rows),
+                                                              sparse(storage == Sparse)
+{
+    stylePalette.append(CellStyle());
+    paletteIndex.insert(CellStyle(), 0);
+    if (sparse)
+    {
+        sparseColumns = columns;
+        return;
+    }
+    columnList.resize(columns);
+    for (TableColumn &column : columnList)
+    {
+        column.resize(rows);
+    }
+}
+
+void TableData::setBytes(int row, int column, const QByteArray &utf8)
+{
+    if (sparse)
+        grid.setBytes(row, column, utf8);
+    else
+        columnList[column].setBytes(row, utf8);
+}
+
+TableColumn TableData::gatherColumn(int column, const QVector<int> &rows) const
+{
+    if (!sparse)
+        return columnList.at(column).gather(rows);
+
+    TableColumn result;
+    for (int row : rows)
+    {
+        const QByteArray utf8 = row < 0 ? QByteArray() : grid.bytes(row, column);
+        result.append(utf8.constData(), utf8.size());
+    }
+    result.inferType();
+    return result;
+}
+
+void TableData::appendColumns(const QVector<TableColumn> &block, int blockRows)
+{
+    // Загрузчик CSV всегда строит плотную таблицу
+    Q_ASSERT(!sparse);
+    if (columnList.isEmpty())
+        columnList.resize(block.size());
+
+    for (int i = 0; i < columnList.size(); ++i)
+    {
+        if (i < block.size())
+            columnList[i].append(block.at(i));
+        else
+            columnList[i].resize(rows + blockRows);
+    }
+    rows += blockRows;
+}
+
+void TableData::insertRows(int row, int count)
+{
+    if (sparse)
+        grid.insertRows(row, count);
+    for (TableColumn &column : columnList)
+    {
+        column.insert(row, count);
+    }
+    rows += count;
+}
+
+void TableData::removeRows(int row, int count)
+{
+    if (sparse)
+        grid.removeRows(row, count);
+    for (TableColumn &column : columnList)
+    {
+        column.remove(row, count);
+    }
+    rows -= count;
+}
+
+void TableData::insertColumns(int column, int count)
+{
+    if (sparse)
+    {
+        grid.insertColumns(column, count);
+        sparseColumns += count;
+        return;
+    }
+    TableColumn empty;
+    empty.resize(rows);
+    columnList.insert(column, count, empty);
+}
+
+void TableData::removeColumns(int column, int count)
+{
+    if (sparse)
+    {
+        grid.removeColumns(column, count);
+        sparseColumns -= count;
+        return;
+    }
+    columnList.remove(column, count);
+}
+
+void TableData::setStyle(int row, int column, const CellStyle &style)
+{
+    if (sparse)
+        grid.setStyleId(row, column, internStyle(style));
+    else
+        columnList[column].setStyleId(row, internStyle(style));
+}
+
+bool TableData::hasStyles() const
+{
+    if (sparse)
+        return grid.hasStyles();
+    for (const TableColumn &column : columnList)
+    {
+        if (column.hasStyles())
+            return true;
+    }
+    return false;
+}
+
+QVector<QVector<quint16>> TableData::columnStyleIds() const
+{
+    if (sparse)
+        return grid.columnStyleIds(rows, sparseColumns);
+
+    QVector<QVector<quint16>> result;
+    result.reserve(columnList.size());
+    for (const TableColumn &column : columnList)
+    {
+        result.append(column.styleIdList());
+    }
+    return result;
+}
+
+void TableData::setStyles(const QVector<CellStyle> &palette, const QVector<QVector<quint16>> &columnStyles)
+{
+    // Стиль 0 в палитре всегда означает оформление по умолчанию
+    stylePalette = palette;
+    if (stylePalette.isEmpty())
+        stylePalette.append(CellStyle());
+    stylePalette[0] = CellStyle();
+
+    paletteIndex.clear();
+    for (int i = 0; i < stylePalette.size(); ++i)
+    {
+        paletteIndex.insert(stylePalette.at(i), i);
+    }
+
+    if (sparse)
+    {
+        grid.clearStyles();
+        for (int j = 0; j < qMin(columnStyles.size(), sparseColumns); ++j)
+        {
+            const QVector<quint16> &ids = columnStyles.at(j);
+            if (ids.size() != rows)
+                continue;
+            for (int i = 0; i < rows; ++i)
+            {
+                if (ids.at(i) != 0 && ids.at(i) < stylePalette.size())
+                    grid.setStyleId(i, j, ids.at(i));
+            }
+        }
+        return;
+    }
+
+    for (int i = 0; i < columnList.size(); ++i)
+    {
+        const QVector<quint16> ids = i < columnStyles.size() ? columnStyles.at(i) : QVector<quint16>();
+        columnList[i].setStyleIdList(ids.size() == rows ? ids : QVector<quint16>());
+    }
+}
+
+int TableData::internStyle(const CellStyle &style)
+{
+    QHash<CellStyle, int>::const_iterator it = paletteIndex.constFind(style);
+    if (it != paletteIndex.constEnd())
+        return it.value();
+
+    if (stylePalette.size() >= MaxStyles)
+    {
+        qWarning() << "Style palette is full, falling back to the default style";
+        return 0;
+    }
+
+    stylePalette.append(style);
+    paletteIndex.insert(style, stylePalette.size() - 1);
+    return stylePalette.size() - 1;
+}
+
+void TableChanges::clear(int rows)
+{
+    dirtyRows = QBitArray(rows);
+    rewriteFrom = INT_MAX;
+    stylesDirty = false;
+    formulasDirty = false;
+}
+
+void TableChanges::markRow(int row)
+{
+    if (row >= rewriteFrom)
+        return;
+    if (row >= dirtyRows.size())
+        dirtyRows.resize(row + 1);
+    dirtyRows.setBit(row);
+}
+
+void TableChanges::markStructure(int row, int rows)
+{
+    // Номера строк после row сдвинулись: их отметки больше не нужны, файл перепишется с row
+    rewriteFrom = qMin(rewriteFrom, row);
+    dirtyRows.resize(qMin(rewriteFrom, rows));
+    stylesDirty = true;
+    formulasDirty = true;
+}
+
+void TableChanges::merge(const TableChanges &later)
+{
+    rewriteFrom = qMin(rewriteFrom, later.rewriteFrom);
+    const int size = qMin(rewriteFrom, qMax(dirtyRows.size(), later.dirtyRows.size()));
+    QBitArray merged = dirtyRows;
+    merged.resize(size);
+    for (int i = 0; i < qMin(size, later.dirtyRows.size()); ++i)
+    {
+        if (later.dirtyRows.testBit(i))
+            merged.setBit(i);
+    }
+    dirtyRows = merged;
+    stylesDirty = stylesDirty || later.stylesDirty;
+    formulasDirty = formulasDirty || later.formulasDirty;
+}
@@ -0,0 +1,232 @@
+#ifndef TABLEDATA_H
+#define TABLEDATA_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QColor>
+#include <QFont>
+#include <QJsonObject>
+#include <QBitArray>
+#include <QDateTime>
+
+#include "sparsegrid.h"
+
+// Оформление ячейки. Незаданные поля (невалидный цвет, hasFont == false, alignment == 0)
+// означают оформление по умолчанию, поэтому пустой стиль ничего не хранит
+struct CellStyle
+{
+    QColor foreground;
+    QColor background;
+    QFont font;
+    bool hasFont = false;
+    int alignment = 0;
+
+    bool isEmpty() const;
+
+    // Запись в файл настроек таблицы; пустой объект — оформление по умолчанию
+    QJsonObject toJson() const;
+    static CellStyle fromJson(const QJsonObject &cellSettings);
+
+    bool operator==(const CellStyle &other) const;
+    bool operator!=(const CellStyle &other) const { return !(*this == other); }
+};
+
+uint qHash(const CellStyle &style, uint seed = 0);
+
+// Один столбец таблицы: тексты всех ячеек лежат подряд в одном буфере (UTF-8),
+// для каждой ячейки хранится только смещение и длина. Оформление — номер стиля в палитре
+// таблицы; пока в столбце нет оформленных ячеек, номера не хранятся вовсе.
+// Столбцы из одних целых, дробных чисел или дат хранятся упакованным массивом значений
+// с битовой картой пустых ячеек; текст для них строится при показе и записи
+class TableColumn
+{
+public:
+    enum Type
+    {
+        Text,
+        Integer,
+        Real,
+        Date
+    };
+
+    int size() const;
+    Type type() const { return columnType; }
+
+    QString text(int row) const;
+    QByteArray bytes(int row) const;
+    const char *rawData(int row) const { return arena.constData() + cells.at(row).offset; } // Только для Text
+    int rawSize(int row) const { return cells.at(row).size; }
+    bool isEmpty(int row) const;
+
+    // Значения типизированного столбца: Integer и Date (юлианский день) — integerAt, Real — realAt
+    qint64 integerAt(int row) const { return integers.at(row); }
+    double realAt(int row) const { return reals.at(row); }
+    // Значение ячейки как числа; для текстового столбца текст разбирается, ok == false — не число
+    double number(int row, bool *ok) const;
+    // Массивы значений для поблочной обработки; nullMap() пуст, пока в столбце нет пустых ячеек
+    const qint64 *integerData() const { return integers.constData(); }
+    const double *realData() const { return reals.constData(); }
+    const QBitArray &nullMap() const { return nulls; }
+
+    int styleId(int row) const { return styleIds.isEmpty() ? 0 : styleIds.at(row); }
+    void setStyleId(int row, int id);
+    bool hasStyles() const { return !styleIds.isEmpty(); }
+    const QVector<quint16> &styleIdList() const { return styleIds; }
+    void setStyleIdList(const QVector<quint16> &ids) { styleIds = ids; }
+
+    // Выбор типа для только что разобранного текстового столбца. Тип подходит, только если
+    // его текстовая запись совпадает с исходным текстом каждой ячейки байт в байт
+    void inferType();
+
+    void append(const char *data, int size);
+    void append(const TableColumn &other);
+    // Новый столбец из строк rows в том же формате хранения; -1 — пустая ячейка. Оформление не переносится
+    TableColumn gather(const QVector<int> &rows) const;
+    void setBytes(int row, const QByteArray &utf8);
+    void setText(int row, const QString &text) { setBytes(row, text.toUtf8()); }
+    void insert(int row, int count);
+    void remove(int row, int count);
+    void resize(int rows);
+    void reserve(int rows, int bytes);
+
+private:
+    friend class CsvCache; // Кэш разбора читает и пишет буфер и ссылки столбца как есть
+
+    struct CellRef
+    {
+        int offset;
+        int size;
+    };
+
+    bool convertTo(Type target);
+    bool promoteToReal();
+    void convertToText();
+    void setNull(int row, bool null);
+    void compact();
+
+    Type columnType = Text;
+    QByteArray arena;
+    QVector<CellRef> cells;
+    QVector<qint64> integers;  // Значения столбцов Integer и Date
+    QVector<double> reals;     // Значения столбца Real
+    QBitArray nulls;           // Пустые ячейки типизированного столбца; пустой массив — таких нет
+    QVector<quint16> styleIds; // Пустой — все ячейки столбца без оформления
+    int garbage = 0;           // Байты перезаписанных значений, которые ещё лежат в буфере
+};
+
+// Табличные данные в столбцовом виде. Все контейнеры неявно разделяемые,
+// поэтому копия TableData — дешёвый снимок, который можно отдать в другой поток.
+// Большие почти пустые таблицы хранятся разреженно (SparseGrid): тогда column() недоступен,
+// а ячейки перебираются по заполненным блокам
+class TableData
+{
+public:
+    enum Storage
+    {
+        Dense,
+        Sparse
+    };
+
+    explicit TableData(int rows = 0, int columns = 0, Storage storage = Dense);
+
+    int rowCount() const { return rows; }
+    int columnCount() const { return sparse ? sparseColumns : columnList.size(); }
+    bool isSparse() const { return sparse; }
+    const SparseGrid &sparseGrid() const { return grid; }
+
+    const TableColumn &column(int column) const { return columnList.at(column); }
+    QString text(int row, int column) const { return sparse ? grid.text(row, column) : columnList.at(column).text(row); }
+    QByteArray bytes(int row, int column) const { return sparse ? grid.bytes(row, column) : columnList.at(column).bytes(row); }
+    void setText(int row, int column, const QString &text) { setBytes(row, column, text.toUtf8()); }
+    void setBytes(int row, int column, const QByteArray &utf8);
+
+    // Строки rows одного столбца плотным TableColumn (результаты запросов и объединений)
+    TableColumn gatherColumn(int column, const QVector<int> &rows) const;
+
+    // Добавление блока столбцов, разобранных загрузчиком, без перекодирования
+    void appendColumns(const QVector<TableColumn> &block, int blockRows);
+
+    void insertRows(int row, int count);
+    void removeRows(int row, int count);
+    void insertColumns(int column, int count);
+    void removeColumns(int column, int count);
+
+    // Оформление хранится палитрой уникальных стилей; стиль 0 — оформление по умолчанию
+    CellStyle style(int row, int column) const { return stylePalette.at(styleId(row, column)); }
+    int styleId(int row, int column) const { return sparse ? grid.styleId(row, column) : columnList.at(column).styleId(row); }
+    void setStyle(int row, int column, const CellStyle &style);
+    bool hasStyles() const;
+    const QVector<CellStyle> &palette() const { return stylePalette; }
+
+    // Номера стилей по столбцам; пустой вектор — столбец без оформления
+    QVector<QVector<quint16>> columnStyleIds() const;
+
+    // Замена всего оформления разом (загрузка файла настроек)
+    void setStyles(const QVector<CellStyle> &palette, const QVector<QVector<quint16>> &columnStyles);
+
+private:
+    int internStyle(const CellStyle &style);
+
+    int rows;
+    bool sparse;
+    int sparseColumns = 0;
+    SparseGrid grid;
+    QVector<TableColumn> columnList;
+    QVector<CellStyle> stylePalette;
+    QHash<CellStyle, int> paletteIndex;
+};
+
+// Формат CSV-файла, определённый при открытии (CsvSniffer); в нём же файл и сохраняется
+struct CsvDialect
+{
+    enum Encoding
+    {
+        Utf8,
+        Utf16LE,
+        Utf16BE,
+        Cp1251
+    };
+
+    char delimiter = ',';
+    char quote = '"';
+    QByteArray lineEnd;         // Пусто — перевод строки платформы
+    Encoding encoding = Utf8;
+    bool bom = false;           // Файл начинается с метки порядка байтов
+    bool hasHeader = false;     // Первая запись — заголовки столбцов, а не строка таблицы
+    QStringList header;
+};
+
+// Раскладка CSV-файла на диске: где начинается каждая строка таблицы. По ней сохранение
+// находит байты изменённых строк и не переписывает файл целиком
+struct CsvLayout
+{
+    QString filePath;
+    QDateTime fileModified;     // Время изменения файла, когда раскладка была верна
+    QVector<qint64> rowOffsets; // Начала строк и размер файла последним элементом
+    CsvDialect dialect;
+
+    bool isValid() const { return !filePath.isEmpty() && !rowOffsets.isEmpty(); }
+};
+
+// Изменения таблицы с последней загрузки или сохранения. Строки до rewriteFrom
+// соответствуют строкам файла один к одному; начиная с rewriteFrom (вставка или удаление)
+// файл переписывается до конца
+struct TableChanges
+{
+    QBitArray dirtyRows;
+    int rewriteFrom = 0;
+    bool stylesDirty = true;
+    bool formulasDirty = true;
+
+    void clear(int rows);
+    void markRow(int row);
+    void markStructure(int row, int rows);
+
+    // Возврат изменений, которые не удалось сохранить; later — правки, сделанные во время записи
+    void merge(const TableChanges &later);
+};
+
+#endif // TABLEDATA_H
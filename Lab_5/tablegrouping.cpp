@@ -0,0 +1,223 @@
+#include "tablegrouping.h"
+#include "tablequery.h"
+
+#include <QHash>
+#include <QSet>
+#include <QtConcurrent>
+
+namespace
+{
+    const int MaxPivotValues = 1000; // Больше столбцов сводная таблица уже не читается
+
+    // Заголовок исходного столбца, у столбцов без заголовка — номер
+    QString columnTitle(const QStringList &titles, int column)
+    {
+        const QString title = titles.value(column);
+        return title.isEmpty() ? TableGrouping::tr("Столбец %1").arg(column + 1) : title;
+    }
+
+    QString aggregateTitle(const QStringList &titles, const AggregateSpec &spec)
+    {
+        switch (spec.function)
+        {
+        case AggregateSpec::CountAll:
+            return TableGrouping::tr("Количество строк");
+        case AggregateSpec::Count:
+            return TableGrouping::tr("Количество (%1)").arg(columnTitle(titles, spec.column));
+        case AggregateSpec::Sum:
+            return TableGrouping::tr("Сумма (%1)").arg(columnTitle(titles, spec.column));
+        case AggregateSpec::Min:
+            return TableGrouping::tr("Минимум (%1)").arg(columnTitle(titles, spec.column));
+        case AggregateSpec::Max:
+            return TableGrouping::tr("Максимум (%1)").arg(columnTitle(titles, spec.column));
+        case AggregateSpec::Average:
+            return TableGrouping::tr("Среднее (%1)").arg(columnTitle(titles, spec.column));
+        }
+        return QString();
+    }
+
+    // Ключ по тексту ячеек: групп немного, поэтому без кодирования по типам столбцов
+    QByteArray textKey(const TableData &snapshot, int row, const QVector<int> &columns)
+    {
+        QByteArray key;
+        for (int column : columns)
+        {
+            const QByteArray bytes = snapshot.bytes(row, column);
+            const qint32 size = bytes.size();
+            key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+            key.append(bytes);
+        }
+        return key;
+    }
+}
+
+TableGrouping::TableGrouping(QObject *parent) : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<GroupedTable>::finished, this, [this]()
+            {
+                result = watcher.result();
+                emit finished(result);
+            });
+}
+
+TableGrouping::~TableGrouping()
+{
+    watcher.waitForFinished();
+}
+
+bool TableGrouping::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+void TableGrouping::runGroups(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                              const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs)
+{
+    watcher.setFuture(QtConcurrent::run(&TableGrouping::groups, snapshot, titles, rows, groupColumns, specs));
+}
+
+void TableGrouping::runPivot(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                             const QVector<int> &rowColumns, int pivotColumn, const AggregateSpec &spec)
+{
+    // У QtConcurrent::run не больше пяти аргументов функции
+    watcher.setFuture(QtConcurrent::run([snapshot, titles, rows, rowColumns, pivotColumn, spec]()
+                                        { return TableGrouping::pivot(snapshot, titles, rows, rowColumns, pivotColumn, spec); }));
+}
+
+GroupedTable TableGrouping::groups(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                                   const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs)
+{
+    GroupedTable table;
+    const GroupedRows grouped = TableAggregate::aggregate(snapshot, rows, groupColumns, specs, &table.rowGroups);
+    for (int column : groupColumns)
+    {
+        table.columns.append(snapshot.gatherColumn(column, grouped.firstRows));
+        table.titles.append(columnTitle(titles, column));
+    }
+    for (int k = 0; k < specs.size(); ++k)
+    {
+        table.columns.append(grouped.aggregates.at(k));
+        table.titles.append(aggregateTitle(titles, specs.at(k)));
+    }
+    table.rowCount = grouped.firstRows.size();
+    table.keyColumns = groupColumns.size();
+    return table;
+}
+
+GroupedTable TableGrouping::pivot(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                                  const QVector<int> &rowColumns, int pivotColumn, const AggregateSpec &spec)
+{
+    // Группы по ключам строк и значению столбца сводки считаются одним проходом,
+    // затем раскладываются по строкам и столбцам отчёта
+    GroupedTable table;
+    const GroupedRows grouped = TableAggregate::aggregate(snapshot, rows, rowColumns + QVector<int>{pivotColumn},
+                                                          QVector<AggregateSpec>{spec}, &table.rowGroups);
+    const int groups = grouped.firstRows.size();
+
+    QHash<QByteArray, int> rowIndex;
+    QHash<QByteArray, int> valueIndex;
+    QVector<int> rowFirst;
+    QVector<int> valueFirst;
+    QVector<int> groupRow(groups);
+    QVector<int> groupValue(groups);
+    for (int g = 0; g < groups; ++g)
+    {
+        const int first = grouped.firstRows.at(g);
+        const QByteArray rowKey = textKey(snapshot, first, rowColumns);
+        groupRow[g] = rowIndex.value(rowKey, rowFirst.size());
+        if (groupRow.at(g) == rowFirst.size())
+        {
+            rowIndex.insert(rowKey, rowFirst.size());
+            rowFirst.append(first);
+        }
+
+        const QByteArray valueKey = snapshot.bytes(first, pivotColumn);
+        groupValue[g] = valueIndex.value(valueKey, valueFirst.size());
+        if (groupValue.at(g) == valueFirst.size())
+        {
+            valueIndex.insert(valueKey, valueFirst.size());
+            valueFirst.append(first);
+        }
+    }
+
+    if (valueFirst.size() > MaxPivotValues)
+    {
+        table.errorMessage = tr("В столбце сводки %1 разных значений, допускается не больше %2")
+                                 .arg(valueFirst.size())
+                                 .arg(MaxPivotValues);
+        table.rowGroups.clear();
+        return table;
+    }
+
+    // Столбцы сводки идут по возрастанию значений, строки — в порядке первого появления
+    SortKey key;
+    key.column = pivotColumn;
+    QVector<int> sortedValues = valueFirst;
+    TableQuery::sortRows(snapshot, sortedValues, QVector<SortKey>() << key);
+    QHash<int, int> valuePosition;
+    for (int i = 0; i < sortedValues.size(); ++i)
+    {
+        valuePosition.insert(sortedValues.at(i), i);
+    }
+
+    table.rowCount = rowFirst.size();
+    table.keyColumns = rowColumns.size();
+    table.pivotValues = sortedValues.size();
+    table.cellGroups.fill(-1, table.rowCount * table.pivotValues);
+    for (int g = 0; g < groups; ++g)
+    {
+        table.cellGroups[groupRow.at(g) * table.pivotValues + valuePosition.value(valueFirst.at(groupValue.at(g)))] = g;
+    }
+
+    for (int column : rowColumns)
+    {
+        table.columns.append(snapshot.gatherColumn(column, rowFirst));
+        table.titles.append(columnTitle(titles, column));
+    }
+    const TableColumn &values = grouped.aggregates.first();
+    for (int v = 0; v < table.pivotValues; ++v)
+    {
+        TableColumn column;
+        for (int r = 0; r < table.rowCount; ++r)
+        {
+            const int g = table.cellGroups.at(r * table.pivotValues + v);
+            const QByteArray bytes = g < 0 ? QByteArray() : values.bytes(g);
+            column.append(bytes.constData(), bytes.size());
+        }
+        column.inferType();
+        table.columns.append(column);
+
+        const QString title = snapshot.text(sortedValues.at(v), pivotColumn);
+        table.titles.append(title.isEmpty() ? tr("(пусто)") : title);
+    }
+    return table;
+}
+
+QVector<int> TableGrouping::sourceRows(int row, int column) const
+{
+    QSet<int> wanted;
+    if (result.pivotValues == 0)
+    {
+        wanted.insert(row);
+    }
+    else if (column < result.keyColumns)
+    {
+        for (int v = 0; v < result.pivotValues; ++v)
+        {
+            wanted.insert(result.cellGroups.at(row * result.pivotValues + v));
+        }
+    }
+    else
+    {
+        wanted.insert(result.cellGroups.at(row * result.pivotValues + column - result.keyColumns));
+    }
+    wanted.remove(-1);
+
+    QVector<int> rows;
+    for (int i = 0; !wanted.isEmpty() && i < result.rowGroups.size(); ++i)
+    {
+        if (wanted.contains(result.rowGroups.at(i)))
+            rows.append(i);
+    }
+    return rows;
+}
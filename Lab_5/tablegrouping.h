@@ -0,0 +1,58 @@
+#ifndef TABLEGROUPING_H
+#define TABLEGROUPING_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "tableaggregate.h"
+
+// Отчёт по группам: столбцы таблицы-результата и привязка его ячеек к группам исходной таблицы
+struct GroupedTable
+{
+    QString errorMessage;
+    QVector<TableColumn> columns;
+    QStringList titles;
+    int rowCount = 0;
+    int keyColumns = 0;      // Первые столбцы — значения ключей группы
+    int pivotValues = 0;     // Столбцов сводной таблицы после ключевых; 0 — обычная группировка
+    QVector<int> rowGroups;  // Группа каждой строки исходной таблицы, -1 — строка не попала в отчёт
+    QVector<int> cellGroups; // Сводная таблица: группа ячейки (строка * pivotValues + столбец), -1 — пусто
+};
+
+// Группировка и сводная таблица в пуле потоков. Объект остаётся у вкладки с результатом
+// и по ячейке отчёта отвечает, из каких строк исходной таблицы она собрана
+class TableGrouping : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TableGrouping(QObject *parent = nullptr);
+    ~TableGrouping() override;
+
+    bool isRunning() const;
+    // rows — строки snapshot, попадающие в отчёт (видимые после фильтра); titles — заголовки
+    // столбцов snapshot для заголовков отчёта, пустой заголовок заменяется номером столбца
+    void runGroups(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                   const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs);
+    void runPivot(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                  const QVector<int> &rowColumns, int pivotColumn, const AggregateSpec &spec);
+
+    static GroupedTable groups(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                               const QVector<int> &groupColumns, const QVector<AggregateSpec> &specs);
+    static GroupedTable pivot(const TableData &snapshot, const QStringList &titles, const QVector<int> &rows,
+                              const QVector<int> &rowColumns, int pivotColumn, const AggregateSpec &spec);
+
+    // Строки исходной таблицы за ячейкой отчёта; ключевой столбец сводной таблицы — вся её строка
+    QVector<int> sourceRows(int row, int column) const;
+
+signals:
+    void finished(const GroupedTable &table);
+
+private:
+    QFutureWatcher<GroupedTable> watcher;
+    GroupedTable result;
+};
+
+#endif // TABLEGROUPING_H
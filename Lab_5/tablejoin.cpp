@@ -0,0 +1,278 @@
+#include "tablejoin.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace
+{
+    const int MinRowsPerTask = 64 * 1024; // Меньшие части не окупают передачу в другой поток
+
+    // Ключи Integer- и Date-столбцов: значение без перевода в текст
+    class IntegerKeys
+    {
+    public:
+        explicit IntegerKeys(const TableColumn &column) : values(column.integerData()),
+                                                          nullBits(column.nullMap().isEmpty() ? nullptr : reinterpret_cast<const uchar *>(column.nullMap().bits()))
+        {
+        }
+
+        bool key(int row, qint64 &value) const
+        {
+            if (nullBits && ((nullBits[row >> 3] >> (row & 7)) & 1))
+                return false;
+            value = values[row];
+            return true;
+        }
+
+    private:
+        const qint64 *values;
+        const uchar *nullBits;
+    };
+
+    // Ключи как текст ячейки; у текстового столбца плотной таблицы байты берутся из буфера без копирования
+    class ByteKeys
+    {
+    public:
+        ByteKeys(const TableData &table, int column) : table(&table),
+                                                       column(column),
+                                                       text(!table.isSparse() && table.column(column).type() == TableColumn::Text ? &table.column(column) : nullptr)
+        {
+        }
+
+        bool key(int row, QByteArray &value) const
+        {
+            if (text)
+                value = QByteArray::fromRawData(text->rawData(row), text->rawSize(row));
+            else
+                value = table->bytes(row, column);
+            return !value.isEmpty();
+        }
+
+    private:
+        const TableData *table;
+        int column;
+        const TableColumn *text;
+    };
+
+    // Хеш-таблица по строкам меньшей таблицы: первая строка каждого ключа и цепочки следующих.
+    // Строки вставляются с конца, поэтому цепочка идёт по возрастанию номеров
+    template <typename Key, typename Reader>
+    struct BuildTable
+    {
+        QHash<Key, int> heads;
+        QVector<int> next;
+
+        void build(const Reader &reader, int rows)
+        {
+            heads.reserve(rows);
+            next.fill(-1, rows);
+            Key key;
+            for (int row = rows - 1; row >= 0; --row)
+            {
+                if (!reader.key(row, key))
+                    continue;
+                auto it = heads.find(key);
+                if (it != heads.end())
+                {
+                    next[row] = it.value();
+                    it.value() = row;
+                }
+                else
+                {
+                    heads.insert(key, row);
+                }
+            }
+        }
+    };
+
+    // Пары строк одной части проверяемой таблицы; build -1 — строка без пары.
+    // matched отмечает строки хеш-таблицы, нашедшие пару (нужно, когда хеш построен по левой таблице)
+    struct ProbedPart
+    {
+        QVector<int> probeRows;
+        QVector<int> buildRows;
+        QBitArray matched;
+    };
+
+    template <typename Key, typename Reader>
+    ProbedPart probeRange(const BuildTable<Key, Reader> &table, const Reader &reader, int first, int last,
+                          bool keepMisses, bool keepMatches, bool markMatched)
+    {
+        ProbedPart part;
+        if (markMatched)
+            part.matched.resize(table.next.size());
+        Key key;
+        for (int row = first; row < last; ++row)
+        {
+            const auto it = reader.key(row, key) ? table.heads.constFind(key) : table.heads.constEnd();
+            if (it == table.heads.constEnd())
+            {
+                if (keepMisses)
+                {
+                    part.probeRows.append(row);
+                    part.buildRows.append(-1);
+                }
+                continue;
+            }
+
+            for (int match = it.value(); match >= 0; match = table.next.at(match))
+            {
+                if (markMatched)
+                    part.matched.setBit(match);
+                if (keepMatches)
+                {
+                    part.probeRows.append(row);
+                    part.buildRows.append(match);
+                }
+            }
+        }
+        return part;
+    }
+
+    // Номера строк результата в левой и правой таблицах (-1 — пустые ячейки), в порядке левой таблицы
+    template <typename Key, typename Reader>
+    void matchRows(const Reader &leftKeys, int leftCount, const Reader &rightKeys, int rightCount,
+                   TableJoin::Kind kind, QVector<int> &leftRows, QVector<int> &rightRows)
+    {
+        const bool buildLeft = leftCount < rightCount;
+        const Reader &buildKeys = buildLeft ? leftKeys : rightKeys;
+        const Reader &probeKeys = buildLeft ? rightKeys : leftKeys;
+        const int probeCount = buildLeft ? rightCount : leftCount;
+
+        BuildTable<Key, Reader> table;
+        table.build(buildKeys, buildLeft ? leftCount : rightCount);
+
+        // Если хеш построен по правой таблице, строки без пары видны при проверке сразу;
+        // иначе они известны только после всех частей — по отметкам matched
+        const bool keepMisses = !buildLeft && kind != TableJoin::Inner;
+        const bool keepMatches = kind != TableJoin::Anti;
+        const bool markMatched = buildLeft && kind != TableJoin::Inner;
+
+        const int parts = qMax(1, QThread::idealThreadCount());
+        const int step = qMax(MinRowsPerTask, (probeCount + parts - 1) / parts);
+        QList<QFuture<ProbedPart>> pending;
+        for (int first = 0; first < probeCount; first += step)
+        {
+            const int last = qMin(first + step, probeCount);
+            pending.append(QtConcurrent::run([&table, &probeKeys, first, last, keepMisses, keepMatches, markMatched]()
+                                             { return probeRange(table, probeKeys, first, last, keepMisses, keepMatches, markMatched); }));
+        }
+
+        QVector<int> probeRows;
+        QVector<int> buildRows;
+        QBitArray matched(markMatched ? leftCount : 0);
+        for (QFuture<ProbedPart> &future : pending)
+        {
+            const ProbedPart part = future.result();
+            probeRows += part.probeRows;
+            buildRows += part.buildRows;
+            if (markMatched)
+                matched |= part.matched;
+        }
+
+        if (!buildLeft)
+        {
+            leftRows = probeRows;
+            rightRows = kind == TableJoin::Anti ? QVector<int>() : buildRows;
+            return;
+        }
+
+        // Хеш по левой таблице: пары приводятся к порядку левой таблицы,
+        // строки левой таблицы без пары добавляются с пустой правой частью
+        QVector<qint64> pairs;
+        pairs.reserve(probeRows.size() + (markMatched ? leftCount : 0));
+        for (int i = 0; i < probeRows.size(); ++i)
+        {
+            pairs.append((static_cast<qint64>(buildRows.at(i)) << 32) | static_cast<quint32>(probeRows.at(i)));
+        }
+        for (int row = 0; markMatched && row < leftCount; ++row)
+        {
+            if (!matched.testBit(row))
+                pairs.append((static_cast<qint64>(row) << 32) | static_cast<quint32>(-1));
+        }
+        std::sort(pairs.begin(), pairs.end());
+
+        leftRows.resize(pairs.size());
+        if (kind != TableJoin::Anti)
+            rightRows.resize(pairs.size());
+        for (int i = 0; i < pairs.size(); ++i)
+        {
+            leftRows[i] = static_cast<int>(pairs.at(i) >> 32);
+            if (kind != TableJoin::Anti)
+                rightRows[i] = static_cast<int>(static_cast<quint32>(pairs.at(i)));
+        }
+    }
+
+    bool integerKeys(const TableData &table, int column)
+    {
+        if (table.isSparse())
+            return false;
+        const TableColumn::Type type = table.column(column).type();
+        return type == TableColumn::Integer || type == TableColumn::Date;
+    }
+}
+
+TableJoin::TableJoin(QObject *parent) : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<JoinedTable>::finished, this, [this]()
+            {
+                emit finished(watcher.result());
+            });
+}
+
+TableJoin::~TableJoin()
+{
+    watcher.waitForFinished();
+}
+
+bool TableJoin::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+void TableJoin::run(const TableData &left, int leftColumn, const TableData &right, int rightColumn, Kind kind)
+{
+    watcher.setFuture(QtConcurrent::run(&TableJoin::join, left, leftColumn, right, rightColumn, kind));
+}
+
+JoinedTable TableJoin::join(const TableData &left, int leftColumn, const TableData &right, int rightColumn, Kind kind)
+{
+    QVector<int> leftRows;
+    QVector<int> rightRows;
+    // Числа и даты одного типа сравниваются по значению, всё остальное — по тексту ячеек
+    if (integerKeys(left, leftColumn) && integerKeys(right, rightColumn) &&
+        left.column(leftColumn).type() == right.column(rightColumn).type())
+    {
+        matchRows<qint64>(IntegerKeys(left.column(leftColumn)), left.rowCount(),
+                          IntegerKeys(right.column(rightColumn)), right.rowCount(), kind, leftRows, rightRows);
+    }
+    else
+    {
+        matchRows<QByteArray>(ByteKeys(left, leftColumn), left.rowCount(),
+                              ByteKeys(right, rightColumn), right.rowCount(), kind, leftRows, rightRows);
+    }
+
+    // Столбцы результата собираются параллельно, каждый из своего столбца хранения
+    QList<QFuture<TableColumn>> pending;
+    for (int j = 0; j < left.columnCount(); ++j)
+    {
+        pending.append(QtConcurrent::run([&left, &leftRows, j]()
+                                         { return left.gatherColumn(j, leftRows); }));
+    }
+    for (int j = 0; kind != Anti && j < right.columnCount(); ++j)
+    {
+        pending.append(QtConcurrent::run([&right, &rightRows, j]()
+                                         { return right.gatherColumn(j, rightRows); }));
+    }
+
+    JoinedTable result;
+    result.rowCount = leftRows.size();
+    for (QFuture<TableColumn> &future : pending)
+    {
+        result.columns.append(future.result());
+    }
+    return result;
+}
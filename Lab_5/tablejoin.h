@@ -0,0 +1,48 @@
+#ifndef TABLEJOIN_H
+#define TABLEJOIN_H
+
+#include <QObject>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "tabledata.h"
+
+// Таблица-результат соединения: столбцы левой таблицы, затем правой (у анти-соединения только левой)
+struct JoinedTable
+{
+    QVector<TableColumn> columns;
+    int rowCount = 0;
+};
+
+// Соединение двух таблиц по равенству ключевых столбцов. Хеш-таблица строится по меньшей
+// таблице, другая таблица проверяется по ней частями в пуле потоков; результат собирается
+// по столбцам из номеров совпавших строк, без промежуточных строк таблицы.
+// Пустые ключи ни с чем не совпадают
+class TableJoin : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Kind
+    {
+        Inner,
+        Left, // Строки левой таблицы без пары остаются с пустыми ячейками справа
+        Anti  // Только строки левой таблицы без пары
+    };
+
+    explicit TableJoin(QObject *parent = nullptr);
+    ~TableJoin() override;
+
+    bool isRunning() const;
+    void run(const TableData &left, int leftColumn, const TableData &right, int rightColumn, Kind kind);
+
+    static JoinedTable join(const TableData &left, int leftColumn, const TableData &right, int rightColumn, Kind kind);
+
+signals:
+    void finished(const JoinedTable &table);
+
+private:
+    QFutureWatcher<JoinedTable> watcher;
+};
+
+#endif // TABLEJOIN_H
@@ -0,0 +1,577 @@
+#include "tablemodel.h"
+
+#include <QBrush>
+#include <QFileInfo>
+#include <algorithm>
+
+namespace
+{
+    // Цвет может прийти и как QBrush (роли представления), и как QColor
+    QColor colorFromVariant(const QVariant &value)
+    {
+        if (value.userType() == QMetaType::QBrush)
+            return value.value<QBrush>().color();
+        return value.value<QColor>();
+    }
+}
+
+TableModel::TableModel(int rows, int columns, QObject *parent) : QAbstractTableModel(parent),
+                                                                 table(rows, columns)
+{
+}
+
+TableModel::TableModel(int rows, int columns, TableData::Storage storage, QObject *parent) : QAbstractTableModel(parent),
+                                                                                             table(rows, columns, storage)
+{
+}
+
+int TableModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return ordered ? order.size() : table.rowCount();
+}
+
+int TableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : table.columnCount();
+}
+
+QVariant TableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int row = sourceRow(index.row());
+    switch (role)
+    {
+    case Qt::EditRole:
+        if (formulas.contains(row, index.column()))
+            return formulas.source(row, index.column());
+        return table.text(row, index.column());
+    case Qt::DisplayRole:
+        return table.text(row, index.column());
+    case Qt::ForegroundRole:
+    case Qt::BackgroundRole:
+    case Qt::FontRole:
+    case Qt::TextAlignmentRole:
+        break;
+    default:
+        return QVariant();
+    }
+
+    // Оформление разрешается только для рисуемых ячеек: номер стиля ячейки и готовые
+    // значения ролей этого стиля из палитры
+    const int id = table.styleId(row, index.column());
+    if (id == 0)
+        return QVariant();
+
+    const StyleRoles &roles = styleRoles(id);
+    switch (role)
+    {
+    case Qt::ForegroundRole:
+        return roles.foreground;
+    case Qt::BackgroundRole:
+        return roles.background;
+    case Qt::FontRole:
+        return roles.font;
+    case Qt::TextAlignmentRole:
+        return roles.alignment;
+    }
+    return QVariant();
+}
+
+const TableModel::StyleRoles &TableModel::styleRoles(int id) const
+{
+    // Палитра только растёт (новые стили дописываются в конец), поэтому готовые значения
+    // остаются верными до замены всего оформления в setStyles
+    if (id >= resolvedStyles.size())
+        resolvedStyles.resize(table.palette().size());
+
+    StyleRoles &roles = resolvedStyles[id];
+    if (!roles.resolved)
+    {
+        const CellStyle &style = table.palette().at(id);
+        if (style.foreground.isValid())
+            roles.foreground = QBrush(style.foreground);
+        if (style.background.isValid())
+            roles.background = QBrush(style.background);
+        if (style.hasFont)
+            roles.font = style.font;
+        if (style.alignment)
+            roles.alignment = style.alignment;
+        roles.resolved = true;
+    }
+    return roles;
+}
+
+bool TableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid())
+        return false;
+
+    const int row = index.row();
+    const int column = index.column();
+
+    if (role == Qt::EditRole || role == Qt::DisplayRole)
+    {
+        const int dataRow = sourceRow(row);
+        QString text = value.toString();
+        const bool isFormula = text.size() > 1 && text.startsWith(QLatin1Char('='));
+        const bool hadFormula = formulas.contains(dataRow, column);
+        if (isFormula ? text == formulas.source(dataRow, column) : !hadFormula && text == table.text(dataRow, column))
+            return false;
+
+        if (isFormula)
+        {
+            formulas.setFormula(dataRow, column, text);
+        }
+        else
+        {
+            formulas.removeFormula(dataRow, column);
+            table.setText(dataRow, column, text);
+        }
+        changes.markRow(dataRow);
+        if (isFormula || hadFormula)
+            changes.formulasDirty = true;
+        emit dataChanged(index, index, QVector<int>() << Qt::DisplayRole << Qt::EditRole);
+
+        // Значение новой формулы и всех формул, зависящих от этой ячейки
+        if (!formulas.isEmpty())
+            recalculate(QVector<quint64>() << FormulaSheet::key(dataRow, column));
+        emit cellEdited(row, column);
+        return true;
+    }
+
+    CellStyle style = cellStyle(row, column);
+    switch (role)
+    {
+    case Qt::ForegroundRole:
+        style.foreground = colorFromVariant(value);
+        break;
+    case Qt::BackgroundRole:
+        style.background = colorFromVariant(value);
+        break;
+    case Qt::FontRole:
+        style.font = value.value<QFont>();
+        style.hasFont = value.isValid();
+        break;
+    case Qt::TextAlignmentRole:
+        style.alignment = value.toInt();
+        break;
+    default:
+        return false;
+    }
+    setCellStyle(row, column, style);
+    return true;
+}
+
+Qt::ItemFlags TableModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable;
+}
+
+QVariant TableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section < titles.size() && !titles.at(section).isEmpty())
+        return titles.at(section);
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+bool TableModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || row > rowCount() || count <= 0)
+        return false;
+
+    // Новой строке нет места в отсортированном и отфильтрованном виде — возвращаемся к исходному порядку
+    if (ordered)
+    {
+        row = row < order.size() ? order.at(row) : table.rowCount();
+        clearRowOrder();
+    }
+
+    beginInsertRows(QModelIndex(), row, row + count - 1);
+    table.insertRows(row, count);
+    formulas.insertRows(row, count);
+    changes.markStructure(row, table.rowCount());
+    ++revision;
+    endInsertRows();
+    recalculateAll();
+    return true;
+}
+
+bool TableModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > rowCount())
+        return false;
+
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    if (ordered)
+    {
+        // Строки представления разбросаны по данным: удаляем подряд идущие куски с конца
+        // и сдвигаем номера оставшихся строк порядка
+        QVector<int> removed = order.mid(row, count);
+        std::sort(removed.begin(), removed.end());
+        for (int last = removed.size() - 1; last >= 0;)
+        {
+            int first = last;
+            while (first > 0 && removed.at(first - 1) == removed.at(first) - 1)
+            {
+                --first;
+            }
+            table.removeRows(removed.at(first), last - first + 1);
+            formulas.removeRows(removed.at(first), last - first + 1);
+            last = first - 1;
+        }
+        changes.markStructure(removed.first(), table.rowCount());
+
+        order.remove(row, count);
+        for (int &dataRow : order)
+        {
+            dataRow -= std::lower_bound(removed.constBegin(), removed.constEnd(), dataRow) - removed.constBegin();
+        }
+    }
+    else
+    {
+        table.removeRows(row, count);
+        formulas.removeRows(row, count);
+        changes.markStructure(row, table.rowCount());
+    }
+    ++revision;
+    endRemoveRows();
+    recalculateAll();
+    return true;
+}
+
+bool TableModel::insertColumns(int column, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || column < 0 || column > table.columnCount() || count <= 0)
+        return false;
+
+    beginInsertColumns(QModelIndex(), column, column + count - 1);
+    table.insertColumns(column, count);
+    for (int i = 0; column < titles.size() && i < count; ++i)
+    {
+        titles.insert(column, QString());
+    }
+    formulas.insertColumns(column, count);
+    changes.markStructure(0, table.rowCount());
+    endInsertColumns();
+    recalculateAll();
+    return true;
+}
+
+bool TableModel::removeColumns(int column, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || column < 0 || count <= 0 || column + count > table.columnCount())
+        return false;
+
+    beginRemoveColumns(QModelIndex(), column, column + count - 1);
+    table.removeColumns(column, count);
+    titles = titles.mid(0, column) + titles.mid(column + count);
+    formulas.removeColumns(column, count);
+    changes.markStructure(0, table.rowCount());
+    endRemoveColumns();
+    recalculateAll();
+    return true;
+}
+
+void TableModel::appendColumns(const QVector<TableColumn> &block, int blockRows, const QVector<qint64> &rowOffsets)
+{
+    if (blockRows <= 0)
+        return;
+
+    // Смещения строк нужны только если пришли для каждой строки, иначе раскладка неизвестна
+    if (rowOffsets.size() == blockRows && layout.rowOffsets.size() == table.rowCount())
+        layout.rowOffsets += rowOffsets;
+    else
+        layout.rowOffsets.clear();
+
+    // Первый блок задаёт число столбцов — проще сбросить модель целиком
+    if (table.columnCount() == 0)
+    {
+        beginResetModel();
+        table.appendColumns(block, blockRows);
+        endResetModel();
+        return;
+    }
+
+    // После сортировки или фильтра новые строки данных встают в конец представления:
+    // порядок, выбранный пользователем, не сбрасывается при каждом дописанном блоке
+    const int first = table.rowCount();
+    const int viewFirst = rowCount();
+    beginInsertRows(QModelIndex(), viewFirst, viewFirst + blockRows - 1);
+    table.appendColumns(block, blockRows);
+    if (ordered)
+    {
+        order.reserve(order.size() + blockRows);
+        for (int row = first; row < first + blockRows; ++row)
+        {
+            order.append(row);
+        }
+    }
+    ++revision;
+    endInsertRows();
+
+    // Формулы по диапазонам, в которые попали новые строки (=SUM(A1:A100000)), пересчитываются
+    if (!formulas.isEmpty())
+    {
+        QVector<quint64> added;
+        added.reserve(blockRows * table.columnCount());
+        for (int row = first; row < first + blockRows; ++row)
+        {
+            for (int column = 0; column < table.columnCount(); ++column)
+            {
+                added.append(FormulaSheet::key(row, column));
+            }
+        }
+        recalculate(added);
+    }
+}
+
+void TableModel::finishLoad(const QString &filePath, const CsvDialect &dialect, qint64 dataEnd)
+{
+    // Файл и таблица совпадают: сохранять нечего, пока пользователь ничего не изменит.
+    // Смещения строк перекодированного файла не совпадают с его байтами — такой файл
+    // при сохранении переписывается целиком. Конец данных берётся у загрузчика, а не из
+    // размера файла: дописанное во время загрузки прочитает слежение за файлом
+    QFileInfo info(filePath);
+    layout.filePath = filePath;
+    layout.fileModified = info.lastModified();
+    layout.dialect = dialect;
+    if (dialect.hasHeader)
+        setColumnTitles(dialect.header);
+    if (dialect.encoding == CsvDialect::Utf8 && layout.rowOffsets.size() == table.rowCount())
+        layout.rowOffsets.append(dataEnd);
+    else
+        layout.rowOffsets.clear();
+    changes.clear(table.rowCount());
+}
+
+void TableModel::appendFileTail(const QVector<TableColumn> &block, int blockRows, const QVector<qint64> &rowOffsets, qint64 end)
+{
+    // Последний элемент раскладки — прежний конец данных: на время добавления он убирается,
+    // чтобы смещения новых строк легли сразу за смещениями старых
+    const bool extend = layout.rowOffsets.size() == table.rowCount() + 1;
+    if (extend)
+        layout.rowOffsets.removeLast();
+    appendColumns(block, blockRows, rowOffsets);
+    if (extend && layout.rowOffsets.size() == table.rowCount())
+    {
+        layout.rowOffsets.append(end);
+        layout.fileModified = QFileInfo(layout.filePath).lastModified();
+    }
+}
+
+TableChanges TableModel::takeChanges()
+{
+    TableChanges taken = changes;
+    changes.clear(table.rowCount());
+    return taken;
+}
+
+void TableModel::restoreChanges(const TableChanges &unsaved)
+{
+    TableChanges restored = unsaved;
+    restored.merge(changes);
+    changes = restored;
+}
+
+void TableModel::setRowOrder(const QVector<int> &rows)
+{
+    beginResetModel();
+    order = rows;
+    ordered = true;
+    endResetModel();
+}
+
+void TableModel::clearRowOrder()
+{
+    if (!ordered)
+        return;
+
+    beginResetModel();
+    order.clear();
+    ordered = false;
+    endResetModel();
+}
+
+int TableModel::replaceTexts(const QVector<quint64> &cells, const QStringList &texts)
+{
+    QVector<quint64> changed;
+    int top = rowCount();
+    int left = columnCount();
+    int bottom = -1;
+    int right = -1;
+    for (int i = 0; i < cells.size(); ++i)
+    {
+        const int row = FormulaSheet::keyRow(cells.at(i));
+        const int column = FormulaSheet::keyColumn(cells.at(i));
+        const int dataRow = sourceRow(row);
+        if (formulas.contains(dataRow, column))
+            continue;
+
+        table.setText(dataRow, column, texts.at(i));
+        changes.markRow(dataRow);
+        changed.append(FormulaSheet::key(dataRow, column));
+        top = qMin(top, row);
+        bottom = qMax(bottom, row);
+        left = qMin(left, column);
+        right = qMax(right, column);
+    }
+    if (changed.isEmpty())
+        return 0;
+
+    emit dataChanged(index(top, left), index(bottom, right), QVector<int>() << Qt::DisplayRole << Qt::EditRole);
+    if (!formulas.isEmpty())
+        recalculate(changed);
+    return changed.size();
+}
+
+void TableModel::pasteBlock(int row, int column, const QVector<TableColumn> &block, int blockRows)
+{
+    const int blockColumns = block.size();
+    if (blockRows <= 0 || blockColumns == 0)
+        return;
+
+    // Расти может только исходный порядок строк: вставка идёт от той же строки данных
+    if (row + blockRows > rowCount() && ordered)
+    {
+        row = row < order.size() ? order.at(row) : table.rowCount();
+        clearRowOrder();
+    }
+    if (row + blockRows > rowCount())
+        insertRows(rowCount(), row + blockRows - rowCount());
+    if (column + blockColumns > columnCount())
+        insertColumns(columnCount(), column + blockColumns - columnCount());
+
+    QVector<quint64> changed;
+    for (int i = 0; i < blockRows; ++i)
+    {
+        const int dataRow = sourceRow(row + i);
+        for (int j = 0; j < blockColumns; ++j)
+        {
+            if (formulas.contains(dataRow, column + j))
+            {
+                formulas.removeFormula(dataRow, column + j);
+                changes.formulasDirty = true;
+            }
+            table.setBytes(dataRow, column + j, block.at(j).bytes(i));
+            if (!formulas.isEmpty())
+                changed.append(FormulaSheet::key(dataRow, column + j));
+        }
+        changes.markRow(dataRow);
+    }
+
+    emit dataChanged(index(row, column), index(row + blockRows - 1, column + blockColumns - 1),
+                     QVector<int>() << Qt::DisplayRole << Qt::EditRole);
+    if (!changed.isEmpty())
+        recalculate(changed);
+}
+
+void TableModel::setColumnTitles(const QStringList &columnTitles)
+{
+    titles = columnTitles;
+    if (columnCount() > 0)
+        emit headerDataChanged(Qt::Horizontal, 0, columnCount() - 1);
+}
+
+QString TableModel::columnLabel(int column) const
+{
+    const QString title = titles.value(column);
+    return title.isEmpty() ? tr("Столбец %1").arg(column + 1) : title;
+}
+
+QStringList TableModel::columnTitles() const
+{
+    QStringList all = titles.mid(0, columnCount());
+    while (all.size() < columnCount())
+    {
+        all.append(QString());
+    }
+    return all;
+}
+
+void TableModel::setCellStyle(int row, int column, const CellStyle &style)
+{
+    table.setStyle(sourceRow(row), column, style);
+    changes.stylesDirty = true;
+    QModelIndex cell = index(row, column);
+    emit dataChanged(cell, cell, QVector<int>() << Qt::ForegroundRole << Qt::BackgroundRole << Qt::FontRole << Qt::TextAlignmentRole);
+}
+
+void TableModel::setStyles(const QVector<CellStyle> &palette, const QVector<QVector<quint16>> &columnStyles)
+{
+    table.setStyles(palette, columnStyles);
+    resolvedStyles.clear();
+    if (rowCount() > 0 && columnCount() > 0)
+        emit dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1), QVector<int>() << Qt::ForegroundRole << Qt::BackgroundRole << Qt::FontRole << Qt::TextAlignmentRole);
+}
+
+bool TableModel::setFormulas(const QVector<FormulaSidecar::Entry> &entries)
+{
+    formulas = FormulaSheet();
+    QVector<quint64> stale;
+    for (const FormulaSidecar::Entry &entry : entries)
+    {
+        if (entry.row >= table.rowCount() || entry.column >= table.columnCount())
+            continue;
+        formulas.setFormula(entry.row, entry.column, entry.source);
+
+        // Пересчитываем только формулы, чьё сохранённое значение разошлось с ячейкой CSV
+        if (table.text(entry.row, entry.column) != entry.value)
+            stale.append(FormulaSheet::key(entry.row, entry.column));
+    }
+    if (stale.isEmpty())
+        return false;
+
+    // Пересчитанные значения есть только в таблице: файл и файл формул нужно сохранить заново
+    const QVector<quint64> updated = formulas.recalculate(table, stale);
+    if (updated.isEmpty())
+        return false;
+    changes.formulasDirty = true;
+    notifyRecalculated(updated);
+    return true;
+}
+
+void TableModel::recalculate(const QVector<quint64> &changed)
+{
+    notifyRecalculated(formulas.recalculate(table, changed));
+}
+
+void TableModel::recalculateAll()
+{
+    // После сдвига строк и столбцов ссылки в формулах переписаны — считаем всё заново
+    if (formulas.isEmpty())
+        return;
+    changes.formulasDirty = true;
+    notifyRecalculated(formulas.recalculateAll(table));
+}
+
+void TableModel::notifyRecalculated(const QVector<quint64> &updated)
+{
+    if (updated.isEmpty())
+        return;
+
+    for (quint64 cell : updated)
+    {
+        changes.markRow(FormulaSheet::keyRow(cell));
+    }
+
+    // Немного ячеек без перестановки строк — сообщаем о каждой, иначе обо всей таблице
+    const QVector<int> roles = QVector<int>() << Qt::DisplayRole << Qt::EditRole;
+    if (!ordered && updated.size() <= 256)
+    {
+        for (quint64 cell : updated)
+        {
+            const QModelIndex changed = index(FormulaSheet::keyRow(cell), FormulaSheet::keyColumn(cell));
+            emit dataChanged(changed, changed, roles);
+        }
+    }
+    else if (rowCount() > 0 && columnCount() > 0)
+    {
+        emit dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1), roles);
+    }
+}
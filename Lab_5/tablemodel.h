@@ -0,0 +1,115 @@
+#ifndef TABLEMODEL_H
+#define TABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QStringList>
+
+#include "tabledata.h"
+#include "formulasidecar.h"
+
+// Модель табличной вкладки: данные хранятся по столбцам в TableData,
+// QTableView запрашивает только видимые ячейки, объектов на ячейку нет
+class TableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit TableModel(int rows = 0, int columns = 0, QObject *parent = nullptr);
+    TableModel(int rows, int columns, TableData::Storage storage, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool insertColumns(int column, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool removeColumns(int column, int count, const QModelIndex &parent = QModelIndex()) override;
+
+    // Блок строк от загрузчика CSV: столбцы приходят уже в формате хранения
+    void appendColumns(const QVector<TableColumn> &block, int blockRows, const QVector<qint64> &rowOffsets = QVector<qint64>());
+    void finishLoad(const QString &filePath, const CsvDialect &dialect, qint64 dataEnd);
+    // Строки, дописанные в конец файла другой программой: раскладка файла продлевается
+    // до end (конец последней строки блока), сохранять их обратно не нужно
+    void appendFileTail(const QVector<TableColumn> &block, int blockRows, const QVector<qint64> &rowOffsets, qint64 end);
+
+    // Частичное сохранение: сериализатор забирает накопленные изменения вместе со снимком,
+    // после записи модель получает новую раскладку файла (или изменения обратно при ошибке)
+    const CsvLayout &fileLayout() const { return layout; }
+    void setFileLayout(const CsvLayout &fileLayout) { layout = fileLayout; }
+    TableChanges takeChanges();
+    void restoreChanges(const TableChanges &unsaved);
+
+    // Порядок строк после сортировки и фильтра: строка представления -> строка TableData.
+    // Меняется только отображение, данные и файл остаются в исходном порядке
+    bool hasRowOrder() const { return ordered; }
+    void setRowOrder(const QVector<int> &rows);
+    void clearRowOrder();
+    int sourceRow(int row) const { return ordered ? order.at(row) : row; }
+    const QVector<int> &rowOrder() const { return order; }
+    // Растёт при вставке и удалении строк: результат запроса к старому снимку применять нельзя
+    int structureRevision() const { return revision; }
+
+    // Заголовки столбцов для таблиц-отчётов (сводная таблица) и CSV со строкой заголовков;
+    // у остальных таблиц — номера
+    void setColumnTitles(const QStringList &columnTitles);
+    // Заголовки по всем столбцам; у столбцов без заголовка пустая строка
+    QStringList columnTitles() const;
+    // Название столбца для диалогов: заголовок или «Столбец N», если заголовка нет
+    QString columnLabel(int column) const;
+
+    const TableData &tableData() const { return table; }
+    QString text(int row, int column) const { return table.text(sourceRow(row), column); }
+    CellStyle cellStyle(int row, int column) const { return table.style(sourceRow(row), column); }
+    void setCellStyle(int row, int column, const CellStyle &style);
+    void setStyles(const QVector<CellStyle> &palette, const QVector<QVector<quint16>> &columnStyles);
+
+    // Формулы: текст, начинающийся с '=', попадает в FormulaSheet, в ячейке остаётся значение.
+    // Правка ячейки пересчитывает зависящие от неё формулы
+    const FormulaSheet &formulaSheet() const { return formulas; }
+
+    // Замена текста многих ячеек (FormulaSheet::key в строках представления) одним обновлением
+    // представления и одним пересчётом формул; ячейки с формулами пропускаются. Возвращает число замен
+    int replaceTexts(const QVector<quint64> &cells, const QStringList &texts);
+    // Вставка прямоугольника ячеек с левым верхним углом в (row, column); таблица при нужде
+    // растёт одной вставкой строк и одной вставкой столбцов, ячейки обновляются одним сигналом
+    void pasteBlock(int row, int column, const QVector<TableColumn> &block, int blockRows);
+    // Формулы из файла формул; вызывается после finishLoad. true — значения части формул
+    // в CSV устарели и пересчитаны: их строки помечены изменёнными
+    bool setFormulas(const QVector<FormulaSidecar::Entry> &entries);
+
+signals:
+    // Пользователь изменил текст ячейки (загрузка и оформление сюда не попадают)
+    void cellEdited(int row, int column);
+
+private:
+    // Значения ролей оформления одного стиля палитры; строятся при первой отрисовке ячейки с ним
+    struct StyleRoles
+    {
+        bool resolved = false;
+        QVariant foreground;
+        QVariant background;
+        QVariant font;
+        QVariant alignment;
+    };
+
+    const StyleRoles &styleRoles(int id) const;
+    void recalculate(const QVector<quint64> &changed);
+    void recalculateAll();
+    void notifyRecalculated(const QVector<quint64> &updated);
+
+    TableData table;
+    FormulaSheet formulas;
+    TableChanges changes;
+    CsvLayout layout;
+    QVector<int> order;
+    QStringList titles;
+    mutable QVector<StyleRoles> resolvedStyles; // По номеру стиля палитры
+    bool ordered = false;
+    int revision = 0;
+};
+
+#endif // TABLEMODEL_H
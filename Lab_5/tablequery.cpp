@@ -0,0 +1,430 @@
+#include "tablequery.h"
+
+#include <QThread>
+#include <QDate>
+#include <QRegularExpression>
+#include <QtConcurrent>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+namespace
+{
+    const int MinRowsPerTask = 16 * 1024; // Меньшие куски не окупают передачу в другой поток
+
+    // Доступ к ячейкам одного столбца: у плотной таблицы — напрямую к TableColumn без копирования,
+    // у разреженной — через SparseGrid
+    class CellReader
+    {
+    public:
+        CellReader(const TableData &table, int column) : table(&table),
+                                                         column(column),
+                                                         dense(table.isSparse() ? nullptr : &table.column(column))
+        {
+        }
+
+        TableColumn::Type type() const { return dense ? dense->type() : TableColumn::Text; }
+        const TableColumn *denseColumn() const { return dense; }
+
+        bool isEmpty(int row) const
+        {
+            return dense ? dense->isEmpty(row) : table->sparseGrid().bytes(row, column).isEmpty();
+        }
+
+        QString text(int row) const
+        {
+            return dense ? dense->text(row) : table->text(row, column);
+        }
+
+        double number(int row, bool *ok) const
+        {
+            return dense ? dense->number(row, ok) : table->sparseGrid().bytes(row, column).toDouble(ok);
+        }
+
+        // Сравнение непустых ячеек: числа и даты по значению, текст по байтам UTF-8 (порядок кодов символов)
+        int compare(int a, int b) const
+        {
+            if (!dense)
+            {
+                const QByteArray left = table->sparseGrid().bytes(a, column);
+                const QByteArray right = table->sparseGrid().bytes(b, column);
+                return compareBytes(left.constData(), left.size(), right.constData(), right.size());
+            }
+
+            switch (dense->type())
+            {
+            case TableColumn::Integer:
+            case TableColumn::Date:
+                return compareValues(dense->integerAt(a), dense->integerAt(b));
+            case TableColumn::Real:
+                return compareValues(dense->realAt(a), dense->realAt(b));
+            default:
+                return compareBytes(dense->rawData(a), dense->rawSize(a), dense->rawData(b), dense->rawSize(b));
+            }
+        }
+
+    private:
+        template <typename T>
+        static int compareValues(T left, T right)
+        {
+            return left < right ? -1 : (right < left ? 1 : 0);
+        }
+
+        static int compareBytes(const char *left, int leftSize, const char *right, int rightSize)
+        {
+            const int result = std::memcmp(left, right, qMin(leftSize, rightSize));
+            return result != 0 ? result : leftSize - rightSize;
+        }
+
+        const TableData *table;
+        int column;
+        const TableColumn *dense;
+    };
+
+    // Фильтр, подготовленный к проверке строк: значения условия разобраны один раз под тип столбца
+    class RowMatcher
+    {
+    public:
+        RowMatcher(const TableData &table, const RowFilter &filter) : reader(table, filter.column),
+                                                                      filter(filter)
+        {
+            const TableColumn::Type type = reader.type();
+            switch (filter.kind)
+            {
+            case RowFilter::Equals:
+                valueUtf8 = filter.value.toUtf8();
+                if (type == TableColumn::Integer)
+                    valueParsed = parseInteger(filter.value, lowerInteger);
+                else if (type == TableColumn::Real)
+                    lowerNumber = filter.value.toDouble(&valueParsed);
+                else if (type == TableColumn::Date)
+                    valueParsed = parseDate(filter.value, lowerInteger);
+                break;
+            case RowFilter::Range:
+                prepareRange(type);
+                break;
+            case RowFilter::RegExp:
+                regex.setPattern(filter.value);
+                break;
+            default:
+                break;
+            }
+        }
+
+        bool matches(int row) const
+        {
+            switch (filter.kind)
+            {
+            case RowFilter::Equals:
+                return matchesEquals(row);
+            case RowFilter::Contains:
+                return filter.value.isEmpty() || reader.text(row).contains(filter.value, Qt::CaseInsensitive);
+            case RowFilter::Range:
+                return matchesRange(row);
+            case RowFilter::RegExp:
+                return regex.match(reader.text(row)).hasMatch();
+            }
+            return false;
+        }
+
+    private:
+        enum RangeMode
+        {
+            TextRange,
+            NumberRange,
+            DateRange
+        };
+
+        static bool parseInteger(const QString &text, qint64 &value)
+        {
+            bool ok = false;
+            value = text.toLongLong(&ok);
+            return ok;
+        }
+
+        static bool parseDate(const QString &text, qint64 &value)
+        {
+            QDate date = QDate::fromString(text, Qt::ISODate);
+            value = date.toJulianDay();
+            return date.isValid();
+        }
+
+        void prepareRange(TableColumn::Type type)
+        {
+            hasLower = !filter.value.isEmpty();
+            hasUpper = !filter.upper.isEmpty();
+
+            // Столбец дат сравнивается по датам, если границы — даты
+            if (type == TableColumn::Date &&
+                (!hasLower || parseDate(filter.value, lowerInteger)) &&
+                (!hasUpper || parseDate(filter.upper, upperInteger)))
+            {
+                mode = DateRange;
+                return;
+            }
+
+            // Числовые границы сравниваются как числа и в текстовом столбце
+            bool lowerOk = true;
+            bool upperOk = true;
+            if (hasLower)
+                lowerNumber = filter.value.toDouble(&lowerOk);
+            if (hasUpper)
+                upperNumber = filter.upper.toDouble(&upperOk);
+            mode = lowerOk && upperOk ? NumberRange : TextRange;
+        }
+
+        bool matchesEquals(int row) const
+        {
+            if (filter.value.isEmpty())
+                return reader.isEmpty(row);
+
+            const TableColumn *column = reader.denseColumn();
+            switch (reader.type())
+            {
+            case TableColumn::Integer:
+            case TableColumn::Date:
+                return valueParsed && !column->isEmpty(row) && column->integerAt(row) == lowerInteger;
+            case TableColumn::Real:
+                return valueParsed && !column->isEmpty(row) && column->realAt(row) == lowerNumber;
+            default:
+                break;
+            }
+
+            if (!column)
+                return reader.text(row) == filter.value;
+            return column->rawSize(row) == valueUtf8.size() &&
+                   std::memcmp(column->rawData(row), valueUtf8.constData(), valueUtf8.size()) == 0;
+        }
+
+        bool matchesRange(int row) const
+        {
+            if (reader.isEmpty(row))
+                return false;
+
+            switch (mode)
+            {
+            case DateRange:
+            {
+                const qint64 day = reader.denseColumn()->integerAt(row);
+                return (!hasLower || day >= lowerInteger) && (!hasUpper || day <= upperInteger);
+            }
+            case NumberRange:
+            {
+                bool ok = false;
+                const double value = reader.number(row, &ok);
+                return ok && (!hasLower || value >= lowerNumber) && (!hasUpper || value <= upperNumber);
+            }
+            default:
+            {
+                const QString text = reader.text(row);
+                return (!hasLower || text.compare(filter.value) >= 0) && (!hasUpper || text.compare(filter.upper) <= 0);
+            }
+            }
+        }
+
+        CellReader reader;
+        RowFilter filter;
+        QByteArray valueUtf8;
+        QRegularExpression regex;
+        RangeMode mode = TextRange;
+        bool valueParsed = false;
+        bool hasLower = false;
+        bool hasUpper = false;
+        qint64 lowerInteger = 0;
+        qint64 upperInteger = 0;
+        double lowerNumber = 0;
+        double upperNumber = 0;
+    };
+
+    // Номера строк [first, last), прошедших все фильтры; каждая задача строит свои RowMatcher
+    QVector<int> filterRange(const TableData &snapshot, const QVector<RowFilter> &filters, int first, int last)
+    {
+        QVector<RowMatcher> matchers;
+        matchers.reserve(filters.size());
+        for (const RowFilter &filter : filters)
+        {
+            matchers.append(RowMatcher(snapshot, filter));
+        }
+
+        QVector<int> rows;
+        for (int i = first; i < last; ++i)
+        {
+            bool accepted = true;
+            for (const RowMatcher &matcher : matchers)
+            {
+                if (!matcher.matches(i))
+                {
+                    accepted = false;
+                    break;
+                }
+            }
+            if (accepted)
+                rows.append(i);
+        }
+        return rows;
+    }
+
+    // Порядок строк по ключам; пустые ячейки последними при любом направлении
+    class RowLess
+    {
+    public:
+        RowLess(const TableData &table, const QVector<SortKey> &keys)
+        {
+            for (const SortKey &key : keys)
+            {
+                readers.append(CellReader(table, key.column));
+                descending.append(key.order == Qt::DescendingOrder);
+            }
+        }
+
+        bool operator()(int a, int b) const
+        {
+            for (int k = 0; k < readers.size(); ++k)
+            {
+                const CellReader &reader = readers.at(k);
+                const bool emptyA = reader.isEmpty(a);
+                const bool emptyB = reader.isEmpty(b);
+                if (emptyA || emptyB)
+                {
+                    if (emptyA != emptyB)
+                        return emptyB;
+                    continue;
+                }
+
+                const int result = reader.compare(a, b);
+                if (result != 0)
+                    return descending.at(k) ? result > 0 : result < 0;
+            }
+            return false;
+        }
+
+    private:
+        QVector<CellReader> readers;
+        QVector<bool> descending;
+    };
+}
+
+TableQuery::TableQuery(QObject *parent) : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<QVector<int>>::finished, this, [this]()
+            {
+                emit finished(watcher.result());
+            });
+}
+
+TableQuery::~TableQuery()
+{
+    watcher.waitForFinished();
+}
+
+bool TableQuery::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+void TableQuery::run(const TableData &snapshot, const QVector<RowFilter> &filters, const QVector<SortKey> &keys)
+{
+    watcher.setFuture(QtConcurrent::run(&TableQuery::rowOrder, snapshot, filters, keys));
+}
+
+QVector<int> TableQuery::rowOrder(const TableData &snapshot, const QVector<RowFilter> &filters, const QVector<SortKey> &keys)
+{
+    QVector<int> rows = filterRows(snapshot, filters);
+    sortRows(snapshot, rows, keys);
+    return rows;
+}
+
+QVector<int> TableQuery::filterRows(const TableData &snapshot, const QVector<RowFilter> &filters)
+{
+    const int rows = snapshot.rowCount();
+    if (filters.isEmpty())
+    {
+        QVector<int> all(rows);
+        std::iota(all.begin(), all.end(), 0);
+        return all;
+    }
+
+    // Куски проверяются параллельно, результаты склеиваются по порядку — номера остаются возрастающими
+    const int parts = qMax(1, QThread::idealThreadCount()) * 4;
+    const int step = qMax(MinRowsPerTask, (rows + parts - 1) / parts);
+    QList<QFuture<QVector<int>>> pending;
+    for (int first = 0; first < rows; first += step)
+    {
+        pending.append(QtConcurrent::run(&filterRange, snapshot, filters, first, qMin(first + step, rows)));
+    }
+
+    QVector<int> result;
+    for (QFuture<QVector<int>> &part : pending)
+    {
+        result += part.result();
+    }
+    return result;
+}
+
+void TableQuery::sortRows(const TableData &snapshot, QVector<int> &rows, const QVector<SortKey> &keys)
+{
+    if (keys.isEmpty() || rows.size() < 2)
+        return;
+
+    const RowLess less(snapshot, keys);
+
+    // Куски сортируются устойчиво в своих потоках, затем попарно сливаются; std::merge при равенстве
+    // берёт элемент из левого куска, поэтому итоговый порядок тоже устойчивый
+    const int size = rows.size();
+    const int parts = qMax(1, QThread::idealThreadCount());
+    const int step = qMax(MinRowsPerTask, (size + parts - 1) / parts);
+    QVector<int> bounds;
+    for (int first = 0; first < size; first += step)
+    {
+        bounds.append(first);
+    }
+    bounds.append(size);
+
+    int *data = rows.data();
+    QList<QFuture<void>> pending;
+    for (int k = 0; k + 1 < bounds.size(); ++k)
+    {
+        const int first = bounds.at(k);
+        const int last = bounds.at(k + 1);
+        pending.append(QtConcurrent::run([data, first, last, &less]()
+                                         { std::stable_sort(data + first, data + last, less); }));
+    }
+    for (QFuture<void> &part : pending)
+    {
+        part.waitForFinished();
+    }
+
+    QVector<int> buffer(size);
+    while (bounds.size() > 2)
+    {
+        const int *source = rows.constData();
+        int *target = buffer.data();
+        QVector<int> merged;
+        merged.append(0);
+        pending.clear();
+
+        int k = 0;
+        for (; k + 2 < bounds.size(); k += 2)
+        {
+            const int first = bounds.at(k);
+            const int middle = bounds.at(k + 1);
+            const int last = bounds.at(k + 2);
+            pending.append(QtConcurrent::run([source, target, first, middle, last, &less]()
+                                             { std::merge(source + first, source + middle, source + middle, source + last, target + first, less); }));
+            merged.append(last);
+        }
+        if (k + 1 < bounds.size())
+        {
+            // Нечётный кусок без пары переносится как есть
+            std::copy(source + bounds.at(k), source + bounds.at(k + 1), target + bounds.at(k));
+            merged.append(bounds.at(k + 1));
+        }
+        for (QFuture<void> &part : pending)
+        {
+            part.waitForFinished();
+        }
+
+        rows.swap(buffer);
+        bounds = merged;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef TABLEQUERY_H
+#define TABLEQUERY_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "tabledata.h"
+
+// Условие отбора строк по одному столбцу
+struct RowFilter
+{
+    enum Kind
+    {
+        Equals,
+        Contains,  // Без учёта регистра
+        Range,     // value — нижняя граница, upper — верхняя; пустая граница не ограничивает
+        RegExp
+    };
+
+    int column = 0;
+    Kind kind = Equals;
+    QString value;
+    QString upper;
+};
+
+// Ключ сортировки; пустые ячейки при любом направлении идут последними
+struct SortKey
+{
+    int column = 0;
+    Qt::SortOrder order = Qt::AscendingOrder;
+};
+
+// Отбор и устойчивая сортировка строк по нескольким ключам. Работает в пуле потоков
+// над снимком TableData и выдаёт только номера строк — сами данные не перемещаются
+class TableQuery : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TableQuery(QObject *parent = nullptr);
+    ~TableQuery() override;
+
+    bool isRunning() const;
+    void run(const TableData &snapshot, const QVector<RowFilter> &filters, const QVector<SortKey> &keys);
+
+    // Синхронный вариант: номера строк snapshot, прошедших все фильтры, в порядке ключей
+    static QVector<int> rowOrder(const TableData &snapshot, const QVector<RowFilter> &filters, const QVector<SortKey> &keys);
+    // Устойчивая параллельная сортировка готового набора номеров строк
+    static void sortRows(const TableData &snapshot, QVector<int> &rows, const QVector<SortKey> &keys);
+
+signals:
+    void finished(const QVector<int> &rows);
+
+private:
+    static QVector<int> filterRows(const TableData &snapshot, const QVector<RowFilter> &filters);
+
+    QFutureWatcher<QVector<int>> watcher;
+};
+
+#endif // TABLEQUERY_H
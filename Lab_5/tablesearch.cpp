@@ -0,0 +1,174 @@
+#include "tablesearch.h"
+#include "formulasheet.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace
+{
+    const int MinRowsPerTask = 64 * 1024; // Меньшие части не окупают передачу в другой поток
+
+    // Часть одного столбца в строках представления [first, last]
+    struct ScanTask
+    {
+        int column;
+        int first;
+        int last;
+    };
+
+    QVector<int> scanColumn(const TableData &snapshot, const QVector<int> &rowOrder, const CellMatcher &matcher,
+                            const ScanTask &task)
+    {
+        QVector<int> rows;
+        const bool ordered = !rowOrder.isEmpty();
+        if (snapshot.isSparse())
+        {
+            for (int i = task.first; i <= task.last; ++i)
+            {
+                const QByteArray bytes = snapshot.sparseGrid().bytes(ordered ? rowOrder.at(i) : i, task.column);
+                if (matcher.matches(bytes.constData(), bytes.size()))
+                    rows.append(i);
+            }
+            return rows;
+        }
+
+        const TableColumn &column = snapshot.column(task.column);
+        const bool text = column.type() == TableColumn::Text;
+        for (int i = task.first; i <= task.last; ++i)
+        {
+            const int row = ordered ? rowOrder.at(i) : i;
+            if (text)
+            {
+                if (matcher.matches(column.rawData(row), column.rawSize(row)))
+                    rows.append(i);
+            }
+            else if (!column.isEmpty(row))
+            {
+                const QByteArray bytes = column.bytes(row);
+                if (matcher.matches(bytes.constData(), bytes.size()))
+                    rows.append(i);
+            }
+        }
+        return rows;
+    }
+}
+
+CellMatcher::CellMatcher(const TableSearchOptions &options) : needle(options.text)
+{
+    if (options.wholeWord)
+    {
+        // \b не знает кириллицы, поэтому границы слова задаются явно, как в поиске по тексту
+        mode = Words;
+        words.setPattern("(?<![\\p{L}\\d_])" + QRegularExpression::escape(options.text) + "(?![\\p{L}\\d_])");
+        if (!options.caseSensitive)
+            words.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+    }
+    else if (options.caseSensitive)
+    {
+        mode = Bytes;
+        matcher.setPattern(options.text.toUtf8());
+    }
+    else
+    {
+        mode = Text;
+    }
+}
+
+bool CellMatcher::matches(const char *utf8, int size) const
+{
+    if (size == 0 || needle.isEmpty())
+        return false;
+
+    switch (mode)
+    {
+    case Bytes:
+        return matcher.indexIn(utf8, size) >= 0;
+    case Text:
+        return QString::fromUtf8(utf8, size).contains(needle, Qt::CaseInsensitive);
+    case Words:
+        return words.match(QString::fromUtf8(utf8, size)).hasMatch();
+    }
+    return false;
+}
+
+QString CellMatcher::replaced(const QString &text, const QString &replacement) const
+{
+    QString result = text;
+    if (mode == Words)
+    {
+        // Замена вставляется буквально: обратная косая черта не должна ссылаться на группы
+        QString literal = replacement;
+        literal.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+        return result.replace(words, literal);
+    }
+    return result.replace(needle, replacement, mode == Bytes ? Qt::CaseSensitive : Qt::CaseInsensitive);
+}
+
+QVector<quint64> TableSearch::findAll(const TableData &snapshot, const QVector<int> &rowOrder,
+                                      const QVector<CellRange> &ranges, const TableSearchOptions &options)
+{
+    const CellMatcher matcher(options);
+    const int rows = rowOrder.isEmpty() ? snapshot.rowCount() : rowOrder.size();
+    const int columns = snapshot.columnCount();
+    QVector<quint64> found;
+
+    // Разреженная таблица в исходном порядке: пустые блоки не просматриваются вовсе
+    if (snapshot.isSparse() && rowOrder.isEmpty())
+    {
+        const SparseGrid &grid = snapshot.sparseGrid();
+        for (const QPair<int, int> &origin : grid.chunkOrigins())
+        {
+            for (const CellRange &range : ranges)
+            {
+                const int firstRow = qMax(qMax(range.top, 0), origin.first);
+                const int lastRow = qMin(qMin(range.bottom, rows - 1), origin.first + SparseGrid::ChunkRows - 1);
+                const int firstColumn = qMax(qMax(range.left, 0), origin.second);
+                const int lastColumn = qMin(qMin(range.right, columns - 1), origin.second + SparseGrid::ChunkColumns - 1);
+                for (int i = firstRow; i <= lastRow; ++i)
+                {
+                    for (int j = firstColumn; j <= lastColumn; ++j)
+                    {
+                        const QByteArray bytes = grid.bytes(i, j);
+                        if (matcher.matches(bytes.constData(), bytes.size()))
+                            found.append(FormulaSheet::key(i, j));
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        QVector<ScanTask> tasks;
+        for (const CellRange &range : ranges)
+        {
+            const int top = qMax(range.top, 0);
+            const int bottom = qMin(range.bottom, rows - 1);
+            for (int j = qMax(range.left, 0); j <= qMin(range.right, columns - 1); ++j)
+            {
+                for (int first = top; first <= bottom; first += MinRowsPerTask)
+                {
+                    tasks.append(ScanTask{j, first, qMin(first + MinRowsPerTask - 1, bottom)});
+                }
+            }
+        }
+
+        QList<QFuture<QVector<int>>> pending;
+        for (const ScanTask &task : tasks)
+        {
+            pending.append(QtConcurrent::run([&snapshot, &rowOrder, &matcher, task]()
+                                             { return scanColumn(snapshot, rowOrder, matcher, task); }));
+        }
+        for (int t = 0; t < tasks.size(); ++t)
+        {
+            for (int row : pending[t].result())
+            {
+                found.append(FormulaSheet::key(row, tasks.at(t).column));
+            }
+        }
+    }
+
+    // Пересекающиеся области выделения дают одну ячейку дважды
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    return found;
+}
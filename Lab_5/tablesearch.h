@@ -0,0 +1,54 @@
+#ifndef TABLESEARCH_H
+#define TABLESEARCH_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArrayMatcher>
+#include <QRegularExpression>
+
+#include "tabledata.h"
+#include "selectionstats.h"
+
+struct TableSearchOptions
+{
+    QString text;
+    bool caseSensitive = false;
+    bool wholeWord = false;
+};
+
+// Проверка и замена текста ячейки. С учётом регистра и без границ слов поиск идёт по байтам
+// UTF-8 без перевода ячейки в QString
+class CellMatcher
+{
+public:
+    explicit CellMatcher(const TableSearchOptions &options);
+
+    bool matches(const char *utf8, int size) const;
+    QString replaced(const QString &text, const QString &replacement) const;
+
+private:
+    enum Mode
+    {
+        Bytes,
+        Text, // Без учёта регистра
+        Words
+    };
+
+    Mode mode;
+    QString needle;
+    QByteArrayMatcher matcher;
+    QRegularExpression words;
+};
+
+// Поиск по ячейкам таблицы. Столбцы (и длинные столбцы по частям) просматриваются в пуле потоков
+class TableSearch
+{
+public:
+    // ranges — области поиска в строках представления, rowOrder — строки TableData за строками
+    // представления (пусто — исходный порядок). Результат — FormulaSheet::key(строка представления,
+    // столбец) по строкам, затем по столбцам
+    static QVector<quint64> findAll(const TableData &snapshot, const QVector<int> &rowOrder,
+                                    const QVector<CellRange> &ranges, const TableSearchOptions &options);
+};
+
+#endif // TABLESEARCH_H
@@ -0,0 +1,401 @@
+#include "tableserializer.h"
+#include "csvtokenizer.h"
+#include "csvsniffer.h"
+#include "stylesidecar.h"
+#include "formulasidecar.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+namespace
+{
+    const int BufferSize = 1024 * 1024; // Данные уходят на диск порциями примерно по мегабайту
+
+    // Перевод строки пишем сами: файл открыт в двоичном режиме, чтобы смещения строк были точными.
+    // У открытого файла он свой, у новой таблицы — как принято на платформе
+#ifdef Q_OS_WIN
+    const char LineEnd[] = "\r\n";
+#else
+    const char LineEnd[] = "\n";
+#endif
+
+    QByteArray lineEndOf(const CsvDialect &dialect)
+    {
+        return dialect.lineEnd.isEmpty() ? QByteArray(LineEnd) : dialect.lineEnd;
+    }
+
+    // Сбрасывает накопленный буфер в файл, сохраняя выделенную под него память. Буфер
+    // кончается на границе записи, поэтому перекодировать его можно независимо от соседних
+    bool flushBuffer(QFileDevice &file, QByteArray &buffer, CsvDialect::Encoding encoding = CsvDialect::Utf8)
+    {
+        if (buffer.isEmpty())
+            return true;
+        bool ok = false;
+        if (encoding == CsvDialect::Utf8)
+        {
+            ok = file.write(buffer) == buffer.size();
+        }
+        else
+        {
+            const QByteArray encoded = CsvSniffer::fromUtf8(buffer, encoding);
+            ok = file.write(encoded) == encoded.size();
+        }
+        buffer.resize(0);
+        return ok;
+    }
+
+    // Метка порядка байтов и строка заголовков (в UTF-8, кодировку меняет flushBuffer)
+    bool writePreamble(QFileDevice &file, QByteArray &buffer, const CsvDialect &dialect, const CsvTokenizer &tokenizer)
+    {
+        const QByteArray bom = CsvSniffer::bomBytes(dialect);
+        if (file.write(bom) != bom.size())
+            return false;
+        if (dialect.hasHeader)
+        {
+            buffer.append(tokenizer.formatRecord(dialect.header));
+            buffer.chop(1);
+            buffer.append(lineEndOf(dialect));
+        }
+        return true;
+    }
+
+    // Поля одной строки плотной таблицы через разделитель, без перевода строки
+    void appendRow(QByteArray &out, const TableData &snapshot, int row, const CsvTokenizer &tokenizer)
+    {
+        const int columns = snapshot.columnCount();
+        if (columns == 1)
+        {
+            tokenizer.appendSoleField(out, snapshot.column(0).bytes(row));
+            return;
+        }
+        for (int j = 0; j < columns; ++j)
+        {
+            if (j > 0)
+                out.append(tokenizer.delimiter());
+            const TableColumn &column = snapshot.column(j);
+            if (column.type() == TableColumn::Text)
+                tokenizer.appendField(out, column.rawData(row), column.rawSize(row));
+            else
+                tokenizer.appendField(out, column.bytes(row));
+        }
+    }
+
+    // Длина перевода строки в конце записи [start, next): у исходного файла он может быть любым
+    int terminatorSize(QFile &file, qint64 start, qint64 next)
+    {
+        const qint64 length = qMin<qint64>(2, next - start);
+        if (length <= 0 || !file.seek(next - length))
+            return 0;
+        QByteArray tail = file.read(length);
+        if (tail.endsWith("\r\n"))
+            return 2;
+        if (tail.endsWith('\n') || tail.endsWith('\r'))
+            return 1;
+        return 0;
+    }
+}
+
+TableSerializer::TableSerializer(QObject *parent) : QObject(parent)
+{
+    connect(&watcher, &QFutureWatcher<SaveResult>::finished, this, [this]()
+            {
+                SaveResult result = watcher.result();
+                savedLayout = result.layout;
+                emit finished(result.errorMessage.isEmpty(), result.errorMessage);
+            });
+}
+
+TableSerializer::~TableSerializer()
+{
+    // Сохранение не прерываем: вкладку закрыли, но файл должен быть дописан
+    watcher.waitForFinished();
+}
+
+bool TableSerializer::isRunning() const
+{
+    return watcher.isRunning();
+}
+
+void TableSerializer::save(const TableData &snapshot, const FormulaSheet &formulas, const QString &csvPath, const QString &settingsPath,
+                           const QString &formulasPath, const CsvLayout &layout, const TableChanges &changes)
+{
+    pendingChanges = changes;
+    savedLayout = CsvLayout();
+    watcher.setFuture(QtConcurrent::run([=]()
+                                        { return write(snapshot, formulas, csvPath, settingsPath, formulasPath, layout, changes); }));
+}
+
+SaveResult TableSerializer::write(const TableData &snapshot, const FormulaSheet &formulas, const QString &csvPath, const QString &settingsPath,
+                                  const QString &formulasPath, const CsvLayout &layout, const TableChanges &changes)
+{
+    SaveResult result;
+    const bool sameFile = layout.filePath == csvPath;
+    const bool written = sameFile && canPatch(snapshot, layout) ? patchCsv(snapshot, layout, changes, result.layout)
+                                                                : writeCsv(snapshot, csvPath, layout.dialect, result.layout);
+    if (!written)
+    {
+        result.errorMessage = tr("Не удалось открыть файл для записи");
+        return result;
+    }
+
+    // Оформление переписываем, только если оно менялось или таблица сохраняется в другой файл
+    const bool settingsStale = changes.stylesDirty || !sameFile || !QFile::exists(settingsPath);
+    if (!settingsPath.isEmpty() && settingsStale && !writeSettings(snapshot, settingsPath))
+        result.errorMessage = tr("Не удалось сохранить настройки таблицы");
+
+    // Файл формул существует ровно тогда, когда в таблице есть формулы
+    const bool formulasStale = changes.formulasDirty || !sameFile || formulas.isEmpty() == QFile::exists(formulasPath);
+    if (!formulasPath.isEmpty() && formulasStale && !writeFormulas(snapshot, formulas, formulasPath))
+        result.errorMessage = tr("Не удалось сохранить формулы таблицы");
+    return result;
+}
+
+bool TableSerializer::canPatch(const TableData &snapshot, const CsvLayout &layout)
+{
+    if (snapshot.isSparse() || !layout.isValid())
+        return false;
+
+    // Файл изменили в обход нас — смещения строк больше ничего не значат
+    QFileInfo info(layout.filePath);
+    return info.exists() && info.size() == layout.rowOffsets.last() && info.lastModified() == layout.fileModified;
+}
+
+bool TableSerializer::patchCsv(const TableData &snapshot, const CsvLayout &layout, const TableChanges &changes, CsvLayout &written)
+{
+    // Файл правится на месте, а не через QSaveFile: иначе пришлось бы копировать его целиком
+    QFile file(layout.filePath);
+    if (!file.open(QIODevice::ReadWrite))
+        return false;
+
+    const QVector<qint64> &offsets = layout.rowOffsets;
+    const int diskRows = offsets.size() - 1;
+    const int rows = snapshot.rowCount();
+    int tailFrom = qMin(qMin(changes.rewriteFrom, rows), diskRows);
+
+    // Новые строки нельзя дописать вплотную к последней строке без перевода строки
+    if (tailFrom == diskRows && rows > diskRows && diskRows > 0 &&
+        terminatorSize(file, offsets.at(diskRows - 1), offsets.at(diskRows)) == 0)
+        tailFrom = diskRows - 1;
+
+    // Изменённые строки той же длины переписываем поверх старых байтов
+    const CsvTokenizer tokenizer(layout.dialect.delimiter, layout.dialect.quote);
+    const QByteArray lineEnd = lineEndOf(layout.dialect);
+    QByteArray line;
+    int remaining = changes.dirtyRows.count(true);
+    const int marked = qMin(changes.dirtyRows.size(), tailFrom);
+    for (int i = 0; i < marked && remaining > 0; ++i)
+    {
+        if (!changes.dirtyRows.testBit(i))
+            continue;
+        --remaining;
+
+        line.resize(0);
+        appendRow(line, snapshot, i, tokenizer);
+        const qint64 start = offsets.at(i);
+        const qint64 next = offsets.at(i + 1);
+        if (line.size() != next - start - terminatorSize(file, start, next))
+        {
+            // Длина строки изменилась: всё, что дальше, сдвигается — переписываем хвост с неё
+            tailFrom = i;
+            break;
+        }
+        if (!file.seek(start) || file.write(line) != line.size())
+            return false;
+    }
+
+    written.filePath = layout.filePath;
+    written.dialect = layout.dialect;
+    written.rowOffsets = offsets.mid(0, tailFrom);
+    if (tailFrom < rows || tailFrom < diskRows)
+    {
+        qint64 position = offsets.at(tailFrom);
+        if (!file.seek(position))
+            return false;
+
+        QByteArray buffer;
+        buffer.reserve(BufferSize + 64 * 1024);
+        for (int i = tailFrom; i < rows; ++i)
+        {
+            written.rowOffsets.append(position + buffer.size());
+            appendRow(buffer, snapshot, i, tokenizer);
+            buffer.append(lineEnd);
+
+            if (buffer.size() >= BufferSize)
+            {
+                position += buffer.size();
+                if (!flushBuffer(file, buffer))
+                    return false;
+            }
+        }
+        position += buffer.size();
+        if (!flushBuffer(file, buffer) || !file.resize(position))
+            return false;
+        written.rowOffsets.append(position);
+    }
+    else
+    {
+        written.rowOffsets.append(offsets.last());
+    }
+
+    file.close();
+    written.fileModified = QFileInfo(layout.filePath).lastModified();
+    return true;
+}
+
+bool TableSerializer::writeCsv(const TableData &snapshot, const QString &csvPath, const CsvDialect &dialect, CsvLayout &written)
+{
+    QSaveFile file(csvPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    // Для разреженной таблицы раскладку не запоминаем: её каждый раз пишем целиком
+    written.dialect = dialect;
+    if (snapshot.isSparse())
+        return writeSparseCsv(snapshot, dialect, file);
+
+    const CsvTokenizer tokenizer(dialect.delimiter, dialect.quote);
+    const QByteArray lineEnd = lineEndOf(dialect);
+    QByteArray buffer;
+    buffer.reserve(BufferSize + 64 * 1024);
+    if (!writePreamble(file, buffer, dialect, tokenizer))
+        return false;
+
+    const int rows = snapshot.rowCount();
+    QVector<qint64> offsets;
+    offsets.reserve(rows + 1);
+    qint64 position = CsvSniffer::bomBytes(dialect).size();
+    for (int i = 0; i < rows; ++i)
+    {
+        offsets.append(position + buffer.size());
+        appendRow(buffer, snapshot, i, tokenizer);
+        buffer.append(lineEnd);
+
+        if (buffer.size() >= BufferSize)
+        {
+            position += buffer.size();
+            if (!flushBuffer(file, buffer, dialect.encoding))
+                return false;
+        }
+    }
+    position += buffer.size();
+    if (!flushBuffer(file, buffer, dialect.encoding) || !file.commit())
+        return false;
+
+    // Смещения в UTF-8 верны только для файла в UTF-8; файл в другой кодировке всегда пишется целиком
+    offsets.append(position);
+    written.filePath = csvPath;
+    if (dialect.encoding == CsvDialect::Utf8)
+        written.rowOffsets = offsets;
+    written.fileModified = QFileInfo(csvPath).lastModified();
+    return true;
+}
+
+bool TableSerializer::writeSparseCsv(const TableData &snapshot, const CsvDialect &dialect, QSaveFile &file)
+{
+    const CsvTokenizer tokenizer(dialect.delimiter, dialect.quote);
+    const QByteArray lineEnd = lineEndOf(dialect);
+    QByteArray buffer;
+    buffer.reserve(BufferSize + 64 * 1024);
+    if (!writePreamble(file, buffer, dialect, tokenizer))
+        return false;
+
+    const int rows = snapshot.rowCount();
+    const int columns = snapshot.columnCount();
+    const SparseGrid &grid = snapshot.sparseGrid();
+    const QVector<QPair<int, int>> origins = grid.chunkOrigins();
+
+    // Пустая строка таблицы — одни разделители; такие строки пишем готовым шаблоном
+    QByteArray emptyLine(qMax(columns - 1, 0), tokenizer.delimiter());
+    if (columns == 1)
+        tokenizer.appendSoleField(emptyLine, QByteArray());
+    emptyLine.append(lineEnd);
+
+    int row = 0;
+    int chunk = 0;
+    while (row < rows)
+    {
+        if (chunk == origins.size() || origins.at(chunk).first > row)
+        {
+            const int next = chunk == origins.size() ? rows : qMin(origins.at(chunk).first, rows);
+            for (; row < next; ++row)
+            {
+                buffer.append(emptyLine);
+                if (buffer.size() >= BufferSize && !flushBuffer(file, buffer, dialect.encoding))
+                    return false;
+            }
+            continue;
+        }
+
+        // Полоса строк, в которой есть заполненные блоки: по ячейкам идём только внутри блоков
+        int bandEnd = chunk;
+        while (bandEnd < origins.size() && origins.at(bandEnd).first == row)
+        {
+            ++bandEnd;
+        }
+
+        const int last = qMin(row + SparseGrid::ChunkRows, rows);
+        for (int i = row; i < last; ++i)
+        {
+            int j = 0;
+            for (int b = chunk; b < bandEnd; ++b)
+            {
+                const int first = qMin(origins.at(b).second, columns);
+                const int stop = qMin(first + SparseGrid::ChunkColumns, columns);
+                for (; j < first; ++j)
+                {
+                    if (j > 0)
+                        buffer.append(tokenizer.delimiter());
+                }
+                for (; j < stop; ++j)
+                {
+                    if (j > 0)
+                        buffer.append(tokenizer.delimiter());
+                    if (columns == 1)
+                        tokenizer.appendSoleField(buffer, grid.bytes(i, j));
+                    else
+                        tokenizer.appendField(buffer, grid.bytes(i, j));
+                }
+            }
+            if (columns == 1 && j == 0)
+                tokenizer.appendSoleField(buffer, QByteArray());
+            for (; j < columns; ++j)
+            {
+                if (j > 0)
+                    buffer.append(tokenizer.delimiter());
+            }
+            buffer.append(lineEnd);
+
+            if (buffer.size() >= BufferSize && !flushBuffer(file, buffer, dialect.encoding))
+                return false;
+        }
+
+        row = last;
+        chunk = bandEnd;
+    }
+
+    return flushBuffer(file, buffer, dialect.encoding) && file.commit();
+}
+
+bool TableSerializer::writeSettings(const TableData &snapshot, const QString &settingsPath)
+{
+    QSaveFile file(settingsPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    return StyleSidecar::write(&file, snapshot) && file.commit();
+}
+
+bool TableSerializer::writeFormulas(const TableData &snapshot, const FormulaSheet &formulas, const QString &formulasPath)
+{
+    // Таблица без формул не оставляет после себя файл от прежних формул
+    if (formulas.isEmpty())
+        return !QFile::exists(formulasPath) || QFile::remove(formulasPath);
+
+    QSaveFile file(formulasPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    return FormulaSidecar::write(&file, formulas, snapshot) && file.commit();
+}
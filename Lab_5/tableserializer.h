@@ -0,0 +1,59 @@
+#ifndef TABLESERIALIZER_H
+#define TABLESERIALIZER_H
+
+#include <QObject>
+#include <QString>
+#include <QFutureWatcher>
+
+#include "tabledata.h"
+#include "formulasheet.h"
+
+class QSaveFile;
+
+// Итог фоновой записи: текст ошибки (пустой — успех) и раскладка записанного CSV
+struct SaveResult
+{
+    QString errorMessage;
+    CsvLayout layout;
+};
+
+// Сохранение таблицы в фоне: получает снимок TableData (копия без копирования ячеек),
+// в рабочем потоке пишет CSV, файлы оформления и формул через большой буфер и сообщает о результате.
+// CSV пишется в формате, в каком был открыт (CsvLayout::dialect): разделитель, кавычка,
+// перевод строки, кодировка и строка заголовков. Если известна раскладка файла на диске,
+// меняются только байты изменённых строк
+class TableSerializer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TableSerializer(QObject *parent = nullptr);
+    ~TableSerializer() override;
+
+    bool isRunning() const;
+    void save(const TableData &snapshot, const FormulaSheet &formulas, const QString &csvPath, const QString &settingsPath,
+              const QString &formulasPath, const CsvLayout &layout, const TableChanges &changes);
+
+    // Изменения, переданные последнему сохранению, и раскладка файла после него
+    const TableChanges &changes() const { return pendingChanges; }
+    const CsvLayout &fileLayout() const { return savedLayout; }
+
+signals:
+    void finished(bool success, const QString &errorMessage);
+
+private:
+    static SaveResult write(const TableData &snapshot, const FormulaSheet &formulas, const QString &csvPath, const QString &settingsPath,
+                            const QString &formulasPath, const CsvLayout &layout, const TableChanges &changes);
+    static bool canPatch(const TableData &snapshot, const CsvLayout &layout);
+    static bool patchCsv(const TableData &snapshot, const CsvLayout &layout, const TableChanges &changes, CsvLayout &written);
+    static bool writeCsv(const TableData &snapshot, const QString &csvPath, const CsvDialect &dialect, CsvLayout &written);
+    static bool writeSparseCsv(const TableData &snapshot, const CsvDialect &dialect, QSaveFile &file);
+    static bool writeSettings(const TableData &snapshot, const QString &settingsPath);
+    static bool writeFormulas(const TableData &snapshot, const FormulaSheet &formulas, const QString &formulasPath);
+
+    QFutureWatcher<SaveResult> watcher;
+    TableChanges pendingChanges;
+    CsvLayout savedLayout;
+};
+
+#endif // TABLESERIALIZER_H
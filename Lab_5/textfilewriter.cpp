@@ -0,0 +1,58 @@
+#include "textfilewriter.h"
+
+#include <QSaveFile>
+#include <QTextBlock>
+#include <QTextCodec>
+#include <QTextEncoder>
+#include <QScopedPointer>
+
+namespace
+{
+    const int BufferSize = 4 * 1024 * 1024; // Запись крупными порциями: системных вызовов мало, память не растёт с текстом
+
+    bool flush(QSaveFile &file, QByteArray &buffer)
+    {
+        if (buffer.isEmpty())
+            return true;
+        const bool written = file.write(buffer) == buffer.size();
+        buffer.resize(0);
+        return written;
+    }
+}
+
+bool TextFileWriter::save(const QTextDocument *document, const QString &path)
+{
+    // Текстовый режим сам заменяет \n на системный перевод строки
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QScopedPointer<QTextEncoder> encoder(QTextCodec::codecForLocale()->makeEncoder());
+    QByteArray buffer;
+    buffer.reserve(BufferSize);
+
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+    {
+        // Как в toPlainText: переносы внутри абзаца и неразрывные пробелы становятся обычными
+        QString text = block.text();
+        text.replace(QChar::LineSeparator, QLatin1Char('\n'));
+        text.replace(QChar::Nbsp, QLatin1Char(' '));
+        if (block.next().isValid())
+            text.append(QLatin1Char('\n'));
+
+        buffer.append(encoder->fromUnicode(text));
+        if (buffer.size() >= BufferSize && !flush(file, buffer))
+        {
+            file.cancelWriting();
+            return false;
+        }
+    }
+
+    if (!flush(file, buffer))
+    {
+        file.cancelWriting();
+        return false;
+    }
+    // commit сбрасывает данные на диск и только потом переименовывает временный файл
+    return file.commit();
+}
@@ -0,0 +1,18 @@
+#ifndef TEXTFILEWRITER_H
+#define TEXTFILEWRITER_H
+
+#include <QString>
+#include <QTextDocument>
+
+// Запись текста документа в файл без промежуточной копии всего текста (toPlainText):
+// абзацы по порядку кодируются в буфер, который сбрасывается во временный файл рядом
+// с целевым. Готовый файл синхронизируется с диском и заменяет целевой переименованием,
+// поэтому сбой посреди записи не обрезает прежнюю версию
+class TextFileWriter
+{
+public:
+    // Кодировка и переводы строк — как у QTextStream в текстовом режиме: системные
+    static bool save(const QTextDocument *document, const QString &path);
+};
+
+#endif // TEXTFILEWRITER_H
@@ -0,0 +1,176 @@
+#include "textformatsidecar.h"
+
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextFrame>
+#include <QHash>
+
+namespace
+{
+    const quint32 Magic = 0x544D4654; // "TFMT"
+    const quint16 Version = 1;
+    const quint32 MaxFormats = 0x10000;
+}
+
+bool TextFormatSidecar::canStore(const QTextDocument *document)
+{
+    return document->rootFrame()->childFrames().isEmpty();
+}
+
+TextFormatSidecar TextFormatSidecar::fromDocument(const QTextDocument *document)
+{
+    TextFormatSidecar sidecar;
+    sidecar.textLength = document->characterCount() - 1;
+    sidecar.textHash = hashOf(document);
+
+    // Номер формата в коллекции документа -> номер в таблице файла
+    QHash<int, quint32> index;
+    const QTextCharFormat plain;
+    // Конец предыдущего абзаца: с ним серия сливается через разделитель абзацев
+    int previousBlockEnd = -1;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+    {
+        const int blockStart = block.position();
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it)
+        {
+            const QTextFragment fragment = it.fragment();
+            const QTextCharFormat format = fragment.charFormat();
+            // Неоформленный текст так и загружается, серии для него не нужны
+            if (format == plain)
+                continue;
+
+            const int documentIndex = fragment.charFormatIndex();
+            auto found = index.constFind(documentIndex);
+            if (found == index.constEnd())
+            {
+                if (static_cast<quint32>(sidecar.formats.size()) >= MaxFormats)
+                    continue;
+                found = index.insert(documentIndex, static_cast<quint32>(sidecar.formats.size()));
+                sidecar.formats.append(format);
+            }
+
+            // Соседние фрагменты одного формата сливаются в серию. Промежуток допустим только
+            // один — разделитель между концом прошлого абзаца и началом этого
+            Run run;
+            run.offset = fragment.position();
+            run.length = fragment.length();
+            run.format = found.value();
+            if (!sidecar.runs.isEmpty())
+            {
+                Run &last = sidecar.runs.last();
+                const int lastEnd = last.offset + last.length;
+                const bool adjacent = lastEnd == run.offset ||
+                                      (lastEnd == previousBlockEnd && run.offset == blockStart);
+                if (last.format == run.format && adjacent)
+                {
+                    last.length = run.offset + run.length - last.offset;
+                    continue;
+                }
+            }
+            sidecar.runs.append(run);
+        }
+        previousBlockEnd = block.position() + block.length() - 1;
+    }
+    return sidecar;
+}
+
+bool TextFormatSidecar::write(QIODevice *device) const
+{
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << Magic << Version << textLength << textHash;
+    out << static_cast<quint32>(formats.size());
+    for (const QTextCharFormat &format : formats)
+    {
+        out << format;
+    }
+    out << static_cast<quint32>(runs.size());
+    for (const Run &run : runs)
+    {
+        out << run.offset << run.length << run.format;
+    }
+    return out.status() == QDataStream::Ok;
+}
+
+bool TextFormatSidecar::read(QIODevice *device)
+{
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+    if (magic != Magic || version == 0 || version > Version)
+        return false;
+
+    quint32 formatCount = 0;
+    in >> textLength >> textHash >> formatCount;
+    if (in.status() != QDataStream::Ok || textLength < 0 || formatCount > MaxFormats)
+        return false;
+
+    formats.clear();
+    formats.reserve(static_cast<int>(formatCount));
+    for (quint32 i = 0; i < formatCount; ++i)
+    {
+        QTextFormat format;
+        in >> format;
+        formats.append(format.toCharFormat());
+    }
+
+    quint32 runCount = 0;
+    in >> runCount;
+    // Серий не больше, чем символов текста
+    if (in.status() != QDataStream::Ok || runCount > static_cast<quint64>(textLength))
+        return false;
+
+    runs.clear();
+    runs.reserve(static_cast<int>(runCount));
+    for (quint32 i = 0; i < runCount; ++i)
+    {
+        Run run;
+        in >> run.offset >> run.length >> run.format;
+        runs.append(run);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+bool TextFormatSidecar::apply(QTextDocument *document) const
+{
+    if (document->characterCount() - 1 != textLength || hashOf(document) != textHash)
+        return false;
+
+    // Все серии — одна правка: документ перестраивает раскладку один раз, а не после каждой
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (const Run &run : runs)
+    {
+        if (run.format >= static_cast<quint32>(formats.size()) || run.offset < 0 || run.length <= 0 ||
+            run.offset + static_cast<qint64>(run.length) > textLength)
+            continue;
+        cursor.setPosition(run.offset);
+        cursor.setPosition(run.offset + run.length, QTextCursor::KeepAnchor);
+        cursor.setCharFormat(formats.at(static_cast<int>(run.format)));
+    }
+    cursor.endEditBlock();
+    return true;
+}
+
+QByteArray TextFormatSidecar::hashOf(const QTextDocument *document)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    const QChar separator = QChar::ParagraphSeparator;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+    {
+        // Текст берётся таким, каким его пишет TextFileWriter: после повторного открытия
+        // перенос внутри абзаца становится границей абзаца, а неразрывный пробел — обычным
+        QString text = block.text();
+        text.replace(QChar::LineSeparator, QChar::ParagraphSeparator);
+        text.replace(QChar::Nbsp, QLatin1Char(' '));
+        hash.addData(reinterpret_cast<const char *>(text.constData()), text.size() * static_cast<int>(sizeof(QChar)));
+        hash.addData(reinterpret_cast<const char *>(&separator), static_cast<int>(sizeof(QChar)));
+    }
+    return hash.result();
+}
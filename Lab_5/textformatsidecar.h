@@ -0,0 +1,47 @@
+#ifndef TEXTFORMATSIDECAR_H
+#define TEXTFORMATSIDECAR_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QVector>
+#include <QTextCharFormat>
+#include <QTextDocument>
+
+// Файл оформления текста (textSettings/<имя>.format). Формат двоичный и версионный:
+//   заголовок: сигнатура, версия, длина текста и хеш его содержимого;
+//   таблица уникальных форматов символов (номера — в порядке появления);
+//   серии (смещение, длина, номер формата) для оформленных участков текста.
+// Текст открывается как обычно, а серии накладываются на него без разбора HTML
+class TextFormatSidecar
+{
+public:
+    struct Run
+    {
+        qint32 offset = 0;
+        qint32 length = 0;
+        quint32 format = 0;
+    };
+
+    qint64 textLength = 0;
+    QByteArray textHash;
+    QVector<QTextCharFormat> formats;
+    QVector<Run> runs;
+
+    // Серии описывают только сплошной текст: документ с таблицами (вложенными фреймами)
+    // так не сохранить
+    static bool canStore(const QTextDocument *document);
+    // Форматы берутся из коллекции документа, где одинаковые форматы уже сведены в один
+    static TextFormatSidecar fromDocument(const QTextDocument *document);
+
+    bool write(QIODevice *device) const;
+    bool read(QIODevice *device);
+
+    // false — текст документа не тот, для которого записано оформление
+    bool apply(QTextDocument *document) const;
+
+private:
+    // Хеш считается по абзацам, без копии всего текста
+    static QByteArray hashOf(const QTextDocument *document);
+};
+
+#endif // TEXTFORMATSIDECAR_H
@@ -0,0 +1,98 @@
+#include "textloader.h"
+
+#include <QFile>
+#include <QTextCodec>
+#include <QTextDecoder>
+#include <QScopedPointer>
+#include <QtConcurrent>
+
+namespace
+{
+    const qint64 ChunkSize = 1024 * 1024; // Столько документ успевает вставить, не задерживая отрисовку
+    const int MaxChunksInFlight = 2;      // Сколько готовых кусков может ждать вставки в GUI
+}
+
+TextLoader::TextLoader(const QString &path, QObject *parent) : QObject(parent),
+                                                               filePath(path),
+                                                               cancelled(0),
+                                                               freeSlots(MaxChunksInFlight)
+{
+}
+
+TextLoader::~TextLoader()
+{
+    // Закрытие вкладки во время загрузки: чтение останавливается на ближайшем куске
+    cancel();
+    future.waitForFinished();
+}
+
+void TextLoader::start()
+{
+    if (isRunning())
+        return;
+
+    cancelled.storeRelease(0);
+    future = QtConcurrent::run(this, &TextLoader::run);
+}
+
+void TextLoader::cancel()
+{
+    cancelled.storeRelease(1);
+}
+
+bool TextLoader::isRunning() const
+{
+    return future.isRunning();
+}
+
+void TextLoader::chunkConsumed()
+{
+    freeSlots.release();
+}
+
+bool TextLoader::waitForSlot()
+{
+    // Ждём, пока GUI вставит предыдущие куски, и при этом следим за отменой
+    while (!freeSlots.tryAcquire(1, 50))
+    {
+        if (cancelled.loadAcquire())
+            return false;
+    }
+    return !cancelled.loadAcquire();
+}
+
+void TextLoader::run()
+{
+    // Текстовый режим, как у QTextStream раньше: \r\n превращаются в \n при чтении
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        emit finished(false, tr("Не удалось открыть файл"));
+        return;
+    }
+
+    const qint64 size = file.size();
+    QScopedPointer<QTextDecoder> decoder;
+    qint64 done = 0;
+    while (!file.atEnd())
+    {
+        const QByteArray bytes = file.read(ChunkSize);
+        if (bytes.isEmpty())
+            break;
+        // Декодер хранит состояние: символ, разрезанный границей куска, собирается в следующем
+        if (!decoder)
+            decoder.reset(QTextCodec::codecForUtfText(bytes, QTextCodec::codecForLocale())->makeDecoder());
+        const QString text = decoder->toUnicode(bytes);
+
+        if (!waitForSlot())
+            break;
+        emit chunkReady(text);
+        done += bytes.size();
+        emit progressChanged(static_cast<int>(qMin<qint64>(done * 100 / qMax<qint64>(size, 1), 100)));
+    }
+
+    if (file.error() != QFileDevice::NoError)
+        emit finished(false, tr("Не удалось прочитать файл"));
+    else
+        emit finished(!cancelled.loadAcquire(), QString());
+}
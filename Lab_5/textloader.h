@@ -0,0 +1,43 @@
+#ifndef TEXTLOADER_H
+#define TEXTLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QSemaphore>
+
+// Загрузчик текстового файла: читает файл кусками в пуле потоков, декодирует их (кодировка
+// по BOM, иначе системная) и по порядку отдаёт готовый текст в GUI-поток. Вкладка показывает
+// начало файла сразу и дописывает остальное между итерациями цикла событий
+class TextLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TextLoader(const QString &path, QObject *parent = nullptr);
+    ~TextLoader() override;
+
+    void start();
+    void cancel();
+    bool isRunning() const;
+
+    // Получатель вызывает после вставки каждого куска, чтобы загрузчик не обгонял GUI
+    void chunkConsumed();
+
+signals:
+    void chunkReady(const QString &text);
+    void progressChanged(int percent);
+    void finished(bool success, const QString &errorMessage);
+
+private:
+    void run();
+    bool waitForSlot();
+
+    QString filePath;
+    QFuture<void> future;
+    QAtomicInt cancelled;
+    QSemaphore freeSlots; // Сколько кусков ещё можно отправить, не дожидаясь GUI
+};
+
+#endif // TEXTLOADER_H